@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# The benchmarks of the server's hot paths, built against ../Build
+# (build the libraries first). See each main.cpp for its arguments.
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    DirWalkerBench \
+    ReadEntriesBench \
+    PathSetBench \
+    ScriptBench
@@ -0,0 +1,38 @@
+#-------------------------------------------------
+#
+# Times the work-stealing DirWalker against a single-threaded walk
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = DirWalkerBench
+TEMPLATE = app
+CONFIG   += console
+CONFIG   -= app_bundle
+
+DESTDIR = ../../Build
+unix:{
+  QMAKE_LFLAGS += -Wl,--rpath="$$_PRO_FILE_PWD_/../../Build"
+  QMAKE_LFLAGS_RPATH="$$_PRO_FILE_PWD_/../../Build"
+}
+
+LIBS += -L"$$_PRO_FILE_PWD_/../../Build/" -lPluginInterface -lQFileExtensions
+
+# the walker is timed without a notifier, DirNotifier is left out
+DEFINES += WALKER_WITHOUT_NOTIFIER
+
+INCLUDEPATH += ../../Server
+INCLUDEPATH += ../../PluginInterface
+INCLUDEPATH += ../../QFileExtensions
+
+SOURCES += main.cpp \
+    ../../Server/dirwalker.cpp \
+    ../../Server/watchpredicate.cpp \
+    ../../Server/globset.cpp
+
+HEADERS += \
+    ../../Server/dirwalker.h \
+    ../../Server/watchpredicate.h \
+    ../../Server/globset.h
@@ -0,0 +1,191 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QDir>
+#include <QFile>
+#include <QTime>
+
+#include "dirwalker.h"
+#include "qdirext.h"
+
+#define BENCH_DEPTH         4       // levels of directories below the root
+#define BENCH_FANOUT        8       // sub directories per directory
+#define BENCH_FILES         32      // files per directory
+#define BENCH_RUNS          5       // timed walks of each kind, the best one is reported
+
+/**
+  * Times the discovery of a directory tree: the work-stealing DirWalker against the single-threaded
+  * depth first walk it replaced, both listing with QDirExt::readEntries (types only). The tree is
+  * generated under a temporary directory unless root=<path> is given:
+  *
+  *     DirWalkerBench [root=<path>] [depth=<n>] [fanout=<n>] [files=<n>] [runs=<n>]
+  *
+  * Each walk runs once to warm the caches, then runs times. The best times are reported: drop the
+  * page cache between the runs to time cold walks.
+  */
+
+static QTextStream out(stdout);
+
+/**
+  * Generates depth levels of fanout sub directories, each directory holding files empty files.
+  */
+static int generateTree(const QString &root, int depth, int fanout, int files) {
+    int numEntries = 0;
+
+    QDir().mkpath(root);
+
+    for (int i = 0; i < files; i++) {
+        QFile file(root + QDir::separator() + QString("file%1.txt").arg(i));
+        file.open(QIODevice::WriteOnly);
+        numEntries++;
+    }
+
+    if (!depth)
+        return numEntries;
+
+    for (int i = 0; i < fanout; i++)
+        numEntries += 1 + generateTree(root + QDir::separator() + QString("dir%1").arg(i), depth - 1, fanout, files);
+
+    return numEntries;
+}
+
+static void removeTree(const QString &root) {
+    QFileInfoList entries = QDir(root).entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+
+    for (int i = 0; i < entries.count(); i++) {
+        if (entries[i].isDir() && !entries[i].isSymLink())
+            removeTree(entries[i].filePath());
+        else
+            QFile::remove(entries[i].filePath());
+    }
+
+    QDir().rmdir(root);
+}
+
+/**
+  * The walk before the DirWalker: depth first, on the calling thread. Returns the entries found.
+  */
+static int walkSequentially(const QString &directory) {
+    QList<QDirExtEntry> entries;
+    int                 numEntries = 0;
+
+    QDirExt::readEntries(directory, &entries);
+
+    for (QList<QDirExtEntry>::iterator i = entries.begin(); i != entries.end(); i++) {
+        if (i->m_isHidden)
+            continue;
+
+        numEntries++;
+        if (i->m_isDir)
+            numEntries += walkSequentially(directory + QDirExt::separator(directory) + i->m_name);
+    }
+
+    return numEntries;
+}
+
+/**
+  * Walks with the DirWalker, consuming its batches as the watcher does. Returns the entries found.
+  */
+static int walkInParallel(const QString &root) {
+    DirWalker   walker(true);
+    WalkerBatch batch;
+    int         numEntries = 0;
+
+    walker.start(root);
+    while (walker.nextBatch(&batch))
+        numEntries += batch.count();
+
+    // the root is handed over as a directory too
+    return numEntries - 1;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QString root;
+    int     depth = BENCH_DEPTH;
+    int     fanout = BENCH_FANOUT;
+    int     files = BENCH_FILES;
+    int     runs = BENCH_RUNS;
+
+    QStringList arguments = app.arguments();
+    for (int i = 1; i < arguments.count(); i++) {
+        QString argument = arguments[i];
+        QString value = argument.mid(argument.indexOf("=") + 1);
+
+        if (argument.startsWith("root="))
+            root = value;
+        else if (argument.startsWith("depth="))
+            depth = value.toInt();
+        else if (argument.startsWith("fanout="))
+            fanout = value.toInt();
+        else if (argument.startsWith("files="))
+            files = value.toInt();
+        else if (argument.startsWith("runs="))
+            runs = qMax(1, value.toInt());
+    }
+
+    bool generated = root.isEmpty();
+    if (generated) {
+        root = QDir::tempPath() + QDir::separator() + QString("DirWalkerBench%1").arg(app.applicationPid());
+
+        out << "Generating " << depth << " levels of " << fanout << " directories, " << files << " files each, under " << root << endl;
+        int numEntries = generateTree(root, depth, fanout, files);
+        out << numEntries << " entries generated" << endl;
+    }
+
+    // warm up, and check both walks find the same entries
+    int sequentialEntries = walkSequentially(root);
+    int parallelEntries = walkInParallel(root);
+    if (sequentialEntries != parallelEntries)
+        out << "WARNING: the sequential walk found " << sequentialEntries << " entries, the walker " << parallelEntries << endl;
+
+    int bestSequential = -1;
+    int bestParallel = -1;
+    for (int i = 0; i < runs; i++) {
+        QTime time;
+
+        time.start();
+        walkSequentially(root);
+        int elapsed = time.elapsed();
+        bestSequential = bestSequential == -1 ? elapsed : qMin(bestSequential, elapsed);
+
+        time.start();
+        walkInParallel(root);
+        elapsed = time.elapsed();
+        bestParallel = bestParallel == -1 ? elapsed : qMin(bestParallel, elapsed);
+    }
+
+    out << "Entries:           " << parallelEntries << endl;
+    out << "Walker threads:    " << QThread::idealThreadCount() * WALKER_THREADS_PER_CORE << endl;
+    out << "Single-threaded:   " << bestSequential << " ms" << endl;
+    out << "Work-stealing:     " << bestParallel << " ms" << endl;
+    out << "Speedup:           " << (bestParallel ? QString::number((double)bestSequential / bestParallel, 'f', 2) : QString("n/a")) << endl;
+
+    if (generated)
+        removeTree(root);
+
+    return 0;
+}
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Compares the PathSet trie with the former QMap based PathSet
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = PathSetBench
+TEMPLATE = app
+CONFIG   += console
+CONFIG   -= app_bundle
+
+DESTDIR = ../../Build
+
+INCLUDEPATH += ../../Server
+
+SOURCES += main.cpp \
+    oldpathsegment.cpp \
+    ../../Server/pathsegment.cpp
+
+HEADERS += \
+    oldpathsegment.h \
+    ../../Server/pathsegment.h
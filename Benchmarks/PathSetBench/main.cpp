@@ -0,0 +1,228 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QDirIterator>
+#include <QVector>
+#include <QFile>
+#include <QTime>
+
+#include <stdlib.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "pathsegment.h"
+#include "oldpathsegment.h"
+
+#define BENCH_ROOT          "/usr"      // walked for paths unless a list is given
+#define BENCH_MAX_PATHS     3000000     // paths loaded at most
+
+/**
+  * Loads a few million real paths in the current PathSet (a trie of arena-allocated segments with
+  * interned names) and in the former one (a QMap and a heap allocation per segment), and reports
+  * for each the heap bytes per path and the insert and lookup rates:
+  *
+  *     PathSetBench [paths=<file>] [root=<path>] [max=<n>]
+  *
+  * The paths are read from a file, one per line (directories end with a '/'), or found walking
+  * root. The bytes are the heap in use once the set is built less before (glibc only, counted by
+  * wrapping the allocator), and the sets' own footprint estimate. The lookups are made in
+  * shuffled order.
+  */
+
+static QTextStream out(stdout);
+
+#ifdef __GLIBC__
+// the allocations of the whole process go through these, Qt's included
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+extern "C" void __libc_free(void *p);
+
+static volatile long liveBytes = 0;
+
+extern "C" void *malloc(size_t size) {
+    void *p = __libc_malloc(size);
+    if (p)
+        __sync_fetch_and_add(&liveBytes, (long)malloc_usable_size(p));
+    return p;
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+    void *p = __libc_calloc(count, size);
+    if (p)
+        __sync_fetch_and_add(&liveBytes, (long)malloc_usable_size(p));
+    return p;
+}
+
+extern "C" void *realloc(void *p, size_t size) {
+    long former = p ? (long)malloc_usable_size(p) : 0;
+
+    void *q = __libc_realloc(p, size);
+    if (q)
+        __sync_fetch_and_add(&liveBytes, (long)malloc_usable_size(q) - former);
+    else if (!size)
+        __sync_fetch_and_sub(&liveBytes, former);
+    return q;
+}
+
+extern "C" void free(void *p) {
+    if (p)
+        __sync_fetch_and_sub(&liveBytes, (long)malloc_usable_size(p));
+    __libc_free(p);
+}
+#define BYTES_COUNTED   true
+#else
+static volatile long liveBytes = 0;
+#define BYTES_COUNTED   false
+#endif
+
+/**
+  * The results of a path set.
+  */
+class SetResults {
+public:
+    long    m_bytes;        // heap used by the set
+    qint64  m_footprint;    // as the set accounts for itself
+    int     m_insertTime;   // ms
+    int     m_lookupTime;
+    int     m_numFound;
+};
+
+/**
+  * Builds a set of the paths, then looks them up in the given order.
+  */
+template <class Set> static SetResults measure(const QStringList &paths, const QVector<bool> &directories, const QVector<int> &order) {
+    SetResults  results;
+    QTime       time;
+    long        bytes = liveBytes;
+    Set         *setP = new Set();
+
+    time.start();
+    for (int i = 0; i < paths.count(); i++)
+        setP->addPath(paths[i], directories[i]);
+    results.m_insertTime = time.elapsed();
+
+    results.m_bytes = liveBytes - bytes;
+    results.m_footprint = setP->footprint();
+
+    results.m_numFound = 0;
+    time.start();
+    for (int i = 0; i < order.count(); i++)
+        if (setP->findPath(paths[order[i]]))
+            results.m_numFound++;
+    results.m_lookupTime = time.elapsed();
+
+    delete setP;
+
+    return results;
+}
+
+static QString rate(int count, int ms) {
+    return ms ? QString::number((qint64)count * 1000 / ms) : QString("n/a");
+}
+
+static void report(const QString &name, const SetResults &results, int numPaths) {
+    out << qSetFieldWidth(12) << left << name
+        << qSetFieldWidth(16) << (BYTES_COUNTED ? QString::number((double)results.m_bytes / numPaths, 'f', 1) : QString("n/a"))
+        << QString::number((double)results.m_footprint / numPaths, 'f', 1)
+        << rate(numPaths, results.m_insertTime) << rate(numPaths, results.m_lookupTime)
+        << qSetFieldWidth(0) << endl;
+
+    if (results.m_numFound != numPaths)
+        out << "WARNING: " << name << " found " << results.m_numFound << " paths of " << numPaths << endl;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QString list;
+    QString root = BENCH_ROOT;
+    int     maxPaths = BENCH_MAX_PATHS;
+
+    QStringList arguments = app.arguments();
+    for (int i = 1; i < arguments.count(); i++) {
+        QString argument = arguments[i];
+        QString value = argument.mid(argument.indexOf("=") + 1);
+
+        if (argument.startsWith("paths="))
+            list = value;
+        else if (argument.startsWith("root="))
+            root = value;
+        else if (argument.startsWith("max="))
+            maxPaths = value.toInt();
+    }
+
+    QStringList     paths;
+    QVector<bool>   directories;
+
+    if (!list.isEmpty()) {
+        QFile file(list);
+        if (!file.open(QIODevice::ReadOnly)) {
+            out << "Can't read " << list << endl;
+            return -1;
+        }
+
+        QTextStream in(&file);
+        while (!in.atEnd() && paths.count() < maxPaths) {
+            QString path = in.readLine();
+            bool    directory = path.length() > 1 && path.endsWith('/');
+
+            if (directory)
+                path.chop(1);
+            if (path.isEmpty())
+                continue;
+
+            paths.append(path);
+            directories.append(directory);
+        }
+    } else {
+        QDirIterator i(root, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System, QDirIterator::Subdirectories);
+        while (i.hasNext() && paths.count() < maxPaths) {
+            paths.append(i.next());
+            directories.append(i.fileInfo().isDir() && !i.fileInfo().isSymLink());
+        }
+    }
+
+    out << paths.count() << " paths loaded from " << (list.isEmpty() ? root : list) << endl;
+    if (paths.isEmpty())
+        return -1;
+
+    // the same shuffled lookup order for both
+    QVector<int> order(paths.count());
+    for (int i = 0; i < order.count(); i++)
+        order[i] = i;
+    qsrand(1);
+    for (int i = order.count() - 1; i > 0; i--)
+        qSwap(order[i], order[qrand() % (i + 1)]);
+
+    out << qSetFieldWidth(12) << left << "set" << qSetFieldWidth(16) << "heap bytes/path" << "footprint/path" << "inserts/s" << "lookups/s" << qSetFieldWidth(0) << endl;
+
+    report("QMap", measure<Old::PathSet>(paths, directories, order), paths.count());
+    report("trie", measure<PathSet>(paths, directories, order), paths.count());
+
+    return 0;
+}
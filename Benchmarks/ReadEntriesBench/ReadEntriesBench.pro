@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Times QDirExt::readEntries against the QFileInfoExt per entry listing
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = ReadEntriesBench
+TEMPLATE = app
+CONFIG   += console
+CONFIG   -= app_bundle
+
+DESTDIR = ../../Build
+unix:{
+  QMAKE_LFLAGS += -Wl,--rpath="$$_PRO_FILE_PWD_/../../Build"
+  QMAKE_LFLAGS_RPATH="$$_PRO_FILE_PWD_/../../Build"
+}
+
+LIBS += -L"$$_PRO_FILE_PWD_/../../Build/" -lQFileExtensions
+
+INCLUDEPATH += ../../QFileExtensions
+
+SOURCES += main.cpp
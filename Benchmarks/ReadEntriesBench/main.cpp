@@ -0,0 +1,260 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QProcess>
+#include <QDir>
+#include <QFile>
+#include <QTime>
+
+#include <stdlib.h>
+
+#include "qdirext.h"
+#include "qfileinfoext.h"
+
+#define BENCH_ENTRIES       1000000 // files in the generated directory
+#define BENCH_RUNS          3       // timed listings of each kind, the best one is reported
+#define BENCH_STRACE        "strace" // counts the getdents calls, if installed
+
+/**
+  * Lists a directory of a million entries the way the watcher did before QDirExt::readEntries (a
+  * QDirExt::entryList, then a QFileInfoExt per entry to tell hidden files and directories) and
+  * with readEntries, types only and with stat:
+  *
+  *     ReadEntriesBench [dir=<path>] [entries=<n>] [runs=<n>]
+  *
+  * The directory is generated under a temporary directory unless dir=<path> is given. Reported for
+  * each path: the best wall time of runs listings (the caches are warm), the heap allocations of
+  * a listing (malloc, calloc and realloc calls, counted on glibc only), and the getdents calls of a
+  * listing, counted by running the bench itself under strace -c (n/a without strace).
+  */
+
+static QTextStream out(stdout);
+
+#ifdef __GLIBC__
+// the allocations of the whole process go through these, Qt's included
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+
+static volatile long numAllocations = 0;
+
+extern "C" void *malloc(size_t size) {
+    __sync_fetch_and_add(&numAllocations, 1);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+    __sync_fetch_and_add(&numAllocations, 1);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *p, size_t size) {
+    __sync_fetch_and_add(&numAllocations, 1);
+    return __libc_realloc(p, size);
+}
+#define ALLOCATIONS_COUNTED     true
+#else
+static volatile long numAllocations = 0;
+#define ALLOCATIONS_COUNTED     false
+#endif
+
+/**
+  * The listing before readEntries. Returns the visible entries.
+  */
+static int listWithFileInfo(const QString &directory) {
+    QDirExt     dir(directory);
+    QStringList names = dir.entryList();
+    int         numEntries = 0;
+
+    for (QList<QString>::iterator i = names.begin(); i != names.end(); i++) {
+        if (*i == "." || *i == "..")
+            continue;
+
+        QString entryPath = directory;
+        entryPath.append(QDirExt::separator(directory));
+        entryPath.append(*i);
+        QFileInfoExt entry(entryPath);
+
+        if (entry.isHidden())
+            continue;
+
+        if (!entry.isDir())
+            numEntries++;
+    }
+
+    return numEntries;
+}
+
+static int listWithReadEntries(const QString &directory, bool withStat) {
+    QList<QDirExtEntry> entries;
+    int                 numEntries = 0;
+
+    QDirExt::readEntries(directory, &entries, withStat);
+    for (QList<QDirExtEntry>::const_iterator i = entries.begin(); i != entries.end(); i++)
+        if (!i->m_isHidden && !i->m_isDir)
+            numEntries++;
+
+    return numEntries;
+}
+
+static int list(const QString &path, const QString &directory) {
+    if (path == "fileinfo")
+        return listWithFileInfo(directory);
+    if (path == "readentries")
+        return listWithReadEntries(directory, false);
+    if (path == "readentries+stat")
+        return listWithReadEntries(directory, true);
+
+    return 0;
+}
+
+/**
+  * Returns the getdents calls of a listing: the bench lists once under strace, less what it
+  * calls without listing. Returns -1 if strace couldn't be run.
+  */
+static qint64 countGetdents(const QString &program, const QString &path, const QString &directory) {
+    qint64 numCalls[2] = { 0, 0 };
+
+    for (int i = 0; i < 2; i++) {
+        QString     output = QDir::tempPath() + QDir::separator() + QString("ReadEntriesBench%1.strace").arg(QCoreApplication::applicationPid());
+        QStringList arguments;
+
+        arguments << "-f" << "-c" << "-e" << "trace=getdents,getdents64" << "-o" << output
+                  << program << QString("list=%1").arg(i ? path : QString("none")) << QString("dir=%1").arg(directory);
+        if (QProcess::execute(BENCH_STRACE, arguments) != 0)
+            return -1;
+
+        QFile file(output);
+        if (!file.open(QIODevice::ReadOnly))
+            return -1;
+
+        // % time, seconds, usecs/call, calls, [errors], syscall
+        QStringList lines = QString(file.readAll()).split('\n');
+        for (int j = 0; j < lines.count(); j++) {
+            QStringList columns = lines[j].simplified().split(' ');
+            if (columns.count() >= 5 && columns.last().startsWith("getdents"))
+                numCalls[i] += columns[3].toLongLong();
+        }
+
+        file.remove();
+    }
+
+    return numCalls[1] - numCalls[0];
+}
+
+static void generateDirectory(const QString &directory, int numEntries) {
+    QDir().mkpath(directory);
+
+    for (int i = 0; i < numEntries; i++) {
+        QFile file(directory + QDir::separator() + QString("file%1.txt").arg(i));
+        file.open(QIODevice::WriteOnly);
+    }
+}
+
+static void removeDirectory(const QString &directory) {
+    QList<QDirExtEntry> entries;
+
+    QDirExt::readEntries(directory, &entries);
+    for (int i = 0; i < entries.count(); i++)
+        QFile::remove(directory + QDir::separator() + entries[i].m_name);
+
+    QDir().rmdir(directory);
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QString directory;
+    QString listOnly;
+    int     numEntries = BENCH_ENTRIES;
+    int     runs = BENCH_RUNS;
+
+    QStringList arguments = app.arguments();
+    for (int i = 1; i < arguments.count(); i++) {
+        QString argument = arguments[i];
+        QString value = argument.mid(argument.indexOf("=") + 1);
+
+        if (argument.startsWith("dir="))
+            directory = value;
+        else if (argument.startsWith("entries="))
+            numEntries = value.toInt();
+        else if (argument.startsWith("runs="))
+            runs = qMax(1, value.toInt());
+        else if (argument.startsWith("list="))
+            listOnly = value;
+    }
+
+    // run under strace by countGetdents
+    if (!listOnly.isEmpty()) {
+        list(listOnly, directory);
+        return 0;
+    }
+
+    bool generated = directory.isEmpty();
+    if (generated) {
+        directory = QDir::tempPath() + QDir::separator() + QString("ReadEntriesBench%1").arg(app.applicationPid());
+
+        out << "Generating " << numEntries << " files under " << directory << endl;
+        generateDirectory(directory, numEntries);
+    }
+
+    QStringList paths;
+    paths << "fileinfo" << "readentries" << "readentries+stat";
+
+    out << qSetFieldWidth(20) << left << "path" << "wall time (ms)" << "allocations" << "getdents calls" << qSetFieldWidth(0) << endl;
+
+    for (int i = 0; i < paths.count(); i++) {
+        // warm up
+        int found = list(paths[i], directory);
+
+        int bestTime = -1;
+        for (int j = 0; j < runs; j++) {
+            QTime time;
+
+            time.start();
+            list(paths[i], directory);
+            int elapsed = time.elapsed();
+            bestTime = bestTime == -1 ? elapsed : qMin(bestTime, elapsed);
+        }
+
+        long allocations = numAllocations;
+        list(paths[i], directory);
+        allocations = numAllocations - allocations;
+
+        qint64 getdents = countGetdents(app.applicationFilePath(), paths[i], directory);
+
+        out << qSetFieldWidth(20) << left << paths[i] << bestTime
+            << (ALLOCATIONS_COUNTED ? QString::number(allocations) : QString("n/a"))
+            << (getdents != -1 ? QString::number(getdents) : QString("n/a")) << qSetFieldWidth(0) << endl;
+
+        if (found != numEntries && generated)
+            out << "WARNING: " << paths[i] << " found " << found << " files" << endl;
+    }
+
+    if (generated)
+        removeDirectory(directory);
+
+    return 0;
+}
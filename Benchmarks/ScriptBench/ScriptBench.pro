@@ -0,0 +1,29 @@
+#-------------------------------------------------
+#
+# Scripts/s with per-thread script engines against the shared engine
+#
+#-------------------------------------------------
+
+QT       += core script
+QT       -= gui
+
+TARGET = ScriptBench
+TEMPLATE = app
+CONFIG   += console
+CONFIG   -= app_bundle
+
+DESTDIR = ../../Build
+unix:{
+  QMAKE_LFLAGS += -Wl,--rpath="$$_PRO_FILE_PWD_/../../Build"
+  QMAKE_LFLAGS_RPATH="$$_PRO_FILE_PWD_/../../Build"
+}
+
+LIBS += -L"$$_PRO_FILE_PWD_/../../Build/" -lPluginInterface
+
+INCLUDEPATH += ../../PluginInterface
+
+SOURCES += main.cpp \
+    oldscriptrunner.cpp
+
+HEADERS += \
+    oldscriptrunner.h
@@ -0,0 +1,175 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QPluginLoader>
+#include <QThread>
+#include <QList>
+#include <QFile>
+#include <QTime>
+
+#include "plugininterface.h"
+#include "scriptrunner.h"
+#include "oldscriptrunner.h"
+#include "script.h"
+
+#define BENCH_SCRIPTS       20000   // scripts run by each thread
+#define BENCH_PLUGIN        "libFilePlugin.so" // next to the bench, in the build directory
+#define BENCH_SCRIPT        "{\n\tvar type = plugin.getAttributeValue(\"Type\");\n\tplugin.setResult((type == \"mp3\" || type == \"ogg\") && plugin.getAttributeValue(\"Size\") > 1024);\n}"
+
+/**
+  * Runs a rules script from 1, 2, 4 and 8 threads, each with its own plugin instance as the
+  * indexer workers, with the per-thread script engines (ScriptRunner) and with the single engine
+  * they replaced (Old::ScriptRunner), and reports the scripts run per second:
+  *
+  *     ScriptBench [plugin=<library>] [script=<file>] [scripts=<n>]
+  *
+  * The plugin is the FilePlugin library of the build directory unless given, its attributes are
+  * set once per thread (nothing is read from disk). The times include the creation of the
+  * per-thread engines, made by each thread's first script.
+  */
+
+static QTextStream out(stdout);
+
+/**
+  * Runs a script a number of times with a plugin instance.
+  */
+class BenchThread : public QThread {
+public:
+    BenchThread(PluginInterface *pluginP, const QString &script, int numScripts, bool shared) : m_script(script) {
+        m_pluginP = pluginP;
+        m_numScripts = numScripts;
+        m_numRetained = 0;
+
+        // made on the main thread, the runners share the single engine
+        m_sharedRunnerP = shared ? new Old::ScriptRunner() : NULL;
+    }
+
+    ~BenchThread() {
+        if (m_sharedRunnerP)
+            delete m_sharedRunnerP;
+    }
+
+    int m_numRetained;
+
+protected:
+    void run() {
+        ScriptRunner runner;
+
+        for (int i = 0; i < m_numScripts; i++) {
+            bool retained = m_sharedRunnerP ? m_sharedRunnerP->run(&m_script, m_pluginP) : runner.run(&m_script, m_pluginP);
+            if (retained)
+                m_numRetained++;
+        }
+    }
+
+private:
+    PluginInterface     *m_pluginP;
+    Script              m_script;
+    int                 m_numScripts;
+    Old::ScriptRunner   *m_sharedRunnerP;   // NULL for the per-thread engines
+};
+
+/**
+  * Returns the scripts run per second by numThreads threads.
+  */
+static double measure(const QList<PluginInterface *> &plugins, int numThreads, const QString &script, int numScripts, bool shared) {
+    QList<BenchThread *>    threads;
+    QTime                   time;
+
+    for (int i = 0; i < numThreads; i++)
+        threads.append(new BenchThread(plugins[i], script, numScripts, shared));
+
+    time.start();
+    for (int i = 0; i < threads.count(); i++)
+        threads[i]->start();
+    for (int i = 0; i < threads.count(); i++)
+        threads[i]->wait();
+    int elapsed = time.elapsed();
+
+    int numRetained = 0;
+    for (int i = 0; i < threads.count(); i++)
+        numRetained += threads[i]->m_numRetained;
+    qDeleteAll(threads);
+
+    if (numRetained != numThreads * numScripts)
+        out << "WARNING: " << numRetained << " of " << numThreads * numScripts << " scripts retained the file" << endl;
+
+    return elapsed ? (double)numThreads * numScripts * 1000 / elapsed : 0;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QString pluginFilename = app.applicationDirPath() + "/" + BENCH_PLUGIN;
+    QString script = BENCH_SCRIPT;
+    int     numScripts = BENCH_SCRIPTS;
+
+    QStringList arguments = app.arguments();
+    for (int i = 1; i < arguments.count(); i++) {
+        QString argument = arguments[i];
+        QString value = argument.mid(argument.indexOf("=") + 1);
+
+        if (argument.startsWith("plugin="))
+            pluginFilename = value;
+        else if (argument.startsWith("scripts="))
+            numScripts = qMax(1, value.toInt());
+        else if (argument.startsWith("script=")) {
+            QFile file(value);
+            if (file.open(QIODevice::ReadOnly))
+                script = QString::fromUtf8(file.readAll());
+        }
+    }
+
+    QPluginLoader loader(pluginFilename);
+    PluginInterface *prototypeP = qobject_cast<PluginInterface *>(loader.instance());
+    if (!prototypeP) {
+        out << "Failed to load plugin: " << pluginFilename << ", error: " << loader.errorString() << endl;
+        return -1;
+    }
+
+    // an instance per thread, the script retains its file
+    QList<PluginInterface *> plugins;
+    for (int i = 0; i < 8; i++) {
+        PluginInterface *pluginP = prototypeP->newInstance("/bench");
+        pluginP->setAttributeValue("Type", "mp3");
+        pluginP->setAttributeValue("Size", 4096);
+        plugins.append(pluginP);
+    }
+
+    out << qSetFieldWidth(10) << left << "threads" << qSetFieldWidth(20) << "shared engine/s" << "per-thread/s" << "ratio" << qSetFieldWidth(0) << endl;
+
+    for (int numThreads = 1; numThreads <= 8; numThreads *= 2) {
+        double shared = measure(plugins, numThreads, script, numScripts, true);
+        double perThread = measure(plugins, numThreads, script, numScripts, false);
+
+        out << qSetFieldWidth(10) << left << numThreads << qSetFieldWidth(20)
+            << QString::number(shared, 'f', 0) << QString::number(perThread, 'f', 0)
+            << (shared ? QString::number(perThread / shared, 'f', 2) : QString("n/a")) << qSetFieldWidth(0) << endl;
+    }
+
+    qDeleteAll(plugins);
+
+    return 0;
+}
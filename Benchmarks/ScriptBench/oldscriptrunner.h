@@ -0,0 +1,58 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#ifndef OLDSCRIPTRUNNER_H
+#define OLDSCRIPTRUNNER_H
+
+#include <QObject>
+#include <QScriptEngine>
+#include <QSemaphore>
+
+#include "script.h"
+#include "plugininterface.h"
+
+/**
+  * The script runner as it was before each thread got its own engine: a single engine shared by
+  * all the filters and watchers, the scripts run one at a time. Kept as is for ScriptBench to
+  * compare with, in the Old namespace apart from the current one.
+  */
+namespace Old {
+
+class ScriptRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ScriptRunner(QObject *parentP = 0);
+    ~ScriptRunner();
+
+    bool run(Script *scriptP, PluginInterface *pluginP);
+
+private:
+    static QScriptEngine *m_scriptEngineP;
+    static int           m_scriptEngineRefCount;
+    static QSemaphore    *m_runningScriptP;           // don't run script concurrently since we have a single script engine for all filters/watchers...
+};
+
+} // namespace Old
+
+#endif // OLDSCRIPTRUNNER_H
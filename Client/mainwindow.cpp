@@ -866,9 +866,9 @@ void MainWindow::applyScript() {
     if (filterP) {
         filterP->setPluginScript(plugin, script);
 
-        // force a rescan of the directory if the plugin is running
+        // have the filter check its files against the new rules if the plugin is running
         if (filterP->isRunning())
-            m_serverProxy.rescanFilter(filter);
+            m_serverProxy.reevaluateFilter(filter);
     }
 }
 
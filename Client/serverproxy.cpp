@@ -115,6 +115,13 @@ void ServerProxy::addFilter(QString parent, QString filter, QString directory, b
     sendRequest(command);
 }
 
+// the globs follow the plugins, after an empty argument
+void ServerProxy::addFilter(QString parent, QString filter, QString directory, bool recursive, QStringList plugins, QStringList globs) {
+    QStringList command;
+    command << ADD_FILTER_COMMAND << parent << filter << directory << (recursive ? "TRUE" : "FALSE") << plugins << "" << globs;
+    sendRequest(command);
+}
+
 void ServerProxy::startFilter(QString filter) {
     QStringList command;
     command << START_FILTER_COMMAND << filter;
@@ -139,6 +146,13 @@ void ServerProxy::modifyFilter(QString filter, QString directory, bool recursive
     sendRequest(command);
 }
 
+// replaces the filter's globs, which the former one keeps
+void ServerProxy::modifyFilter(QString filter, QString directory, bool recursive, QStringList plugins, QStringList globs) {
+    QStringList command;
+    command << MODIFY_FILTER_COMMAND << filter << directory << (recursive ? "TRUE" : "FALSE") << plugins << "" << globs;
+    sendRequest(command);
+}
+
 void ServerProxy::removeFilter(QString filter) {
     QStringList command;
     command << REMOVE_FILTER_COMMAND << filter;
@@ -163,6 +177,12 @@ void ServerProxy::rescanFilter(QString filter) {
     sendRequest(command);
 }
 
+void ServerProxy::reevaluateFilter(QString filter) {
+    QStringList command;
+    command << REEVALUATE_FILTER_COMMAND << filter;
+    sendRequest(command);
+}
+
 void ServerProxy::cleanup() {
     QStringList command;
     command << CLEANUP_COMMAND;
@@ -232,6 +252,12 @@ void ServerProxy::requestFilterDirectory(QString filter) {
     sendRequest(command);
 }
 
+void ServerProxy::requestFilterGlobs(QString filter) {
+    QStringList command;
+    command << GET_FILTER_GLOBS_COMMAND << filter;
+    sendRequest(command);
+}
+
 void ServerProxy::requestFilterPlugins(QString filter) {
     QStringList command;
     command << PLUGINS_COMMAND << filter;
@@ -483,6 +509,16 @@ void ServerProxy::messageReceived(QString string) {
         return;
     }
 
+    // get filter globs
+    if (command == GET_FILTER_GLOBS_COMMAND){
+        if (arguments.count() >= 1) {
+            QString filter = arguments.takeFirst();
+            arguments.removeAll("");
+            filterGlobs(filter, arguments);
+        }
+        return;
+    }
+
     // list plugins for a filter
     if (command == PLUGINS_COMMAND){
         if (arguments.count() >= 2) {
@@ -70,6 +70,7 @@ signals:
     void filterIsRunning(QString filter, bool running);
 
     void filterDirectory(QString filter, QString directory);
+    void filterGlobs(QString filter, QStringList globs);
 
     void plugins(QString filter, QStringList plugins);
     void pluginNames(QString filter, QStringList pluginNames);
@@ -107,17 +108,20 @@ public:
     void newFilterSet();
 
     void addFilter(QString parent, QString filter, QString directory, bool recursive, QStringList plugins);
+    void addFilter(QString parent, QString filter, QString directory, bool recursive, QStringList plugins, QStringList globs);
     void startFilter(QString filter);
     void stopFilter(QString filter);
     void requestIsFilterRunning(QString filter);
 
     void modifyFilter(QString filter, QString directory, bool recursive, QStringList plugins);
+    void modifyFilter(QString filter, QString directory, bool recursive, QStringList plugins, QStringList globs);
     void removeFilter(QString filter);
 
     void setPluginScript(QString filter, QString plugin, QString script);
 
     void rescan();
     void rescanFilter(QString filter);
+    void reevaluateFilter(QString filter);
 
     void cleanup();
     void cleanupFilter(QString filter);
@@ -138,6 +142,7 @@ public:
     void requestDirectories(QString directory);
 
     void requestFilterDirectory(QString filter);
+    void requestFilterGlobs(QString filter);
     void requestFilterPlugins(QString filter);
     void requestFilterFiles(QString filter);
 
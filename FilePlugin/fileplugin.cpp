@@ -30,8 +30,10 @@
 
 #include "fileplugin.h"
 #include "scriptrunner.h"
+#include "iothrottle.h"
 
 QMap<QString, AttributeCacheEntry *> FilePlugin::m_attributesCache;
+QSemaphore FilePlugin::m_cacheSem(1);
 
 PluginInterface *FilePlugin::newInstance(QString virtualDirectoryPath) {
     FilePlugin *newInstanceP = new FilePlugin();
@@ -128,6 +130,7 @@ void FilePlugin::loadAttributes(QString filepath) {
         return;
 
     // get the file info.
+    IoThrottle::account(0, 1);
     QFileInfo fileInfo(filepath);
 
     setAttributeValue(PATH_ATTR, fileInfo.absolutePath());
@@ -155,16 +158,25 @@ bool FilePlugin::contains(QString regExp) {
     QString filename = getAttributeValue(NAME_ATTR).toString();
     QFile   file(path + QDir::separator() + filename);
 
+    IoThrottle::account(0, 1);
     if(!file.open(QIODevice::ReadOnly))
         return false;
 
-    // read the file content line by line and look for the regexp
+    // read the file content line by line and look for the regexp, the reads are accounted by chunks
     QTextStream in(&file);
+    qint64      accounted = 0;
     while(!result && !in.atEnd()) {
         QString line = in.readLine();
         if (exp.indexIn(line) >= 0)
             result = true;
+
+        qint64 read = file.pos() - accounted;
+        if (read >= IO_THROTTLE_CHUNK) {
+            IoThrottle::account(read);
+            accounted += read;
+        }
     }
+    IoThrottle::account(file.pos() - accounted);
 
     file.close();
 
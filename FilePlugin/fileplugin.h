@@ -73,7 +73,7 @@ class FILEPLUGINSHARED_EXPORT FilePlugin : public PluginInterface {
     Q_INTERFACES(PluginInterface)
 
 public:
-    explicit FilePlugin() : PluginInterface(), m_wrapper(this), m_cacheSem(1) {}
+    explicit FilePlugin() : PluginInterface(), m_wrapper(this) {}
 
     // there's no way to specify a constructor in a plugin interface (nor a static factory)
     // so we call pluginP = pluginP->newInstance(<vPath>); then unload the plugin.
@@ -177,6 +177,14 @@ public:
         return &m_wrapper;
     }
 
+    const QStringList getSuffixes() {
+        return m_suffixes;
+    }
+
+    const QList<QByteArray> getSignatures() {
+        return m_signatures;
+    }
+
 protected:
     AttributesMap          m_attributes;               // file attributes used to filter files
     QString                m_virtualDirectoryPath;     // the path of the associated virtual directory in the browser
@@ -184,7 +192,8 @@ protected:
     bool                   m_result;                   // result of the last run javascript rule
     ScriptRunner           m_scripter;
     PluginInterfaceWrapper m_wrapper;                  // wraps this to make it available in the script context
-    QSemaphore             m_cacheSem;
+    QStringList            m_suffixes;                 // the manifest, empty handles any file
+    QList<QByteArray>      m_signatures;
 
     void        saveAttributesInCache(QString filepath, QMap<QString, AttributeCacheEntry *> &attributesMapCache);          // cache the attributes for the given file
     bool        retrieveAttributesFromCache(QString filepath, QMap<QString, AttributeCacheEntry *> &attributesMapCache);    // reload attributes
@@ -192,6 +201,8 @@ protected:
     void        saveAttributes(AttributeCacheEntry *entryP);
     void        loadAttributes(AttributeCacheEntry *entryP);
 
+    static  QSemaphore     m_cacheSem;                 // protects the caches, shared by all the instances (and indexing threads)
+
 private:
     static  QMap<QString, AttributeCacheEntry *>    m_attributesCache;          // the attributes cache
 };
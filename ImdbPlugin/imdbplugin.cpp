@@ -44,6 +44,7 @@ void ImdbPlugin::initialize(QString virtualDirectoryPath) {
     FilePlugin::initialize(virtualDirectoryPath);
 
     // this one keeps only video files
+    m_suffixes = QString(VIDEO_SUFFIXES).split(' ');
     m_scriptP = new Script("{\n\ttype = plugin.getAttributeValue(\"Type\").toLowerCase();\
 \n\tplugin.setResult(\
 \n\t\ttype == \"mp4\" ||\
@@ -99,15 +100,7 @@ void ImdbPlugin::loadAttributes(QString filepath) {
     setAttributeValue(POSTER_ATTR, QVariant(tr("Unknown")));
 
     // only video files are handled
-    QString type = getAttributeValue(TYPE_ATTR).toString().toLower();
-    if (type != "mp4" &&
-        type != "mpeg4" &&
-        type != "mpg" &&
-        type != "avi" &&
-        type != "divx" &&
-        type != "wmv" &&
-        type != "mov" &&
-        type != "mkv")
+    if (!m_suffixes.contains(getAttributeValue(TYPE_ATTR).toString().toLower()))
         return;
 
     // loads the movie attributes
@@ -44,6 +44,8 @@
 #define ACTORS_ATTR         "Actors"
 #define PLOT_ATTR           "Synopsis"
 #define POSTER_ATTR         "Poster"
+
+#define VIDEO_SUFFIXES      "mp4 mpeg4 mpg avi divx wmv mov mkv"
 /*
     There are other meta-data which can be extracted from IMDBApi.com, check out
     "http://www.imdbapi.com/?t=<your favorite movie title here>&r=xml" for
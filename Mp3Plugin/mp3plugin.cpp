@@ -30,6 +30,7 @@
 
 #include "mp3plugin.h"
 #include "scriptrunner.h"
+#include "iothrottle.h"
 
 QMap<QString, AttributeCacheEntry *> Mp3Plugin::m_attributesCache;
 
@@ -43,6 +44,7 @@ void Mp3Plugin::initialize(QString virtualDirectoryPath) {
     FilePlugin::initialize(virtualDirectoryPath);
 
     // this one keeps only mp3 files
+    m_suffixes << MP3_SUFFIX;
     m_scriptP = new Script("{\n\tplugin.setResult(plugin.getAttributeValue(\"Type\").toLowerCase() == \"mp3\");\n}");
 
     m_attributes.insert(GENRE_ATTR, new Attribute(GENRE_ATTR, tr("Music genre (ie: rock, pop, etc.)"), "String"));
@@ -75,12 +77,17 @@ void Mp3Plugin::loadAttributes(QString filepath) {
     setAttributeValue(TRACK_ATTR, QVariant(tr("Unknown")));
 
     // only mp3 files are handled
-    if (getAttributeValue(TYPE_ATTR).toString().toLower() != "mp3")
+    if (!m_suffixes.contains(getAttributeValue(TYPE_ATTR).toString().toLower()))
         return;
 
     // loads the mp3 attributes
+    IoThrottle::account(0, 1);
     id3_file *fileP = id3_file_open(filepath.toLocal8Bit().data(), ID3_FILE_MODE_READONLY);
 
+    // libid3tag read the tags (ID3v2 at the start, ID3v1 at the end), account for them
+    struct id3_tag *tagP = fileP ? id3_file_tag(fileP) : NULL;
+    IoThrottle::account((tagP ? tagP->paddedsize : 0) + ID3_V1_TAG_SIZE);
+
     // genre
     QVariant genre = getMp3TagFromFile(fileP, ID3_FRAME_GENRE);
     if (!genre.isNull()) {
@@ -41,6 +41,10 @@
 #define TRACK_ATTR      "Track"
 #define GENRE_ATTR      "Genre"
 
+#define ID3_V1_TAG_SIZE 128     // bytes at the end of the file
+
+#define MP3_SUFFIX      "mp3"
+
 //#define _VERBOSE_MP3_PLUGIN 1
 
 class MP3PLUGINSHARED_EXPORT Mp3Plugin : public FilePlugin {
@@ -16,11 +16,13 @@ DEFINES += PLUGININTERFACE_LIBRARY
 SOURCES += plugininterface.cpp \
     attribute.cpp \
     scriptrunner.cpp \
-    script.cpp
+    script.cpp \
+    iothrottle.cpp
 
 HEADERS += plugininterface.h\
     PluginInterface_global.h \
     attribute.h \
     scriptrunner.h \
     script.h \
-    plugininterfacewrapper.h
+    plugininterfacewrapper.h \
+    iothrottle.h
@@ -0,0 +1,273 @@
+/*
+ * SION! Server file plugin interface.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#include <QObject>
+#include <QThreadStorage>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "iothrottle.h"
+
+#ifdef Q_OS_LINUX
+// see linux/ioprio.h, not exported to user space
+#define IOPRIO_CLASS_NONE           0
+#define IOPRIO_CLASS_BE             2
+#define IOPRIO_CLASS_IDLE           3
+#define IOPRIO_CLASS_SHIFT          13
+#define IOPRIO_WHO_PROCESS          1
+#endif
+
+/**
+  * The throttle a thread uses, the limits generation it applied the I/O class of, and whether it
+  * defers its waits.
+  */
+class IoThrottleBinding {
+public:
+    IoThrottleBinding() {
+        m_throttleP = NULL;
+        m_generation = -1;
+        m_deferred = false;
+    }
+
+    IoThrottle  *m_throttleP;
+    int         m_generation;
+    bool        m_deferred;
+};
+
+static QThreadStorage<IoThrottleBinding *> ioThrottleBindings;
+
+/**
+  * Returns the stricter of each limit.
+  */
+IoLimits IoLimits::strictest(const IoLimits &limits1, const IoLimits &limits2) {
+    IoLimits limits;
+
+    limits.m_ioClass = qMax(limits1.m_ioClass, limits2.m_ioClass);
+
+    limits.m_bytesPerSec = !limits1.m_bytesPerSec ? limits2.m_bytesPerSec :
+                           !limits2.m_bytesPerSec ? limits1.m_bytesPerSec : qMin(limits1.m_bytesPerSec, limits2.m_bytesPerSec);
+
+    limits.m_opsPerSec = !limits1.m_opsPerSec ? limits2.m_opsPerSec :
+                         !limits2.m_opsPerSec ? limits1.m_opsPerSec : qMin(limits1.m_opsPerSec, limits2.m_opsPerSec);
+
+    return limits;
+}
+
+QString IoLimits::className(IoClass ioClass) {
+    switch (ioClass) {
+        case Idle:
+            return "idle";
+        case BestEffort:
+            return "besteffort";
+        default:
+            return "default";
+    }
+}
+
+bool IoLimits::parseClassName(const QString &name, IoClass *ioClassP) {
+    for (int i = Default; i <= Idle; i++) {
+        if (name.toLower() == className((IoClass)i)) {
+            *ioClassP = (IoClass)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+IoThrottle::IoThrottle() {
+    m_generation = 0;
+    m_byteTokens = 0;
+    m_opTokens = 0;
+    m_lastRefill.start();
+}
+
+/**
+  * Changes the limits. The threads waiting on the throttle are woken up, and apply the new I/O
+  * class at their next access.
+  */
+void IoThrottle::setLimits(const IoLimits &limits) {
+    QMutexLocker locker(&m_mutex);
+
+    if (limits == m_limits)
+        return;
+
+    m_limits = limits;
+    m_generation++;
+
+    // start over with no debt and no burst
+    m_byteTokens = 0;
+    m_opTokens = 0;
+    m_lastRefill.restart();
+
+    m_limitsChanged.wakeAll();
+}
+
+IoLimits IoThrottle::getLimits() {
+    QMutexLocker locker(&m_mutex);
+
+    return m_limits;
+}
+
+/**
+  * Adds the tokens earned since the last refill, up to a second worth of them. Called with the
+  * mutex held.
+  */
+void IoThrottle::refill() {
+    int elapsed = m_lastRefill.restart();
+
+    // the clock wrapped (midnight)
+    if (elapsed < 0)
+        elapsed = 1000;
+
+    m_byteTokens = m_limits.m_bytesPerSec ? qMin(m_byteTokens + elapsed * (double)m_limits.m_bytesPerSec / 1000, (double)m_limits.m_bytesPerSec) : 0;
+    m_opTokens = m_limits.m_opsPerSec ? qMin(m_opTokens + elapsed * (double)m_limits.m_opsPerSec / 1000, (double)m_limits.m_opsPerSec) : 0;
+}
+
+/**
+  * Accounts reads (bytes) and operations, and blocks until the throttle is back within its
+  * limits (unless told not to wait): the threads of a root share the debt.
+  */
+void IoThrottle::charge(qint64 bytes, int ops, bool wait) {
+    QMutexLocker locker(&m_mutex);
+
+    refill();
+
+    if (m_limits.m_bytesPerSec)
+        m_byteTokens -= bytes;
+    if (m_limits.m_opsPerSec)
+        m_opTokens -= ops;
+
+    while (wait) {
+        int delay = 0;
+
+        if (m_limits.m_bytesPerSec && m_byteTokens < 0)
+            delay = qMax(delay, (int)(-m_byteTokens * 1000 / m_limits.m_bytesPerSec) + 1);
+        if (m_limits.m_opsPerSec && m_opTokens < 0)
+            delay = qMax(delay, (int)(-m_opTokens * 1000 / m_limits.m_opsPerSec) + 1);
+
+        if (!delay)
+            return;
+
+#ifdef _VERBOSE_IO_THROTTLE
+        qDebug() << "IoThrottle waits " << delay << " ms";
+#endif
+
+        // the limits may be lifted meanwhile
+        m_limitsChanged.wait(&m_mutex, delay);
+        refill();
+    }
+}
+
+/**
+  * Sets the throttle the calling thread uses (NULL for none).
+  */
+void IoThrottle::setCurrent(IoThrottle *throttleP) {
+    if (!ioThrottleBindings.hasLocalData())
+        ioThrottleBindings.setLocalData(new IoThrottleBinding());
+
+    IoThrottleBinding *bindingP = ioThrottleBindings.localData();
+
+    bindingP->m_throttleP = throttleP;
+    bindingP->m_generation = -1;
+    bindingP->m_deferred = false;
+}
+
+IoThrottle *IoThrottle::current() {
+    return ioThrottleBindings.hasLocalData() ? ioThrottleBindings.localData()->m_throttleP : NULL;
+}
+
+/**
+  * Accounts I/O done by the calling thread with its throttle, if any, blocking while over the
+  * limits unless the thread defers its waits. The I/O class of the limits is applied to the
+  * thread first if they changed.
+  */
+void IoThrottle::account(qint64 bytes, int ops) {
+    if (!ioThrottleBindings.hasLocalData())
+        return;
+
+    IoThrottleBinding   *bindingP = ioThrottleBindings.localData();
+    IoThrottle          *throttleP = bindingP->m_throttleP;
+
+    if (!throttleP)
+        return;
+
+    throttleP->m_mutex.lock();
+    int         generation = throttleP->m_generation;
+    IoLimits    limits = throttleP->m_limits;
+    throttleP->m_mutex.unlock();
+
+    if (bindingP->m_generation != generation) {
+        applyIoClass(limits.m_ioClass);
+        bindingP->m_generation = generation;
+    }
+
+    if (limits.m_bytesPerSec || limits.m_opsPerSec)
+        throttleP->charge(bytes, ops, !bindingP->m_deferred);
+}
+
+/**
+  * The I/O the calling thread accounts from now on doesn't block it, until it settles.
+  */
+void IoThrottle::defer() {
+    if (ioThrottleBindings.hasLocalData())
+        ioThrottleBindings.localData()->m_deferred = true;
+}
+
+/**
+  * Stops deferring the calling thread's waits, and blocks until the throttle is back within its
+  * limits.
+  */
+void IoThrottle::settle() {
+    if (!ioThrottleBindings.hasLocalData())
+        return;
+
+    IoThrottleBinding *bindingP = ioThrottleBindings.localData();
+
+    bindingP->m_deferred = false;
+    if (bindingP->m_throttleP)
+        bindingP->m_throttleP->charge(0, 0);
+}
+
+/**
+  * Sets the kernel I/O scheduling class of the calling thread (Linux only).
+  */
+void IoThrottle::applyIoClass(IoLimits::IoClass ioClass) {
+#ifdef Q_OS_LINUX
+    int priority = IOPRIO_CLASS_NONE << IOPRIO_CLASS_SHIFT;
+
+    if (ioClass == IoLimits::BestEffort)
+        priority = (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | IO_BEST_EFFORT_LEVEL;
+    else if (ioClass == IoLimits::Idle)
+        priority = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+
+    // a thread is a process to the I/O scheduler
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, priority) == -1)
+        qDebug() << QObject::tr("Failed to set the I/O priority");
+#else
+    Q_UNUSED(ioClass)
+#endif
+}
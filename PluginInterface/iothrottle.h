@@ -0,0 +1,109 @@
+/*
+ * SION! Server file plugin interface.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#ifndef IOTHROTTLE_H
+#define IOTHROTTLE_H
+
+#include <QString>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QTime>
+
+// #define _VERBOSE_IO_THROTTLE 1
+
+#define IO_THROTTLE_CHUNK           65536   // bytes a plugin reads between two accountings
+#define IO_BEST_EFFORT_LEVEL        7       // lowest priority of the best effort I/O class
+
+/**
+  * The I/O limits of a root filter: the kernel I/O scheduling class of its threads, and the
+  * reads its watcher and plugins can do per second (0 for unlimited).
+  */
+class IoLimits {
+public:
+    enum IoClass {
+        Default,        // the process' I/O priority
+        BestEffort,     // lowest best effort priority
+        Idle            // only when nobody else uses the disk
+    };
+
+    IoLimits() {
+        m_ioClass = BestEffort;
+        m_bytesPerSec = 0;
+        m_opsPerSec = 0;
+    }
+
+    inline bool operator==(const IoLimits &limits) const {
+        return m_ioClass == limits.m_ioClass && m_bytesPerSec == limits.m_bytesPerSec && m_opsPerSec == limits.m_opsPerSec;
+    }
+
+    static IoLimits strictest(const IoLimits &limits1, const IoLimits &limits2);
+    static QString  className(IoClass ioClass);
+    static bool     parseClassName(const QString &name, IoClass *ioClassP);
+
+    IoClass m_ioClass;
+    qint64  m_bytesPerSec;  // bytes read
+    int     m_opsPerSec;    // files opened, stat'ed and directories listed
+};
+
+/**
+  * A token bucket rate limiting the reads of a root's threads, up to one second of burst.
+  * A thread uses the throttle it's set (setCurrent): the I/O it does is accounted for with
+  * account, which blocks while the throttle is over its limits. Its kernel I/O class is applied
+  * from there too, so a change of the limits applies to the running threads.
+  *
+  * The watcher and directory walker threads account the directory listings and stats, the
+  * indexer threads the file stats and the plugins the file opens and reads (see FilePlugin,
+  * Mp3Plugin).
+  *
+  * A thread holding a lock others may wait for defers its waits (defer): the I/O it does meanwhile
+  * is owed, and waited for once it released the lock (settle).
+  */
+class IoThrottle {
+public:
+    IoThrottle();
+
+    void        setLimits(const IoLimits &limits);
+    IoLimits    getLimits();
+
+    void        charge(qint64 bytes, int ops, bool wait = true);
+
+    static void         setCurrent(IoThrottle *throttleP);
+    static IoThrottle   *current();
+    static void         account(qint64 bytes, int ops = 0);
+    static void         defer();
+    static void         settle();
+
+private:
+    QMutex          m_mutex;
+    QWaitCondition  m_limitsChanged;
+    IoLimits        m_limits;
+    int             m_generation;   // incremented when the limits change
+    double          m_byteTokens;   // negative when owed
+    double          m_opTokens;
+    QTime           m_lastRefill;
+
+    void        refill();
+
+    static void applyIoClass(IoLimits::IoClass ioClass);
+};
+
+#endif // IOTHROTTLE_H
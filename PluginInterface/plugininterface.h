@@ -27,6 +27,8 @@
 #include <QString>
 #include <QVariant>
 #include <QList>
+#include <QStringList>
+#include <QByteArray>
 
 #include "PluginInterface_global.h"
 
@@ -68,6 +70,12 @@ public:
     virtual QVariant                getAttributeValue(QString attributeName) = 0;
     virtual bool                    contains(QString regExp) = 0;
     virtual PluginInterfaceWrapper  *getWrapper() = 0;
+
+    // the manifest: the plugin only handles the files with one of these (lower case) suffixes, or
+    // starting with one of these signatures. None handles any file. The attributes of a file it
+    // doesn't handle aren't extracted (saved as <null>) unless its script may retain the file.
+    virtual const QStringList       getSuffixes() = 0;
+    virtual const QList<QByteArray> getSignatures() = 0;
 };
 
 #endif // PLUGININTERFACE_H
@@ -26,49 +26,62 @@
 #include <QVariant>
 #include <QDebug>
 
-QScriptEngine *ScriptRunner::m_scriptEngineP = NULL;
-int           ScriptRunner::m_scriptEngineRefCount = 0;
-QSemaphore    *ScriptRunner::m_runningScriptP = NULL;
+QThreadStorage<ThreadScriptEngine *> ScriptRunner::m_scriptEngines;
 
 ScriptRunner::ScriptRunner(QObject *parentP) : QObject(parentP) {
-    // create the engine if it doesn't exist yet.
-    if (++m_scriptEngineRefCount == 1) {
-        m_scriptEngineP = new QScriptEngine();
-        m_runningScriptP = new QSemaphore(1);
-    }
 }
 
 ScriptRunner::~ScriptRunner() {
-    // a little garbage collection?
-    m_scriptEngineP->collectGarbage();
-
-    // destroy the engine if it exists.
-    if (--m_scriptEngineRefCount == 0) {
-        delete m_scriptEngineP;
-        m_scriptEngineP = NULL;
-        delete m_runningScriptP;
-        m_runningScriptP = NULL;
-    }
+    // a little garbage collection? (the current thread's engine, the others may be running)
+    if (m_scriptEngines.hasLocalData())
+        m_scriptEngines.localData()->m_engine.collectGarbage();
 }
 
-bool ScriptRunner::run(Script *scriptP, PluginInterface *pluginP) {
-    bool result = FALSE;
+/**
+  * Returns the current thread's engine, creates it the first time.
+  */
+ThreadScriptEngine *ScriptRunner::getScriptEngine() {
+    if (!m_scriptEngines.hasLocalData())
+        m_scriptEngines.setLocalData(new ThreadScriptEngine());
+
+    return m_scriptEngines.localData();
+}
+
+/**
+  * Returns the script object of a plugin wrapper, published by the engine the first time.
+  */
+QScriptValue ScriptRunner::publishWrapper(ThreadScriptEngine *engineP, QObject *wrapperP) {
+    QHash<QObject *, QScriptValue>::const_iterator i = engineP->m_wrappers.constFind(wrapperP);
 
-    if (!m_scriptEngineP || !m_runningScriptP)
-        return FALSE;
+    // a deleted wrapper's address may have been reused
+    if (i != engineP->m_wrappers.constEnd() && i->toQObject() == wrapperP)
+        return *i;
 
-    m_runningScriptP->acquire();
+    // the wrappers of the deleted plugins aren't referred to anymore
+    if (engineP->m_wrappers.count() >= SCRIPT_MAX_WRAPPERS)
+        engineP->m_wrappers.clear();
+
+    QScriptValue wrapper = engineP->m_engine.newQObject(wrapperP);
+    engineP->m_wrappers.insert(wrapperP, wrapper);
+
+    return wrapper;
+}
+
+bool ScriptRunner::run(Script *scriptP, PluginInterface *pluginP) {
+    bool                result = FALSE;
+    ThreadScriptEngine  *engineP = getScriptEngine();
+    QScriptEngine       *scriptEngineP = &engineP->m_engine;
 
     // push the engine context
-    m_scriptEngineP->pushContext();
+    scriptEngineP->pushContext();
 
     // retrieves the script and make the plugin accessible from the javascript (through a wrapper)
     QString script = scriptP->getScript();
-    QScriptValue go = m_scriptEngineP->globalObject();
-    go.setProperty("plugin", m_scriptEngineP->newQObject(pluginP->getWrapper()));
+    QScriptValue go = scriptEngineP->globalObject();
+    go.setProperty("plugin", publishWrapper(engineP, pluginP->getWrapper()));
 
     // do static check of the script
-    if (!m_scriptEngineP->canEvaluate(script)) {
+    if (!scriptEngineP->canEvaluate(script)) {
         scriptP->setError(QObject::tr("Script can't be evaluated"));
 #ifdef _VERBOSE_PLUGIN_INTERFACE
         qDebug() << scriptP->getLastError();
@@ -77,14 +90,14 @@ bool ScriptRunner::run(Script *scriptP, PluginInterface *pluginP) {
     }
 
     // actually run the script
-    m_scriptEngineP->evaluate(script);
+    scriptEngineP->evaluate(script);
 
     // uncaught exception?
-    if (m_scriptEngineP->hasUncaughtException()) {
-        QScriptValue exception = m_scriptEngineP->uncaughtException();
-        int line = m_scriptEngineP->uncaughtExceptionLineNumber() - 1;
+    if (scriptEngineP->hasUncaughtException()) {
+        QScriptValue exception = scriptEngineP->uncaughtException();
+        int line = scriptEngineP->uncaughtExceptionLineNumber() - 1;
         scriptP->setError(QString("line %1: ").arg(line) + exception.toString());
-        m_scriptEngineP->clearExceptions();
+        scriptEngineP->clearExceptions();
 #ifdef _VERBOSE_PLUGIN_INTERFACE
         qDebug() << scriptP->getLastError() << " cleared..";
 #endif
@@ -95,9 +108,7 @@ bool ScriptRunner::run(Script *scriptP, PluginInterface *pluginP) {
 
 engineCleanUp:
     // pop the engine context
-    m_scriptEngineP->popContext();
-
-    m_runningScriptP->release();
+    scriptEngineP->popContext();
 
     return result;
 }
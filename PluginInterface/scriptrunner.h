@@ -25,16 +25,33 @@
 
 #include <QObject>
 #include <QScriptEngine>
-#include <QSemaphore>
+#include <QScriptValue>
+#include <QThreadStorage>
+#include <QHash>
 
 #include "script.h"
 #include "plugininterface.h"
 
 //#define _VERBOSE_PLUGIN_INTERFACE 1
 
+#define SCRIPT_MAX_WRAPPERS     256     // plugin wrappers published by an engine before its cache is cleared
+
+/**
+ * A thread's script engine, and the script objects of the plugin wrappers it published (by
+ * wrapper), so a plugin is published once per thread. A wrapper deleted meanwhile is found null.
+ */
+class ThreadScriptEngine {
+public:
+    QScriptEngine                   m_engine;
+    QHash<QObject *, QScriptValue>  m_wrappers;
+};
+
 /**
  * Runs the rules script associated with a plugin: publishes the plugin object into the
  * QScriptEngine execution context, executes the script, and sets the plugin's script result.
+ *
+ * Each thread running scripts has its own engine, created the first time and deleted with the
+ * thread, so the filters and watchers run their scripts concurrently.
  */
 
 class PluginInterface;
@@ -53,9 +70,10 @@ signals:
 public slots:
 
 private:
-    static QScriptEngine *m_scriptEngineP;
-    static int           m_scriptEngineRefCount;
-    static QSemaphore    *m_runningScriptP;           // don't run script concurrently since we have a single script engine for all filters/watchers...
+    static QThreadStorage<ThreadScriptEngine *> m_scriptEngines; // the engine of each thread
+
+    static ThreadScriptEngine *getScriptEngine();
+    static QScriptValue publishWrapper(ThreadScriptEngine *engineP, QObject *wrapperP);
 };
 
 #endif // SCRIPTRUNNER_H
@@ -21,6 +21,14 @@
  */
 
 #include <QDebug>
+#include <QFile>
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#endif
 
 #include "qdirext.h"
 #include "qfileinfoext.h"
@@ -129,3 +137,155 @@ QChar QDirExt::separator(QString path) {
 const QStringList QDirExt::entryList(Filters filters, SortFlags sort) {
     return m_infoExt.isCopy() ? m_entries : QDir::entryList(filters, sort);
 }
+
+/**
+  * Returns the local path the given url refers to, an empty QString if the url is remote. Unlike
+  * QFileInfoExt, a plain path isn't parsed as an url (so '#' and '?' are valid file name characters).
+  */
+QString QDirExt::localPath(const QString &url) {
+    if (!url.contains("://"))
+        return url;
+
+    QUrl fullUrl(url);
+    if (fullUrl.scheme() == "file")
+        return fullUrl.toLocalFile();
+
+    return "";
+}
+
+/**
+  * Lists the entries of a directory ("." and ".." excluded) into entriesP. If withStat is set, the
+  * entries' size, modification time, device and inode are retrieved too. Returns false if the directory
+  * can't be read.
+  *
+  * Local directories are read in one go, and the entry type comes from the directory itself
+  * (d_type) when the file system provides it, so nothing but the requested stat is done per entry.
+  * Remote directories go through QDirExt/QFileInfoExt.
+  */
+bool QDirExt::readEntries(const QString &url, QList<QDirExtEntry> *entriesP, bool withStat) {
+    QString path = localPath(url);
+
+#ifdef Q_OS_UNIX
+    if (!path.isEmpty()) {
+        DIR *dirP = opendir(QFile::encodeName(path).constData());
+        if (!dirP)
+            return false;
+
+        int             fd = dirfd(dirP);
+        struct dirent   *entryP;
+        QString         prefix = path;
+
+        if (!prefix.endsWith(QDir::separator()))
+            prefix.append(QDir::separator());
+
+        while ((entryP = readdir(dirP))) {
+            const char *nameP = entryP->d_name;
+            if (nameP[0] == '.' && (!nameP[1] || (nameP[1] == '.' && !nameP[2])))
+                continue;
+
+            QDirExtEntry entry;
+            entry.m_name = QFile::decodeName(nameP);
+            entry.m_absoluteFilePath = prefix + entry.m_name;
+            entry.m_isHidden = nameP[0] == '.';
+
+            // links and file systems not giving the type must be stat'ed
+            bool needStat = withStat;
+#ifdef _DIRENT_HAVE_D_TYPE
+            if (entryP->d_type == DT_DIR)
+                entry.m_isDir = true;
+            else if (entryP->d_type == DT_LNK || entryP->d_type == DT_UNKNOWN)
+                needStat = true;
+#else
+            needStat = true;
+#endif
+
+            struct stat st;
+            if (needStat && fstatat(fd, nameP, &st, 0) == 0) {
+                entry.m_isDir = S_ISDIR(st.st_mode);
+                entry.m_hasStat = true;
+                entry.m_size = st.st_size;
+                entry.m_lastModified = QDateTime::fromTime_t(st.st_mtime);
+                entry.m_device = st.st_dev;
+                entry.m_inode = st.st_ino;
+            }
+
+            entriesP->append(entry);
+        }
+
+        closedir(dirP);
+        return true;
+    }
+#endif
+
+    // remote (or not a unix system)
+    QDirExt     dir(url);
+    QStringList names = dir.entryList();
+
+    for (QList<QString>::iterator i = names.begin(); i != names.end(); i++) {
+        if (*i == "." || *i == "..")
+            continue;
+
+        QString entryPath = url;
+        entryPath.append(separator(url));
+        entryPath.append(*i);
+        QFileInfoExt info(entryPath);
+
+        QDirExtEntry entry;
+        entry.m_name = *i;
+        entry.m_absoluteFilePath = info.absoluteFilePath();
+        entry.m_isDir = info.isDir();
+        entry.m_isHidden = info.isHidden();
+        if (withStat) {
+            entry.m_hasStat = info.exists();
+            entry.m_size = info.size();
+            entry.m_lastModified = info.lastModified();
+        }
+
+        entriesP->append(entry);
+    }
+
+    return true;
+}
+
+/**
+  * Fills entryP with the name, type and stat of a single file or directory. Returns false if it
+  * doesn't exist.
+  */
+bool QDirExt::readEntry(const QString &url, QDirExtEntry *entryP) {
+    QString path = localPath(url);
+
+#ifdef Q_OS_UNIX
+    if (!path.isEmpty()) {
+        struct stat st;
+        if (stat(QFile::encodeName(path).constData(), &st) != 0)
+            return false;
+
+        entryP->m_name = path.mid(path.lastIndexOf(QDir::separator()) + 1);
+        entryP->m_absoluteFilePath = path;
+        entryP->m_isDir = S_ISDIR(st.st_mode);
+        entryP->m_isHidden = entryP->m_name.startsWith('.');
+        entryP->m_hasStat = true;
+        entryP->m_size = st.st_size;
+        entryP->m_lastModified = QDateTime::fromTime_t(st.st_mtime);
+        entryP->m_device = st.st_dev;
+        entryP->m_inode = st.st_ino;
+
+        return true;
+    }
+#endif
+
+    // remote (or not a unix system)
+    QFileInfoExt info(url);
+    if (!info.exists())
+        return false;
+
+    entryP->m_name = info.fileName();
+    entryP->m_absoluteFilePath = info.absoluteFilePath();
+    entryP->m_isDir = info.isDir();
+    entryP->m_isHidden = info.isHidden();
+    entryP->m_hasStat = true;
+    entryP->m_size = info.size();
+    entryP->m_lastModified = info.lastModified();
+
+    return true;
+}
@@ -25,6 +25,8 @@
 
 #include <QDir>
 #include <QStringList>
+#include <QDateTime>
+#include <QList>
 
 #include "qfileinfoext.h"
 
@@ -32,6 +34,31 @@
 
 //#define _VERBOSE_DIREXT 1
 
+/**
+  * A directory entry, as returned by QDirExt::readEntries/readEntry.
+  */
+class QFILEEXTENSIONSSHARED_EXPORT QDirExtEntry {
+public:
+    QDirExtEntry() {
+        m_isDir = false;
+        m_isHidden = false;
+        m_hasStat = false;
+        m_size = 0;
+        m_device = 0;
+        m_inode = 0;
+    }
+
+    QString     m_name;             // entry name (no path)
+    QString     m_absoluteFilePath; // the local file (the local copy for remote content)
+    bool        m_isDir;            // symbolic links to directories are directories
+    bool        m_isHidden;
+    bool        m_hasStat;          // the members below are set
+    qint64      m_size;
+    QDateTime   m_lastModified;
+    quint64     m_device;           // the device and inode identify the file (local only, 0 else)
+    quint64     m_inode;
+};
+
 /**
   * This class extends the QDir class to handle remote directories. When
   * instanciated, the remote content is listed (not downloaded into the cache).
@@ -44,6 +71,10 @@ public:
 
     static QChar separator(QString path);
 
+    static QString localPath(const QString &url);
+    static bool    readEntries(const QString &url, QList<QDirExtEntry> *entriesP, bool withStat = false);
+    static bool    readEntry(const QString &url, QDirExtEntry *entryP);
+
 private:
     QFileInfoExt    m_infoExt;  // create an extended file info for the directory
     QStringList     m_entries;
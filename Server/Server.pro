@@ -28,6 +28,12 @@ SOURCES += main.cpp \
     classifier.cpp \
     filter.cpp \
     pathsegment.cpp \
+    dirnotifier.cpp \
+    indexer.cpp \
+    dirwalker.cpp \
+    scanscheduler.cpp \
+    watchpredicate.cpp \
+    globset.cpp \
     mainwindow.cpp
 
 HEADERS += \
@@ -37,6 +43,12 @@ HEADERS += \
     filter.h \
     servercommands.h \
     pathsegment.h \
+    dirnotifier.h \
+    indexer.h \
+    dirwalker.h \
+    scanscheduler.h \
+    watchpredicate.h \
+    globset.h \
     mainwindow.h
 
 FORMS    += mainwindow.ui
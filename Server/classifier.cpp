@@ -24,6 +24,7 @@
 #include <QFileInfo>
 
 #include "classifier.h"
+#include "watcher.h"
 #include "serverdatabase.h"
 
 Classifier::Classifier(QObject *parentP) : QObject(parentP) {
@@ -65,8 +66,8 @@ void Classifier::writeUtf8String(QDataStream &out, QString string) {
   * Adds a filter to the set of current filters handled by this classifier. Returns the
   * newly created filter.
   */
-Filter *Classifier::addFilter(Filter *parentP, QString virtualDirectoryPath, QString dir, bool recursive, QStringList plugins, bool dontStart) {
-    Filter *filterP = new Filter(virtualDirectoryPath, dir, recursive, plugins, parentP);
+Filter *Classifier::addFilter(Filter *parentP, QString virtualDirectoryPath, QString dir, bool recursive, QStringList plugins, QStringList globs, bool dontStart) {
+    Filter *filterP = new Filter(virtualDirectoryPath, dir, recursive, plugins, globs, parentP);
     if (parentP)
         parentP->addChild(filterP);
 
@@ -151,6 +152,25 @@ void Classifier::stop() {
             m_filters[i]->stop();
 }
 
+/**
+  * Waits for the (stopped) root filters to index the files their watcher signaled.
+  */
+void Classifier::waitForIndexing() {
+    for (int i = 0; i < m_filters.count(); i++)
+        if (m_filters[i]->isRoot())
+            m_filters[i]->waitForIndexing();
+}
+
+/**
+  * The db was cleaned up behind the filters' back, their watchers must signal everything again
+  * after a restart.
+  */
+void Classifier::invalidateWatcherStates() {
+    for (int i = 0; i < m_filters.count(); i++)
+        if (m_filters[i]->isRoot() && m_filters[i]->getWatcher())
+            m_filters[i]->getWatcher()->invalidateCheckpoint(m_filters[i]);
+}
+
 /**
   * Rescan (db cleanup + scan) all the root filters.
   */
@@ -172,7 +192,9 @@ void Classifier::scan() {
 }
 
 /**
-  * Save all the filters in the given file.
+  * Save all the filters in the given file: CLASSIFIER_FILTERSET_TAG, the number of filters,
+  * then for each filter its url, parent, virtual directory path, recursivity, plugins (name and
+  * script) and globs.
   */
 void Classifier::saveFilters(QString filename) {
     QFile file(filename);
@@ -189,6 +211,8 @@ void Classifier::saveFilters(QString filename) {
 
     displayActivity(tr("Saving filters"));
 
+    writeUtf8String(out, CLASSIFIER_FILTERSET_TAG);
+
     int     numFilters = m_filters.count();
     QString numFiltersStr;
     numFiltersStr.sprintf("%d", numFilters);
@@ -215,6 +239,14 @@ void Classifier::saveFilters(QString filename) {
             writeUtf8String(out, fP->getPluginFilenames()[j]);
             writeUtf8String(out, fP->getPlugins()->at(j)->getScript());
         }
+
+        QStringList globs = fP->getGlobs().getGlobs();
+        QString     numGlobsStr;
+        numGlobsStr.sprintf("%d", globs.count());
+        writeUtf8String(out, numGlobsStr);
+
+        for (int j = 0; j < globs.count(); j++)
+            writeUtf8String(out, globs[j]);
     }
 
     displayActivity(tr("Filters saved"));
@@ -223,7 +255,8 @@ void Classifier::saveFilters(QString filename) {
 }
 
 /**
-  * Loads the filters from the given file.
+  * Loads the filters from the given file. The files saved before the globs were (not starting
+  * with CLASSIFIER_FILTERSET_TAG) are loaded too, their filters have no globs.
   */
 void Classifier::loadFilters(QString filename) {
 #ifdef _VERBOSE_CLASSIFIER
@@ -240,6 +273,10 @@ void Classifier::loadFilters(QString filename) {
     displayActivity(tr("Loading filters"));
 
     QString numFiltersStr = readUtf8String(in);
+    bool    hasGlobs = numFiltersStr == CLASSIFIER_FILTERSET_TAG;
+    if (hasGlobs)
+        numFiltersStr = readUtf8String(in);
+
     int numFilters = numFiltersStr.toInt();
 
     // load filters
@@ -265,6 +302,13 @@ void Classifier::loadFilters(QString filename) {
             pluginScripts.append(pluginScript);
         }
 
+        QStringList globs;
+        if (hasGlobs) {
+            int numGlobs = readUtf8String(in).toInt();
+            for (int j = 0; j < numGlobs; j++)
+                globs.append(readUtf8String(in));
+        }
+
         // create the filter
 
         // find the parent if it was set (it works because filters are created and stored sequentially in the classifier)
@@ -272,7 +316,7 @@ void Classifier::loadFilters(QString filename) {
         Filter *parentP = parentVirDirPath.isEmpty() ? NULL : findFilter(parentVirDirPath);
 
         // create (non started) filter
-        addFilter(parentP, virDirPath, directory, recursive, pluginNames, true);
+        addFilter(parentP, virDirPath, directory, recursive, pluginNames, globs, true);
 
         // retrieve newly created filter
         Filter *newFilterP = findFilter(virDirPath);
@@ -436,3 +480,84 @@ void Classifier::loadDatabase(QString filename) {
     file.close();
 }
 
+
+/**
+  * Saves the root filters' watchers checkpoint to filename. The filters must be stopped and
+  * done indexing, the checkpoint is only valid along with the db saved at the same time.
+  */
+void Classifier::saveWatcherStates(QString filename) {
+#ifdef _VERBOSE_CLASSIFIER
+    qDebug() << "Classifier will save watcher states " << filename;
+#endif
+
+    QFile file(filename);
+
+    // open the file and set up the data stream
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return;
+
+    QDataStream out(&file);
+
+    displayActivity(tr("Saving watcher states"));
+
+    QVector<Filter *> roots;
+    for (int i = 0; i < m_filters.count(); i++)
+        if (m_filters[i]->isRoot() && m_filters[i]->getWatcher())
+            roots.append(m_filters[i]);
+
+    QString numRootsStr;
+    numRootsStr.sprintf("%d", roots.count());
+    writeUtf8String(out, numRootsStr);
+
+    for (int i = 0; i < roots.count(); i++) {
+        QString     url;
+        FileStates  states;
+
+        roots[i]->getWatcher()->getCheckpoint(roots[i], &url, &states);
+
+        writeUtf8String(out, roots[i]->getVirtualDirectoryPath());
+        out << url << states;
+    }
+
+    displayActivity(tr("Watcher states saved"));
+
+    file.close();
+}
+
+/**
+  * Loads the root filters' watchers checkpoint from filename. Call once the db and the filters
+  * saved along were loaded, before the filters start.
+  */
+void Classifier::loadWatcherStates(QString filename) {
+#ifdef _VERBOSE_CLASSIFIER
+    qDebug() << "Classifier will load watcher states " << filename;
+#endif
+
+    // open the file and set up the data stream
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream in(&file);
+
+    displayActivity(tr("Loading watcher states"));
+
+    QString numRootsStr = readUtf8String(in);
+    int numRoots = numRootsStr.toInt();
+
+    for (int i = 0; i < numRoots && in.status() == QDataStream::Ok; i++) {
+        QString     virDirPath = readUtf8String(in);
+        QString     url;
+        FileStates  states;
+
+        in >> url >> states;
+
+        Filter *filterP = findFilter(virDirPath);
+        if (filterP && filterP->getWatcher() && in.status() == QDataStream::Ok)
+            filterP->getWatcher()->setCheckpoint(filterP, url, states);
+    }
+
+    displayActivity(tr("Watcher states loaded"));
+
+    file.close();
+}
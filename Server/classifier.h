@@ -31,6 +31,8 @@
 
 //#define _VERBOSE_CLASSIFIER 1
 
+#define CLASSIFIER_FILTERSET_TAG    "SION!FILTERSET 2"  // first string of a filter set file with globs, the former ones start with the number of filters
+
 /**
  * The Classifier holds filters on physical directories. A filter
  * is an instance of a (file) Filter.
@@ -76,16 +78,21 @@ public:
     void    saveDatabase(QString filename);
     void    loadDatabase(QString filename);
 
-    Filter  *addFilter(Filter *parentP, QString virtualDirectoryPath, QString dir, bool recursive, QStringList plugins, bool dontStart = false);
+    void    saveWatcherStates(QString filename);
+    void    loadWatcherStates(QString filename);
+
+    Filter  *addFilter(Filter *parentP, QString virtualDirectoryPath, QString dir, bool recursive, QStringList plugins, QStringList globs, bool dontStart = false);
     Filter  *findFilter(QString virtualDirectoryPath);
-    void    modifyFilter(Filter *filterP, QString dir, bool recursive, QStringList pluginNames) {
+    void    modifyFilter(Filter *filterP, QString dir, bool recursive, QStringList pluginNames, QStringList globs) {
         if (filterP)
-            filterP->modifyFilter(dir, recursive, pluginNames);
+            filterP->modifyFilter(dir, recursive, pluginNames, globs);
     }
 
 
     void    start();
     void    stop();
+    void    waitForIndexing();
+    void    invalidateWatcherStates();
 
     void    rescan();
     void    scan();
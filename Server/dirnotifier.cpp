@@ -0,0 +1,276 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#include <QObject>
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+#include "dirnotifier.h"
+
+#ifdef Q_OS_LINUX
+#define NOTIFIER_WATCH_MASK (IN_CREATE | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#endif
+
+/**
+  * Opens the kernel notification queue. If it can't be opened, the notifier stays
+  * inactive and all the directories must be polled.
+  */
+DirNotifier::DirNotifier() {
+    m_fd = -1;
+    m_wakeUpPipe[0] = m_wakeUpPipe[1] = -1;
+    m_limitReached = false;
+
+#ifdef Q_OS_LINUX
+    if ((m_fd = inotify_init()) == -1) {
+        qDebug() << QObject::tr("Failed to initialize inotify, directories will be polled: ") + QString(strerror(errno));
+        return;
+    }
+    fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(m_fd, F_SETFD, FD_CLOEXEC);
+
+    if (pipe(m_wakeUpPipe) == -1) {
+        m_wakeUpPipe[0] = m_wakeUpPipe[1] = -1;
+        return;
+    }
+    fcntl(m_wakeUpPipe[0], F_SETFL, fcntl(m_wakeUpPipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(m_wakeUpPipe[1], F_SETFL, fcntl(m_wakeUpPipe[1], F_GETFL) | O_NONBLOCK);
+#endif
+}
+
+DirNotifier::~DirNotifier() {
+#ifdef Q_OS_LINUX
+    // closing the queue drops all the watches
+    if (m_fd != -1)
+        close(m_fd);
+
+    if (m_wakeUpPipe[0] != -1) {
+        close(m_wakeUpPipe[0]);
+        close(m_wakeUpPipe[1]);
+    }
+#endif
+}
+
+/**
+  * Starts watching the given directory. Returns false if the directory can't be watched
+  * (notifier not active, watch limit reached, ...), in which case it must be polled.
+  */
+bool DirNotifier::addWatch(const QString &directory) {
+    if (m_fd == -1)
+        return false;
+
+    if (m_descriptors.contains(directory))
+        return true;
+
+    // once the kernel told us we're out of watches, don't bother asking until some are released
+    if (m_limitReached)
+        return false;
+
+#ifdef Q_OS_LINUX
+    int wd = inotify_add_watch(m_fd, QFile::encodeName(directory).constData(), NOTIFIER_WATCH_MASK);
+    if (wd == -1) {
+        if (errno == ENOSPC) {
+            qDebug() << QObject::tr("inotify watch limit reached (%1 watches), remaining directories will be polled").arg(m_descriptors.count());
+            m_limitReached = true;
+        }
+#ifdef _VERBOSE_NOTIFIER
+        else
+            qDebug() << "Failed to watch " << directory << ": " << strerror(errno);
+#endif
+        return false;
+    }
+
+#ifdef _VERBOSE_NOTIFIER
+    qDebug() << "Watching " << directory << " (" << wd << ")";
+#endif
+
+    // the same inode may be reached through several paths (links), keep the last one
+    m_descriptors.remove(m_paths.value(wd));
+    m_paths.insert(wd, directory);
+    m_descriptors.insert(directory, wd);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+  * Stops watching the given directory.
+  */
+void DirNotifier::removeWatch(const QString &directory) {
+    QHash<QString, int>::iterator i = m_descriptors.find(directory);
+    if (i == m_descriptors.end())
+        return;
+
+#ifdef Q_OS_LINUX
+    inotify_rm_watch(m_fd, *i);
+#endif
+
+    m_paths.remove(*i);
+    m_descriptors.erase(i);
+
+    // a watch was released, we can try again
+    m_limitReached = false;
+}
+
+/**
+  * Stops watching all directories.
+  */
+void DirNotifier::removeAllWatches() {
+#ifdef Q_OS_LINUX
+    for (QHash<int, QString>::const_iterator i = m_paths.begin(); i != m_paths.end(); i++)
+        inotify_rm_watch(m_fd, i.key());
+#endif
+
+    m_paths.clear();
+    m_descriptors.clear();
+    m_limitReached = false;
+}
+
+/**
+  * Blocks until events are available, wakeUp is called or msecs milliseconds elapsed.
+  * Returns true if events are available.
+  */
+bool DirNotifier::waitForEvents(int msecs) {
+    if (m_fd == -1)
+        return false;
+
+#ifdef Q_OS_LINUX
+    // poll, not select: the fds may be over FD_SETSIZE with many files open
+    struct pollfd   fds[2];
+    int             numFds = 1;
+
+    fds[0].fd = m_fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    if (m_wakeUpPipe[0] != -1) {
+        fds[1].fd = m_wakeUpPipe[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        numFds = 2;
+    }
+
+    if (poll(fds, numFds, msecs) <= 0)
+        return false;
+
+    // drain the wake up pipe
+    if (numFds == 2 && (fds[1].revents & POLLIN)) {
+        char buffer[16];
+        while (read(m_wakeUpPipe[0], buffer, sizeof(buffer)) > 0)
+            ;
+    }
+
+    return fds[0].revents & POLLIN;
+#else
+    Q_UNUSED(msecs)
+    return false;
+#endif
+}
+
+/**
+  * Reads all the pending events from the kernel queue (doesn't block).
+  */
+QList<DirEvent> DirNotifier::readEvents() {
+    QList<DirEvent> events;
+
+    if (m_fd == -1)
+        return events;
+
+#ifdef Q_OS_LINUX
+    char    buffer[NOTIFIER_READ_BUFFER_SIZE] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+
+    while ((length = read(m_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + length; ptr += sizeof(struct inotify_event) + ((struct inotify_event *)ptr)->len) {
+            const struct inotify_event *eventP = (const struct inotify_event *)ptr;
+
+            if (eventP->mask & IN_Q_OVERFLOW) {
+#ifdef _VERBOSE_NOTIFIER
+                qDebug() << "Notification queue overflow";
+#endif
+                events.append(DirEvent(DirEvent::Overflow));
+                continue;
+            }
+
+            // the kernel dropped the watch (directory deleted or unmounted)
+            if (eventP->mask & IN_IGNORED) {
+                QString directory = m_paths.take(eventP->wd);
+                if (!directory.isEmpty() && m_descriptors.value(directory, -1) == eventP->wd)
+                    m_descriptors.remove(directory);
+                m_limitReached = false;
+                continue;
+            }
+
+            QHash<int, QString>::const_iterator i = m_paths.find(eventP->wd);
+            if (i == m_paths.end())
+                continue; // already removed
+
+            QString directory = *i;
+            if (eventP->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                events.append(DirEvent(DirEvent::SelfDeleted, directory, true));
+                continue;
+            }
+
+            if (!eventP->len)
+                continue;
+
+            QString path = directory;
+            path.append(QDir::separator());
+            path.append(QFile::decodeName(eventP->name));
+
+            bool isDir = eventP->mask & IN_ISDIR;
+            if (eventP->mask & (IN_CREATE | IN_MOVED_TO))
+                events.append(DirEvent(DirEvent::Created, path, isDir, eventP->cookie));
+            else if (eventP->mask & (IN_DELETE | IN_MOVED_FROM))
+                events.append(DirEvent(DirEvent::Deleted, path, isDir, eventP->cookie));
+            else if (eventP->mask & (IN_CLOSE_WRITE | IN_ATTRIB))
+                events.append(DirEvent(DirEvent::Modified, path, isDir));
+        }
+    }
+#endif
+
+    return events;
+}
+
+/**
+  * Interrupts a thread blocked in waitForEvents.
+  */
+void DirNotifier::wakeUp() {
+#ifdef Q_OS_LINUX
+    if (m_wakeUpPipe[1] != -1) {
+        char byte = 0;
+        if (write(m_wakeUpPipe[1], &byte, 1) == -1) {
+            // the pipe is full, the waiting thread will wake up anyway
+        }
+    }
+#endif
+}
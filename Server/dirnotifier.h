@@ -0,0 +1,105 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#ifndef DIRNOTIFIER_H
+#define DIRNOTIFIER_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+
+//#define _VERBOSE_NOTIFIER 1
+
+#define NOTIFIER_READ_BUFFER_SIZE       65536 // bytes read from the kernel event queue at once
+
+/**
+  * A directory change event, as reported by the kernel.
+  */
+class DirEvent {
+public:
+    enum Type {
+        Created,        // an entry was created in (or moved into) a watched directory
+        Modified,       // an entry was written to (and closed) or had its attributes changed
+        Deleted,        // an entry was deleted from (or moved out of) a watched directory
+        SelfDeleted,    // the watched directory itself was deleted or moved
+        Overflow        // the kernel event queue overflowed, events were lost
+    };
+
+    DirEvent(Type type, QString path = "", bool isDir = false, quint32 cookie = 0) {
+        m_type = type;
+        m_path = path;
+        m_isDir = isDir;
+        m_cookie = cookie;
+    }
+
+    Type    m_type;
+    QString m_path;     // full path of the entry
+    bool    m_isDir;    // the entry is a directory
+    quint32 m_cookie;   // relates the two halves of a rename (0 if not a rename)
+};
+
+/**
+  * The directory notifier wraps the kernel file system notification facility (inotify under
+  * Linux). Directories are registered one by one (the kernel doesn't watch recursively), and
+  * their changes are read as DirEvent lists. When the facility isn't available (other OSes,
+  * inotify disabled) or when the per-user watch limit is reached, addWatch fails and the caller
+  * is expected to poll the directory instead.
+  */
+class DirNotifier {
+public:
+    DirNotifier();
+    ~DirNotifier();
+
+    inline bool isActive() {
+        return m_fd != -1;
+    }
+
+    inline bool isWatched(const QString &directory) {
+        return m_descriptors.contains(directory);
+    }
+
+    inline int numWatches() {
+        return m_descriptors.count();
+    }
+
+    inline bool limitReached() {
+        return m_limitReached;
+    }
+
+    bool            addWatch(const QString &directory);
+    void            removeWatch(const QString &directory);
+    void            removeAllWatches();
+
+    bool            waitForEvents(int msecs);
+    QList<DirEvent> readEvents();
+
+    void            wakeUp();
+
+private:
+    int                 m_fd;                   // kernel notification queue, -1 when not available
+    int                 m_wakeUpPipe[2];        // used to interrupt waitForEvents (when stopping)
+    bool                m_limitReached;         // the kernel refused a new watch (max_user_watches)
+    QHash<int, QString> m_paths;                // watch descriptor -> directory
+    QHash<QString, int> m_descriptors;          // directory -> watch descriptor
+};
+
+#endif // DIRNOTIFIER_H
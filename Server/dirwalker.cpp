@@ -0,0 +1,242 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#include <QDebug>
+
+#include "dirwalker.h"
+
+void DirWalkerThread::run() {
+    IoThrottle::setCurrent(m_walkerP->getThrottle());
+    m_walkerP->walk(m_worker);
+}
+
+DirWalker::DirWalker(bool recursive, DirNotifier *notifierP, bool withStat, const WatchPredicate *predicateP, const GlobSet *globsP) : m_batches(WALKER_MAX_PENDING_BATCHES) {
+    m_recursive = recursive;
+    m_withStat = withStat;
+    m_notifierP = notifierP;
+    m_predicateP = predicateP;
+    m_globsP = globsP;
+    m_throttleP = NULL;
+    m_stop = false;
+}
+
+DirWalker::~DirWalker() {
+    stop();
+
+    qDeleteAll(m_threads);
+    m_threads.clear();
+
+    qDeleteAll(m_deques);
+    m_deques.clear();
+}
+
+/**
+  * Starts walking down from root. A non recursive walk only lists the root.
+  */
+void DirWalker::start(const QString &root) {
+    int numThreads = m_recursive ? QThread::idealThreadCount() * WALKER_THREADS_PER_CORE : 1;
+    if (numThreads < 1)
+        numThreads = 1;
+
+    // the walk's I/O is throttled as the starting thread's
+    m_throttleP = IoThrottle::current();
+
+    for (int i = 0; i < numThreads; i++) {
+        m_deques.append(new Deque());
+        m_threads.append(new DirWalkerThread(this, i));
+    }
+
+    m_runningThreads = numThreads;
+    push(0, root);
+
+#ifdef _VERBOSE_WALKER
+    qDebug() << "Walking " << root << " with " << numThreads << " threads";
+#endif
+
+    for (int i = 0; i < m_threads.count(); i++)
+        m_threads[i]->start();
+}
+
+/**
+  * Blocks until a batch of entries is available. Returns false once the whole tree was walked
+  * (or the walk stopped).
+  */
+bool DirWalker::nextBatch(WalkerBatch *batchP) {
+    // the threads never hand over an empty batch, but the last one exiting
+    return m_batches.take(batchP) && batchP->count();
+}
+
+/**
+  * Stops the walk, and waits for the threads to exit.
+  */
+void DirWalker::stop() {
+    m_stop = true;
+    m_batches.close();
+
+    m_idleMutex.lock();
+    m_workAvailable.wakeAll();
+    m_idleMutex.unlock();
+
+    for (int i = 0; i < m_threads.count(); i++)
+        m_threads[i]->wait();
+}
+
+void DirWalker::push(int worker, const QString &directory) {
+    Deque *dequeP = m_deques[worker];
+
+    // count it before it can be taken, so the walk can't look completed meanwhile
+    m_pendingDirectories.ref();
+
+    dequeP->m_mutex.lock();
+    dequeP->m_directories.append(directory);
+    dequeP->m_mutex.unlock();
+
+    m_idleMutex.lock();
+    m_workAvailable.wakeOne();
+    m_idleMutex.unlock();
+}
+
+/**
+  * Returns the next directory to list: from the back of the thread's deque, or stolen from the
+  * front of another one. Returns false when the walk is completed.
+  */
+bool DirWalker::nextDirectory(int worker, QString *directoryP) {
+    while (!m_stop) {
+        Deque *dequeP = m_deques[worker];
+
+        dequeP->m_mutex.lock();
+        if (!dequeP->m_directories.isEmpty()) {
+            *directoryP = dequeP->m_directories.takeLast();
+            dequeP->m_mutex.unlock();
+            return true;
+        }
+        dequeP->m_mutex.unlock();
+
+        // steal
+        for (int i = 1; i < m_deques.count(); i++) {
+            Deque *victimP = m_deques[(worker + i) % m_deques.count()];
+
+            victimP->m_mutex.lock();
+            if (!victimP->m_directories.isEmpty()) {
+                *directoryP = victimP->m_directories.takeFirst();
+                victimP->m_mutex.unlock();
+#ifdef _VERBOSE_WALKER
+                qDebug() << "Walker thread " << worker << " stole " << *directoryP;
+#endif
+                return true;
+            }
+            victimP->m_mutex.unlock();
+        }
+
+        // nothing to steal, done if nobody is listing a directory anymore
+        m_idleMutex.lock();
+        if (m_pendingDirectories == 0) {
+            m_idleMutex.unlock();
+            return false;
+        }
+        m_workAvailable.wait(&m_idleMutex, WALKER_IDLE_WAIT);
+        m_idleMutex.unlock();
+    }
+
+    return false;
+}
+
+/**
+  * Lists a directory: its files and directories go into the batch, its sub directories are
+  * pushed to be listed if recursive. The predicate and globs, if any, leave files and sub
+  * directories out.
+  */
+void DirWalker::listDirectory(int worker, const QString &directory, WalkerBatch *batchP) {
+    // watch it before listing it, so we don't miss what's created meanwhile (the benches build the
+    // walker without the notifier)
+#ifndef WALKER_WITHOUT_NOTIFIER
+    if (m_notifierP) {
+        m_notifierMutex.lock();
+        bool watched = m_notifierP->addWatch(directory);
+        m_notifierMutex.unlock();
+
+        if (!watched)
+            batchP->m_unwatchedDirectories.append(directory);
+    }
+#endif
+
+    batchP->m_directories.append(directory);
+
+    // unless asked for, the entry types are all we need, most file systems give them without a stat
+    QList<QDirExtEntry> entries;
+    QDirExt::readEntries(directory, &entries, m_withStat);
+    IoThrottle::account(0, 1 + (m_withStat ? entries.count() : 0));
+
+    for (QList<QDirExtEntry>::iterator i = entries.begin(); !m_stop && i != entries.end(); i++) {
+        if (i->m_isHidden)
+            continue; // we don't care about these ones.
+
+        QString entryPath = directory;
+        entryPath.append(QDirExt::separator(directory));
+        entryPath.append(i->m_name);
+
+        if (!i->m_isDir) {
+            if (m_predicateP && !m_predicateP->acceptsFile(entryPath, i->m_hasStat ? i->m_size : -1))
+                continue;
+
+            if (m_globsP && m_globsP->excludesFile(entryPath))
+                continue;
+
+            batchP->m_files.append(entryPath);
+            batchP->m_fileEntries.append(*i);
+        } else if (m_recursive && (!m_predicateP || m_predicateP->acceptsDirectory(entryPath)) && (!m_globsP || !m_globsP->excludesDirectory(entryPath)))
+            push(worker, entryPath);
+    }
+}
+
+/**
+  * A walker thread main loop.
+  */
+void DirWalker::walk(int worker) {
+    WalkerBatch batch;
+    QString     directory;
+
+    while (nextDirectory(worker, &directory)) {
+        listDirectory(worker, directory, &batch);
+
+        // the last directory listed, wake up the idle threads so they exit
+        if (!m_pendingDirectories.deref()) {
+            m_idleMutex.lock();
+            m_workAvailable.wakeAll();
+            m_idleMutex.unlock();
+        }
+
+        if (batch.count() >= WALKER_BATCH_SIZE) {
+            if (!m_batches.put(batch))
+                return; // stopped
+
+            batch = WalkerBatch();
+        }
+    }
+
+    if (batch.count() && !m_batches.put(batch))
+        return;
+
+    // the last thread exiting tells the consumer the walk is completed
+    if (!m_runningThreads.deref())
+        m_batches.put(WalkerBatch());
+}
@@ -0,0 +1,143 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#ifndef DIRWALKER_H
+#define DIRWALKER_H
+
+#include <QThread>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+
+#include "indexer.h"
+#include "dirnotifier.h"
+#include "qdirext.h"
+#include "iothrottle.h"
+#include "watchpredicate.h"
+#include "globset.h"
+
+//#define _VERBOSE_WALKER 1
+
+#define WALKER_THREADS_PER_CORE         2       // walking is mostly waiting for the disk, keep requests in flight
+#define WALKER_BATCH_SIZE               256     // entries handed over to the consumer at once
+#define WALKER_MAX_PENDING_BATCHES      64      // batches waiting for the consumer before the walk blocks
+#define WALKER_IDLE_WAIT                10      // millisecs an idle thread waits before trying to steal again
+
+/**
+  * The entries found by the walker, handed over to the consumer in one go.
+  */
+class WalkerBatch {
+public:
+    QStringList m_directories;              // discovered directories
+    QStringList m_unwatchedDirectories;     // discovered directories the notifier refused
+    QStringList m_files;                    // discovered files
+    QList<QDirExtEntry> m_fileEntries;      // the files' entries: path as signaled (remote files are signaled by their local copy), stat if asked for
+
+    inline int count() {
+        return m_directories.count() + m_files.count();
+    }
+};
+
+class DirWalker;
+
+class DirWalkerThread : public QThread {
+    Q_OBJECT
+
+public:
+    explicit DirWalkerThread(DirWalker *walkerP, int worker) : QThread() {
+        m_walkerP = walkerP;
+        m_worker = worker;
+    }
+
+protected:
+    void run();
+
+private:
+    DirWalker   *m_walkerP;
+    int         m_worker;
+};
+
+/**
+  * The walker discovers a directory tree with several threads. Each thread owns a deque of
+  * directories to list: it pushes the sub directories it finds at the back and pops its next
+  * directory from the back (depth first, so the deques stay short), and when its deque is empty it
+  * steals from the front of another thread's deque (the shallowest directories, which hold the
+  * largest sub trees).
+  *
+  * The results are grouped in batches, read by a single consumer (the watcher thread) with
+  * nextBatch, which owns the PathSet. If a notifier is given, the directories are registered with
+  * it before being listed so nothing created meanwhile is missed. With stat set, the files' size,
+  * modification time and inode are retrieved while listing. If a predicate is given, the files it
+  * doesn't accept are left out and the directories it doesn't accept aren't walked down. So are
+  * the files and directories the globs, if given, exclude: each name is matched once, as listed.
+  */
+class DirWalker {
+public:
+    explicit DirWalker(bool recursive, DirNotifier *notifierP = NULL, bool withStat = false, const WatchPredicate *predicateP = NULL, const GlobSet *globsP = NULL);
+    ~DirWalker();
+
+    void start(const QString &root);
+    bool nextBatch(WalkerBatch *batchP);
+    void stop();
+
+    void walk(int worker);
+
+    inline IoThrottle *getThrottle() {
+        return m_throttleP;
+    }
+
+private:
+    /**
+      * A thread's directory deque.
+      */
+    class Deque {
+    public:
+        QMutex          m_mutex;
+        QList<QString>  m_directories;
+    };
+
+    bool                        m_recursive;
+    bool                        m_withStat;
+    DirNotifier                 *m_notifierP;
+    const WatchPredicate        *m_predicateP;          // read only while walking
+    const GlobSet               *m_globsP;              // read only while walking
+    QMutex                      m_notifierMutex;        // the notifier isn't thread safe
+    QVector<Deque *>            m_deques;
+    QList<DirWalkerThread *>    m_threads;
+    QAtomicInt                  m_pendingDirectories;   // pushed and not listed yet
+    QAtomicInt                  m_runningThreads;
+    QMutex                      m_idleMutex;
+    QWaitCondition              m_workAvailable;
+    IndexQueue<WalkerBatch>     m_batches;
+    IoThrottle                  *m_throttleP;           // the starting thread's, applied to the walker threads
+    volatile bool               m_stop;
+
+    void push(int worker, const QString &directory);
+    bool nextDirectory(int worker, QString *directoryP);
+    void listDirectory(int worker, const QString &directory, WalkerBatch *batchP);
+};
+
+#endif // DIRWALKER_H
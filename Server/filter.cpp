@@ -24,8 +24,10 @@
 #include <QStringList>
 #include <QThread>
 #include <QDateTime>
+#include <QTime>
 #include <QtCore/QCoreApplication>
 #include <QVariant>
+#include <QFileInfo>
 #include <QDebug>
 
 #include "filter.h"
@@ -34,6 +36,7 @@
 #include "qdirext.h"
 
 ServerDatabase Filter::m_db;
+QSemaphore     Filter::m_pluginsSem(1);
 
 /**
   * The constructor initializes the filter object and loads the associated plugins.
@@ -47,9 +50,17 @@ void Filter::loadPlugin(QString pluginFilename) {
         qDebug() << "Loaded plugin: " << pluginFilename;
 #endif
         PluginInterface *pluginP = qobject_cast<PluginInterface *>(loader.instance());  // this singleton instance will be automatically
+        m_pluginsSem.acquire();
         pluginP = pluginP->newInstance(m_virtualDirectoryPath);                         // unloaded when the server exits
+        m_pluginsSem.release();
         m_plugins.append(pluginP);
         m_pluginFilenames.append(pluginFilename);
+
+        // checked last until the next reordering
+        m_statsMutex.lock();
+        m_pluginStats.append(PluginStats());
+        m_pluginOrder.append(m_plugins.count() - 1);
+        m_statsMutex.unlock();
     }
     else
         qDebug() << QObject::tr("Failed to load plugin: ") + pluginFilename + QObject::tr(", error: ") + loader.errorString();
@@ -65,27 +76,108 @@ void Filter::unloadPlugin(QString pluginFilename) {
     PluginInterface *pluginP = m_plugins[index];
     m_plugins.remove(index);
 
+    m_statsMutex.lock();
+    m_pluginStats.remove(index);
+    m_pluginOrder.remove(m_pluginOrder.indexOf(index));
+    for (int i = 0; i < m_pluginOrder.count(); i++)
+        if (m_pluginOrder[i] > index)
+            m_pluginOrder[i]--;
+    m_statsMutex.unlock();
+
+    m_pluginsSem.acquire();
     delete pluginP;
+    m_pluginsSem.release();
+}
+
+/**
+  * Returns the plugin instances used by the given indexer worker, creates them (with the
+  * current scripts) the first time.
+  */
+QVector<PluginInterface *> Filter::getWorkerPlugins(int worker) {
+    QVector<PluginInterface *> plugins;
+
+    m_pluginsSem.acquire();
+
+    if (m_workerPlugins.count() <= worker)
+        m_workerPlugins.resize(worker + 1);
+
+    if (m_workerPlugins[worker].isEmpty()) {
+        for (int i = 0; i < m_plugins.count(); i++) {
+            PluginInterface *pluginP = m_plugins[i]->newInstance(m_virtualDirectoryPath);
+            pluginP->setScript(m_plugins[i]->getScript());
+            m_workerPlugins[worker].append(pluginP);
+        }
+    }
+
+    plugins = m_workerPlugins[worker];
+
+    m_pluginsSem.release();
+
+    return plugins;
+}
+
+/**
+  * Returns what each plugin's script may retain (see isSkipped), told from the current scripts the
+  * first time.
+  */
+QVector<WatchPredicate> Filter::getScriptPredicates() {
+    QVector<WatchPredicate> predicates;
+
+    m_pluginsSem.acquire();
+
+    if (m_scriptPredicates.count() != m_plugins.count()) {
+        m_scriptPredicates.clear();
+        for (int i = 0; i < m_plugins.count(); i++)
+            m_scriptPredicates.append(WatchPredicate::fromScript(m_plugins[i]->getScript()));
+    }
+
+    predicates = m_scriptPredicates;
+
+    m_pluginsSem.release();
+
+    return predicates;
+}
+
+/**
+  * Deletes the indexer workers' plugin instances, they'll be recreated from m_plugins when
+  * needed. Must be called with the tree locked (or once the filter is out of the tree).
+  */
+void Filter::deleteWorkerPlugins() {
+    m_pluginsSem.acquire();
+
+    for (int i = 0; i < m_workerPlugins.count(); i++)
+        qDeleteAll(m_workerPlugins[i]);
+    m_workerPlugins.clear();
+    m_scriptPredicates.clear();
+
+    m_pluginsSem.release();
 }
 
 /**
   * Constructs a filter under a parent filter, watching a physical directory (optionnally recursively)
-  * using the given list of plugins.
+  * using the given list of plugins, leaving out what the globs exclude.
   */
-Filter::Filter(QString virtualDirectoryPath, QString url, bool recursive, QStringList pluginNames, Filter *parentP) {
+Filter::Filter(QString virtualDirectoryPath, QString url, bool recursive, QStringList pluginNames, QStringList globs, Filter *parentP) {
     QFileInfoExt dirExt(url);
 
     // adds the filter to the db and keep its id
     m_db.addFilter(virtualDirectoryPath);
     m_filterId = m_db.getFilterId(virtualDirectoryPath);
 
+    // the files it already retains (a db was loaded)
+    m_retainedFiles = m_db.getFiles(m_filterId).toSet();
+
     m_watcherP = NULL;
+    m_indexerP = NULL;
+    m_generation = 0;
+    m_numChecks = 0;
 
     // keep track of the physical hierarchy to later scan
     m_parentP = parentP;
     m_url = url;
     m_dir = dirExt.absoluteFilePath();
     m_recursive = recursive;
+    m_globs = GlobSet(globs);
 
     // keep the virtual directory path
     m_virtualDirectoryPath = virtualDirectoryPath;
@@ -100,8 +192,10 @@ Filter::Filter(QString virtualDirectoryPath, QString url, bool recursive, QStrin
         if (!parentP &&
             !m_plugins.isEmpty() &&
             !m_url.isEmpty() &&
-            dirExt.exists())
-            m_watcherP = new Watcher(m_url, recursive, this);
+            dirExt.exists()) {
+            m_indexerP = new Indexer(this);
+            m_watcherP = Watcher::subscribe(this, m_url, recursive);
+        }
     }
 }
 
@@ -116,46 +210,77 @@ Filter::~Filter() {
 
     displayActivity(tr("Deleting filter %1").arg(m_virtualDirectoryPath));
 
+    // nothing is signaled anymore once unsubscribed, the watcher goes with its last subscription
     if (m_watcherP)
-        m_watcherP->acquireWatchSemaphore();
+        Watcher::unsubscribe(this);
 
-    if (m_watcherP) {
-        if (isRunning())
-            stop();
-        delete m_watcherP;
-    }
+    // stop indexing, once the watcher can't feed the indexer anymore
+    if (m_indexerP)
+        delete m_indexerP;
 
     // delete plugins
+    deleteWorkerPlugins();
+
+    m_pluginsSem.acquire();
     qDeleteAll(m_plugins);
     m_plugins.clear();
+    m_pluginsSem.release();
 
     // deletes the filter from the db
     m_db.deleteFilter(m_filterId);
 }
 
 /**
-  * Modifies the directory, recursivity or plugins of the filter.
+  * Modifies the directory, recursivity, plugins or globs of the filter. A filter moved to another
+  * directory, or getting or losing its watcher, is rescanned. Otherwise the changes are applied
+  * incrementally:
+  *
+  *     - a recursivity change resubscribes a root filter to its watcher from the files it was
+  *       signaled: only the newly included files are signaled, those not covered anymore are
+  *       dropped.
+  *     - the attributes of a removed plugin are removed from the db, and the files are checked
+  *       again from their stored attributes (reevaluateStored).
+  *     - an added plugin extracts its attributes for the files retained by the parent filter,
+  *       the other plugins use the stored ones. A root filter's rejected files aren't stored
+  *       though: it has its watcher signal all its files again, without cleaning the db up.
+  *     - new globs have a root filter's watcher catch it up (see Watcher::updatePredicate), a
+  *       child filter checks the files retained by its parent again.
   */
-void Filter::modifyFilter(QString url, bool recursive, QStringList pluginFilenames) {
+void Filter::modifyFilter(QString url, bool recursive, QStringList pluginFilenames, QStringList globs) {
     QFileInfoExt dirExt(url);
+    GlobSet      globSet(globs);
 
-    bool modified = false;
-    bool watcherWasRunning = isRunning();
+    bool        urlModified = false;
+    bool        recursiveModified = false;
+    bool        globsModified = false;
+    bool        pluginsAdded = false;
+    bool        pluginsRemoved = false;
+    QStringList removedAttributes;
+    bool        watcherWasRunning = isRunning();
 
     if (isRunning())
         stop();
 
+    // the indexer workers may be using the filter
+    lockTree();
+
     // directory
     if (m_url != url) {
         m_url = url;
         m_dir = dirExt.absoluteFilePath();
-        modified = true;
+        urlModified = true;
     }
 
     // recursivity
     if (m_recursive != recursive) {
         m_recursive = recursive;
-        modified = true;
+        recursiveModified = true;
+    }
+
+    // globs
+    if (m_globs != globSet) {
+        m_globs = globSet;
+        globsModified = true;
     }
 
     // plugins
@@ -166,8 +291,9 @@ void Filter::modifyFilter(QString url, bool recursive, QStringList pluginFilenam
         if (pluginFilenames.contains(pluginFilename))
             continue; // keep this one
 
+        removedAttributes += m_plugins[i - 1]->getAttributeNames();
         unloadPlugin(pluginFilename);
-        modified = true;
+        pluginsRemoved = true;
     }
 
     // load the new ones
@@ -180,93 +306,314 @@ void Filter::modifyFilter(QString url, bool recursive, QStringList pluginFilenam
                     continue; // keep this one, we already have it
 
                 loadPlugin(pluginFilename);
-                modified = true;
+                pluginsAdded = true;
             }
         }
     }
 
-    if (modified) {
+    // the attributes the remaining plugins have too are kept
+    for (int i = 0; i < m_plugins.count(); i++) {
+        QList<QString> attributes = m_plugins[i]->getAttributeNames();
+        for (int j = 0; j < attributes.count(); j++)
+            removedAttributes.removeAll(attributes[j]);
+    }
+
+    // the workers' plugins will be recreated from the new ones
+    if (pluginsAdded || pluginsRemoved)
+        deleteWorkerPlugins();
+
+    unlockTree();
+
+    bool watched = !m_parentP &&
+                   !m_plugins.isEmpty() &&
+                   !m_url.isEmpty() &&
+                   dirExt.exists();
+
+    if (urlModified || (!m_parentP && watched != (m_watcherP != NULL))) {
         // do we have a watcher?
-        if (m_watcherP) {
-            delete m_watcherP;
-            m_watcherP = NULL;
-        }
+        if (m_watcherP)
+            Watcher::unsubscribe(this);
 
         // if at least one plugin was loaded, create the watcher for the given directory
         // (if existing)
-        if (!m_parentP &&
-            !m_plugins.isEmpty() &&
-            !m_url.isEmpty() &&
-            dirExt.exists())
-            m_watcherP = new Watcher(m_url, recursive, this);
+        if (watched) {
+            if (!m_indexerP)
+                m_indexerP = new Indexer(this);
+            m_watcherP = Watcher::subscribe(this, m_url, recursive);
+        }
+
+        if (watcherWasRunning)
+            start();
+
+        rescanDirectory(); // force a refresh of the filtered files
+        return;
+    }
+
+    if (recursiveModified && m_watcherP) {
+        QString     checkpointUrl;
+        FileStates  states;
+
+        // caught up against what it was signaled
+        m_watcherP->getCheckpoint(this, &checkpointUrl, &states);
+        Watcher::unsubscribe(this);
+        m_watcherP = Watcher::subscribe(this, m_url, recursive);
+        m_watcherP->setCheckpoint(this, checkpointUrl, states);
+
+        if (!recursive) {
+            waitForIndexing();
+
+            lockTree();
+            dropSubdirectoryFiles();
+            unlockTree();
+        }
     }
 
+    if (pluginsAdded || pluginsRemoved) {
+        m_db.removeFilesAttributes(m_filterId, removedAttributes);
+
+        if (m_parentP || !pluginsAdded)
+            reevaluateStored();
+    } else if (globsModified && m_parentP)
+        reevaluateStored();
+
+    if (m_watcherP && (pluginsAdded || pluginsRemoved || globsModified))
+        m_watcherP->updatePredicate(this);
+
     if (watcherWasRunning)
         start();
 
-    if (modified)
-        rescanDirectory(); // force a refresh of the filtered files
+    // the files a root filter rejected may be retained by the new plugins
+    if (!m_parentP && pluginsAdded)
+        scanDirectory();
 }
 
 /**
-  * Checks the file referenced by the given absolute path against the plugins' rules and
-  * optionaly save its reference into the db.
+  * Checks the record's file against the rules of the worker's plugins, in evaluation order (see
+  * PluginStats). If retained, returns the file attributes to save, in the plugins' order. A
+  * plugin's script which can't retain the file isn't run, a plugin whose manifest excludes the
+  * file saves <null> attributes unless its script was run.
   */
+bool Filter::checkFile(AttributeRecord *recordP, int worker, IndexAttributes *attributesP) {
+    QVector<PluginInterface *> workerPlugins = getWorkerPlugins(worker);
+    QVector<WatchPredicate>    predicates = getScriptPredicates();
+    QVector<bool>              checked(workerPlugins.count());
+    QVector<int>               order = getPluginOrder();
+    QVector<PluginStats>       checks(workerPlugins.count());
+    bool retained = false;
+
+    // a child's globs (a root filter isn't signaled what its globs leave out)
+    if (m_parentP && m_globs.excludesPath(m_dir, recordP->m_path))
+        return false;
+
+    // the scripts which may retain the file, told from its path
+    for (int i = 0; i < workerPlugins.count(); i++)
+        checked[i] = i >= predicates.count() || predicates[i].acceptsFile(recordP->m_path);
+
+    // if any plugin accepts the file, then its ref will be saved
+    for (int i = 0; !retained && i < order.count(); i++) {
+        int   index = order[i];
+        QTime time;
+
+        if (!checked[index])
+            continue;
 
-bool Filter::checkAndSaveFile(QString path) {
-    bool saved = false;
+        time.start();
+        extractAttributes(workerPlugins[index], recordP, true);
+        checks[index].m_extractTime = time.restart();
 
-    // does the file rely under the watched directory?
-    if (!path.startsWith(m_dir))
-        return saved;
+        retained = workerPlugins[index]->runScript();
+        checks[index].m_scriptTime = time.elapsed();
+        checks[index].m_numChecks = 1;
+        checks[index].m_numAccepted = retained ? 1 : 0;
+    }
+
+    addPluginStats(checks);
 
+    if (!retained)
+        return false;
 
-    // if any plugin accepts the file, then save its ref
-    // in the db
-    for (int i = 0; !saved && i < m_plugins.count(); i++) {
-        m_plugins[i]->loadAttributes(path);
-        saved |= m_plugins[i]->checkFile(path);
+    // collect the file attributes, the plugins which weren't checked extract them now unless
+    // their manifest excludes the file
+    QVector<bool> extracted(workerPlugins.count());
+    QSet<QString> extractedNames;
+    for (int i = 0; i < workerPlugins.count(); i++) {
+        extracted[i] = checked[i] || isHandled(workerPlugins[i], recordP);
+        if (extracted[i])
+            extractedNames += workerPlugins[i]->getAttributeNames().toSet();
     }
 
-    // save file if retained
-    if (saved) {
-        QString fileId = m_db.addFile(m_filterId, path); // add file to db
+    for (int i = 0; i < workerPlugins.count(); i++) {
+        if (extracted[i])
+            *attributesP += extractAttributes(workerPlugins[i], recordP, false);
+        else
+            *attributesP += nullAttributes(workerPlugins[i], extractedNames);
+    }
 
-        // signal
-        newFile(m_virtualDirectoryPath, path);
+    return true;
+}
 
-        // save file attributes
-        for (int i = 0; i < m_plugins.count(); i++) {
-            PluginInterface *fP = m_plugins[i];
-            fP->loadAttributes(path); // attributes are loaded only if not done in the above checkFile iteration, we don't reload attrs if same file...
-            QList<QString>attributes = fP->getAttributeNames();
-            for (QList<QString>::iterator j = attributes.begin(); j != attributes.end(); j++) {
-                    QString  attrName = (*j);
-                    QVariant attrObjValue = fP->getAttributeValue(attrName);
-                    QString attrValue = attrObjValue.isValid() ? attrObjValue.toString() : "<null>";
-                    m_db.addFileAttribute(fileId, attrName, attrValue);
-            }
-        }
+/**
+  * Returns the order the plugins are checked in.
+  */
+QVector<int> Filter::getPluginOrder() {
+    QMutexLocker locker(&m_statsMutex);
+
+    return m_pluginOrder;
+}
+
+/**
+  * Adds what the plugins cost and decided checking a file, and reorders them every
+  * FILTER_REORDER_INTERVAL checks.
+  */
+void Filter::addPluginStats(const QVector<PluginStats> &checks) {
+    QMutexLocker locker(&m_statsMutex);
+
+    // the plugins changed meanwhile
+    if (checks.count() != m_pluginStats.count())
+        return;
+
+    for (int i = 0; i < checks.count(); i++) {
+        PluginStats &stats = m_pluginStats[i];
+
+        stats.m_numChecks += checks[i].m_numChecks;
+        stats.m_numAccepted += checks[i].m_numAccepted;
+        stats.m_extractTime += checks[i].m_extractTime;
+        stats.m_scriptTime += checks[i].m_scriptTime;
+        m_numChecks += checks[i].m_numChecks;
+    }
+
+    if (m_numChecks >= FILTER_REORDER_INTERVAL) {
+        reorderPlugins();
+        m_numChecks = 0;
+    }
+}
+
+/**
+  * Sorts the plugins by increasing expected cost, the order doesn't change between equals. The
+  * stats mutex is held.
+  */
+void Filter::reorderPlugins() {
+    QVector<int> order;
+
+    for (int i = 0; i < m_pluginStats.count(); i++) {
+        int j = order.count();
+        while (j > 0 && m_pluginStats[i].expectedCost() < m_pluginStats[order[j - 1]].expectedCost())
+            j--;
+
+        order.insert(j, i);
     }
 
-    return saved;
+#ifdef _VERBOSE_FILTER
+    if (order != m_pluginOrder)
+        qDebug() << "Filter " << m_virtualDirectoryPath << " plugins reordered " << order;
+#endif
+
+    m_pluginOrder = order;
+}
+
+/**
+  * Returns the plugins' names and stats, in the order they're checked in.
+  */
+QList<QPair<QString, PluginStats> > Filter::getPluginStats() {
+    QList<QPair<QString, PluginStats> > stats;
+    QMutexLocker                        locker(&m_statsMutex);
+
+    for (int i = 0; i < m_pluginOrder.count(); i++)
+        stats.append(qMakePair(m_plugins[m_pluginOrder[i]]->getName(), m_pluginStats[m_pluginOrder[i]]));
+
+    return stats;
+}
+
+/**
+  * Returns true if the plugin's manifest covers the record's file: the plugin declares nothing,
+  * or the file's suffix or first bytes match. The file is read only if the suffix doesn't match
+  * and the plugin declares signatures.
+  */
+bool Filter::isHandled(PluginInterface *pluginP, AttributeRecord *recordP) {
+    QStringList         suffixes = pluginP->getSuffixes();
+    QList<QByteArray>   signatures = pluginP->getSignatures();
+
+    if (suffixes.isEmpty() && signatures.isEmpty())
+        return true;
+
+    if (suffixes.contains(recordP->getSuffix()))
+        return true;
+
+    if (signatures.isEmpty())
+        return false;
+
+    QByteArray head = recordP->getHead();
+    for (int i = 0; i < signatures.count(); i++)
+        if (head.startsWith(signatures[i]))
+            return true;
+
+    return false;
+}
+
+/**
+  * Returns the plugin's attributes, all <null>: saved for a file its manifest excludes. Those
+  * another plugin extracted (the FilePlugin ones the others inherit) are left to it, not to
+  * overwrite their values.
+  */
+IndexAttributes Filter::nullAttributes(PluginInterface *pluginP, const QSet<QString> &extractedNames) {
+    IndexAttributes attributes;
+    QList<QString>  names = pluginP->getAttributeNames();
+
+    for (int i = 0; i < names.count(); i++)
+        if (!extractedNames.contains(names[i]))
+            attributes.append(qMakePair(names[i], QString("<null>")));
+
+    return attributes;
 }
 
 /**
-  * Matches (recursively) a new file against the filter rules (plugin' scripts). If the file is
-  * filtered-in, it'll be saved in the DB.
+  * Returns the attributes of the record's file for the given plugin. The first plugin of a type
+  * loads them and they're recorded, the next ones (of any filter of the tree) are given the
+  * recorded values if apply is set (to run their script), or nothing is done.
+  */
+IndexAttributes Filter::extractAttributes(PluginInterface *pluginP, AttributeRecord *recordP, bool apply) {
+    QString pluginName = pluginP->getName();
+
+    QHash<QString, AttributeRecord::Extraction>::const_iterator i = recordP->m_extractions.constFind(pluginName);
+    if (i != recordP->m_extractions.constEnd()) {
+        if (apply)
+            for (int j = 0; j < i->m_values.count(); j++)
+                pluginP->setAttributeValue(i->m_values[j].first, i->m_values[j].second);
+
+        return i->m_attributes;
+    }
+
+    AttributeRecord::Extraction extraction;
+
+    pluginP->loadAttributes(recordP->m_path);
+    QList<QString> attributes = pluginP->getAttributeNames();
+    for (QList<QString>::iterator j = attributes.begin(); j != attributes.end(); j++) {
+        QString  attrName = (*j);
+        QVariant attrObjValue = pluginP->getAttributeValue(attrName);
+        QString  attrValue = attrObjValue.isValid() ? attrObjValue.toString() : "<null>";
+        extraction.m_values.append(qMakePair(attrName, attrObjValue));
+        extraction.m_attributes.append(qMakePair(attrName, attrValue));
+    }
+
+    recordP->m_extractions.insert(pluginName, extraction);
+
+    return extraction.m_attributes;
+}
+
+/**
+  * Matches (recursively) a new or modified file against the filter rules (plugin' scripts), from
+  * an indexer worker thread with the tree locked. The resulting db operations are appended to
+  * operationsP: the file is retained by or dropped from each filter. Children filters only see
+  * the files retained by their parent, and evaluate the attributes recorded for the event.
   *
   * Edge Case: When the database is reloaded, the watcher is not in sync with the db, it hence
   * detects new files which are already in the db. This is the appropriate time to check whether
   * the file is still retained by the plugins since it could have been modified while the server
   * wasn't running or was running another filter set.
   */
-void Filter::checkNewFile(QString path) {
-    // Edge Case: if the file is already here (db was reloaded) check if it still matches the rules
-    if (m_db.hasFile(m_filterId, path)) {
-        checkModifiedFile(path);
-        return;
-    }
+void Filter::evaluateFile(AttributeRecord *recordP, int worker, QList<IndexOperation> *operationsP) {
+    IndexAttributes attributes;
+    QString         path = recordP->m_path;
 
     // does the file rely under the watched directory?
     if (!path.startsWith(m_dir))
@@ -276,91 +623,245 @@ void Filter::checkNewFile(QString path) {
     if (m_plugins.isEmpty())
         return;
 
-    // if a parent filter, the file must first have been
-    // filtered in by the parent.
-    if (m_parentP != NULL && !m_db.hasFile(m_parentP->m_filterId, path))
+    // if rejected, the file must be removed from the db (if it was there), and so from the
+    // children's
+    if (!checkFile(recordP, worker, &attributes)) {
+        operationsP->append(IndexOperation(IndexOperation::Drop, m_filterId, m_generation, path));
         return;
+    }
 
-    // if any plugin accepts the file, then save its ref
-    // in the db, then pass it over to the children
-    if (checkAndSaveFile(path)) {
-        // if children are present, broadcast check
-        for (QVector<Filter *>::iterator i = m_children.begin(); i != m_children.end(); i++) {
-            Filter *fP = (Filter *)(*i);
-            if (fP)
-                fP->checkNewFile(path);
-        }
+    operationsP->append(IndexOperation(IndexOperation::Retain, m_filterId, m_generation, path, attributes));
+
+    // if children are present, broadcast check
+    for (QVector<Filter *>::iterator i = m_children.begin(); i != m_children.end(); i++) {
+        Filter *fP = (Filter *)(*i);
+        fP->evaluateFile(recordP, worker, operationsP);
     }
 }
 
-
 /**
-  * Matches (recursively) a modified file against the filter rules (plugin' scripts). If the file is
-  * filtered-in, it'll be saved in the DB.
+  * Handles a file moved within the watched tree, from an indexer worker thread with the tree
+  * locked: the filters rename it and check it again from its stored attributes (see moveFile),
+  * those whose directory it left drop it. If it moved into the directory of a filter which didn't
+  * cover it, or the root filter rejected it (nothing was stored), it's dropped and evaluated again
+  * from scratch.
   */
-void Filter::checkModifiedFile(QString path) {
-    // does the file rely under the watched directory?
-    if (!path.startsWith(m_dir))
+void Filter::evaluateMove(QString oldPath, QString path, int worker, QList<IndexOperation> *operationsP) {
+    if (!m_parentP && (entersDirectory(oldPath, path) || !isRetained(oldPath))) {
+        operationsP->append(IndexOperation(IndexOperation::Drop, m_filterId, m_generation, oldPath));
+        AttributeRecord record(path);
+        evaluateFile(&record, worker, operationsP);
         return;
+    }
 
-    // if no plugins, nothing to do
-    if (m_plugins.isEmpty())
+    // moved out of the watched directory, drop it here and from the children
+    if (!path.startsWith(m_dir)) {
+        operationsP->append(IndexOperation(IndexOperation::Drop, m_filterId, m_generation, oldPath));
         return;
-
-    // if a parent filter, the file must first have been
-    // filtered in by the parent, else, remove it from db.
-    if (m_parentP != NULL && !m_db.hasFile(m_parentP->m_filterId, path)) {
-        m_db.removeFile(m_filterId, path); // remove file from db
-
-        // signal
-        delFile(m_virtualDirectoryPath, path);
     }
-    else {
-        // if any plugin accepts the file, then save its ref
-        // in the db. Else, if the file was in the db, remove it.
-        if (!checkAndSaveFile(path) && m_db.hasFile(m_filterId, path)) {
-            m_db.removeFile(m_filterId, path); // remove file from db
 
-            // signal
-            delFile(m_virtualDirectoryPath, path);
-        }
-    }
+    operationsP->append(IndexOperation(IndexOperation::Move, m_filterId, m_generation, path, IndexAttributes(), oldPath));
 
-    // if children are present, broadcast check
+    // if children are present, broadcast move
     for (QVector<Filter *>::iterator i = m_children.begin(); i != m_children.end(); i++) {
         Filter *fP = (Filter *)(*i);
-        fP->checkModifiedFile(path);
+        fP->evaluateMove(oldPath, path, worker, operationsP);
     }
 }
 
+/**
+  * Returns true if a file moved from oldPath to path enters the directory of a filter of this
+  * tree.
+  */
+bool Filter::entersDirectory(const QString &oldPath, const QString &path) {
+    if (path.startsWith(m_dir) && !oldPath.startsWith(m_dir))
+        return true;
+
+    for (QVector<Filter *>::iterator i = m_children.begin(); i != m_children.end(); i++)
+        if ((*i)->entersDirectory(oldPath, path))
+            return true;
+
+    return false;
+}
 
 /**
-  * Removes any potentially retained deleted file from the db.
+  * Applies an operation decided by evaluateFile/evaluateMove (or a file deletion) to the db.
+  * Called from the indexer persist thread, with the tree locked.
   */
-void Filter::checkDeletedFile(QString path) {
-    // does the file rely under the watched directory?
-    if (!path.startsWith(m_dir))
+void Filter::persistOperation(const IndexOperation &operation) {
+    if (operation.m_type == IndexOperation::Retain)
+        saveFile(operation.m_path, operation.m_attributes);
+    else if (operation.m_type == IndexOperation::Move)
+        moveFile(operation.m_oldPath, operation.m_path);
+    else
+        dropFile(operation.m_path);
+}
+
+/**
+  * Saves the file reference and its attributes into the db.
+  */
+void Filter::saveFile(QString path, const IndexAttributes &attributes) {
+    QString fileId = m_db.addFile(m_filterId, path); // add file to db
+
+    m_retainedMutex.lock();
+    m_retainedFiles.insert(path);
+    m_retainedMutex.unlock();
+
+    // signal
+    newFile(m_virtualDirectoryPath, path);
+
+    // save file attributes
+    for (int i = 0; i < attributes.count(); i++)
+        m_db.addFileAttribute(fileId, attributes[i].first, attributes[i].second);
+}
+
+/**
+  * Renames the file reference in the db if it was retained, its attributes are kept but those
+  * derived from its path, which follow it. Its new name may not be retained anymore: the rules
+  * are checked again from the stored attributes, and the file is dropped if rejected. A child
+  * filter which didn't retain the file checks it again the same way if its parent still retains
+  * it, and drops it if its parent doesn't anymore. The children filters get their own move
+  * operation, after their parent's.
+  */
+void Filter::moveFile(QString oldPath, QString path) {
+    bool wasRetained = isRetained(oldPath);
+
+    // a child filter only retains what its parent still does
+    if (m_parentP && !m_parentP->isRetained(path)) {
+        dropFile(oldPath);
         return;
+    }
 
-    // if no plugins, nothing to do
-    if (m_plugins.isEmpty())
+    if (!wasRetained && !m_parentP)
+        return;
+
+    if (wasRetained) {
+        m_db.moveFile(m_filterId, oldPath, path);
+
+        m_retainedMutex.lock();
+        m_retainedFiles.remove(oldPath);
+        m_retainedFiles.insert(path);
+        m_retainedMutex.unlock();
+
+        // signal
+        delFile(m_virtualDirectoryPath, oldPath);
+        newFile(m_virtualDirectoryPath, path);
+    }
+
+    IndexAttributes saved = wasRetained ? m_db.getFileAttributeValues(m_filterId, path) : IndexAttributes();
+    IndexAttributes own = saved;
+    IndexAttributes stored;
+    IndexAttributes attributes;
+
+    // the parent's attributes were moved already
+    if (m_parentP)
+        stored = m_db.getFileAttributeValues(m_parentP->getFilterId(), path);
+
+    setPathAttributes(path, &own);
+
+    if (!recheckFile(path, stored, own, &attributes)) {
+        dropFile(path);
         return;
+    }
 
+    if (wasRetained)
+        saveChangedAttributes(path, saved, attributes);
+    else
+        saveFile(path, attributes);
+}
+
+/**
+  * Sets the attributes derived from the file path (see WatchPredicate) to those of the given
+  * path, the others are left as is.
+  */
+void Filter::setPathAttributes(const QString &path, IndexAttributes *attributesP) {
+    QFileInfo info(path);
+
+    for (int i = 0; i < attributesP->count(); i++) {
+        QPair<QString, QString> &attribute = (*attributesP)[i];
+
+        if (attribute.first == PREDICATE_PATH_ATTR)
+            attribute.second = info.absolutePath();
+        else if (attribute.first == PREDICATE_NAME_ATTR)
+            attribute.second = info.fileName();
+        else if (attribute.first == PREDICATE_TYPE_ATTR)
+            attribute.second = info.suffix();
+    }
+}
+
+/**
+  * Removes any potentially retained file from the db, and from the children filters.
+  */
+void Filter::dropFile(QString path) {
     // just drop the file reference if it had previously been saved in the db
-    if (m_db.hasFile(m_filterId, path)) {
+    if (isRetained(path)) {
         m_db.removeFile(m_filterId, path); // remove file from db
 
+        m_retainedMutex.lock();
+        m_retainedFiles.remove(path);
+        m_retainedMutex.unlock();
+
         // signal
         delFile(m_virtualDirectoryPath, path);
 
-        // if children are present, broadcast check
+        // if children are present, broadcast drop
         for (QVector<Filter *>::iterator i = m_children.begin(); i != m_children.end(); i++) {
             Filter *fP = (Filter *)(*i);
-            fP->checkDeletedFile(path);
+            fP->dropFile(path);
         }
     }
 }
 
+/**
+  * Returns true if the file is retained by the filter (saved in the db).
+  */
+bool Filter::isRetained(const QString &path) {
+    QMutexLocker locker(&m_retainedMutex);
+
+    return m_retainedFiles.contains(path);
+}
+
+/**
+  * Returns the files retained by the filter.
+  */
+QStringList Filter::getFiles() {
+    QMutexLocker locker(&m_retainedMutex);
+
+    return m_retainedFiles.toList();
+}
+
+/**
+  * Returns the filter of the tree with the given id, NULL if not found.
+  */
+Filter *Filter::findFilter(const QString &filterId) {
+    if (m_filterId == filterId)
+        return this;
+
+    for (QVector<Filter *>::iterator i = m_children.begin(); i != m_children.end(); i++) {
+        Filter *fP = (*i)->findFilter(filterId);
+        if (fP)
+            return fP;
+    }
+
+    return NULL;
+}
+
+/**
+  * Locks the filter tree against the root indexer's workers, before modifying it.
+  */
+void Filter::lockTree() {
+    Filter *rootP = getRoot();
+
+    if (rootP->m_indexerP)
+        rootP->m_indexerP->lockTree();
+}
+
+void Filter::unlockTree() {
+    Filter *rootP = getRoot();
+
+    if (rootP->m_indexerP)
+        rootP->m_indexerP->unlockTree();
+}
 
 /**
  * Delete all children filters (called from destructor only). There's a redundant children deletion when the
@@ -374,25 +875,24 @@ void Filter::deleteChildren() {
 
 /**
  * Delete all children filters and remove them from the passed list. We must protect this from
- * concurrency with the watcher thread raising a file/directory change to a... deleted filter.
+ * concurrency with the indexer workers evaluating a file against a... deleted filter.
  */
 void Filter::deleteChildren(QVector<Filter *> *filtersP) {
-    if (m_watcherP)
-        m_watcherP->acquireWatchSemaphore();
+    lockTree();
+    deleteDescendants(filtersP);
+    unlockTree();
+}
 
+void Filter::deleteDescendants(QVector<Filter *> *filtersP) {
     for (int i = m_children.count(); i > 0; i--) {
         Filter *fP = m_children[i - 1];
-        fP->deleteChildren(filtersP);
+        fP->deleteDescendants(filtersP);
         int fIndex = filtersP->indexOf(fP);
         if (fIndex != -1)
             filtersP->remove(fIndex);
         delete fP;
     }
     m_children.clear();
-
-    if (m_watcherP)
-        m_watcherP->releaseWatchSemaphore();
-
 }
 
 /**
@@ -402,14 +902,12 @@ void Filter::addChild(Filter *childP) {
     if (!childP)
         return;
 
-    if (m_watcherP)
-        m_watcherP->acquireWatchSemaphore();
+    lockTree();
 
     m_children.append(childP);
     childP->setParent(this);
 
-    if (m_watcherP)
-        m_watcherP->releaseWatchSemaphore();
+    unlockTree();
 }
 
 /**
@@ -419,8 +917,7 @@ void Filter::removeChild(Filter *childP) {
     if (!childP)
         return;
 
-    if (m_watcherP)
-        m_watcherP->acquireWatchSemaphore();
+    lockTree();
 
     int index = m_children.indexOf(childP);
     if (index != -1)  {
@@ -428,8 +925,7 @@ void Filter::removeChild(Filter *childP) {
         childP->setParent(NULL);
     }
 
-    if (m_watcherP)
-        m_watcherP->releaseWatchSemaphore();
+    unlockTree();
 }
 
 /**
@@ -441,18 +937,256 @@ void Filter::rescanDirectory() {
     scanDirectory();
 }
 
+/**
+ * Runs the (modified) rules of a filter again against the attributes saved in the db, instead of
+ * the files: the files retained by its parent (or by itself if root) are checked, and only the
+ * changes are saved and signaled (the files it now retains are checked by its children the same
+ * way). Nothing is read from disk unless the filter uses a plugin its parent doesn't.
+ *
+ * A root filter's rejected files were never saved: its watcher signals them again, with those
+ * its rules' predicate newly admits (see Watcher::recheck), and they're checked from the files.
+ */
+void Filter::reevaluate() {
+    bool watcherWasRunning = isRunning();
+    if (watcherWasRunning)
+        stop();
+
+    reevaluateStored();
+
+    if (!m_parentP && m_watcherP)
+        m_watcherP->recheck(this);
+
+    if (watcherWasRunning)
+        start();
+}
+
+/**
+ * Checks the files again from their stored attributes, with the watcher stopped: the files
+ * retained by the parent filter, or by the filter itself if root (the files a root filter
+ * rejected can't be retained by its plugins' former rules or fewer plugins).
+ */
+void Filter::reevaluateStored() {
+    // no operation decided by the former rules or plugins may be applied after these
+    waitForIndexing();
+
+    lockTree();
+
+    if (m_parentP) {
+        QHash<QString, IndexAttributes> stored = m_db.getFilesAttributes(m_parentP->getFilterId());
+        reevaluateFiles(stored.keys(), stored, m_db.getFilesAttributes(m_filterId));
+    } else {
+        QHash<QString, IndexAttributes> own = m_db.getFilesAttributes(m_filterId);
+        reevaluateFiles(own.keys(), own, own);
+    }
+
+    unlockTree();
+}
+
+/**
+ * Checks the given files again, from their stored attributes (those given, completed by those
+ * saved by this filter). The files rejected are dropped, the files newly retained are saved and
+ * checked by the children. The files still retained get the attributes they miss (those of a
+ * new plugin) saved.
+ */
+void Filter::reevaluateFiles(const QStringList &paths, const QHash<QString, IndexAttributes> &stored, const QHash<QString, IndexAttributes> &own) {
+    QHash<QString, IndexAttributes> retained;
+
+    for (int i = 0; i < paths.count(); i++) {
+        QString         path = paths[i];
+        IndexAttributes attributes;
+
+        if (!recheckFile(path, stored.value(path), own.value(path), &attributes)) {
+            dropFile(path);
+            continue;
+        }
+
+        if (isRetained(path)) {
+            saveMissingAttributes(path, own.value(path), attributes);
+            continue;
+        }
+
+        saveFile(path, attributes);
+        retained.insert(path, attributes);
+    }
+
+    if (retained.isEmpty())
+        return;
+
+    // if children are present, broadcast check of the new files
+    QStringList retainedPaths = retained.keys();
+    for (QVector<Filter *>::iterator i = m_children.begin(); i != m_children.end(); i++) {
+        Filter *fP = (Filter *)(*i);
+        fP->reevaluateFiles(retainedPaths, retained, m_db.getFilesAttributes(fP->getFilterId()));
+    }
+}
+
+/**
+ * Saves the attributes of a retained file which weren't saved yet.
+ */
+void Filter::saveMissingAttributes(const QString &path, const IndexAttributes &saved, const IndexAttributes &attributes) {
+    QSet<QString>   names;
+    QString         fileId;
+
+    for (int i = 0; i < saved.count(); i++)
+        names.insert(saved[i].first);
+
+    for (int i = 0; i < attributes.count(); i++) {
+        if (names.contains(attributes[i].first))
+            continue;
+
+        if (fileId.isEmpty())
+            fileId = m_db.addFile(m_filterId, path);
+
+        m_db.addFileAttribute(fileId, attributes[i].first, attributes[i].second);
+        names.insert(attributes[i].first);
+    }
+}
+
+/**
+ * Saves the attributes of a retained file which weren't saved yet or whose value changed.
+ */
+void Filter::saveChangedAttributes(const QString &path, const IndexAttributes &saved, const IndexAttributes &attributes) {
+    QHash<QString, QString> values;
+    QString                 fileId;
+
+    for (int i = 0; i < saved.count(); i++)
+        values.insert(saved[i].first, saved[i].second);
+
+    for (int i = 0; i < attributes.count(); i++) {
+        QHash<QString, QString>::const_iterator value = values.constFind(attributes[i].first);
+        if (value != values.constEnd() && *value == attributes[i].second)
+            continue;
+
+        if (fileId.isEmpty())
+            fileId = m_db.addFile(m_filterId, path);
+
+        m_db.addFileAttribute(fileId, attributes[i].first, attributes[i].second);
+        values.insert(attributes[i].first, attributes[i].second);
+    }
+}
+
+/**
+ * Drops the retained files of a (root) filter which aren't directly in its directory, once it
+ * isn't recursive anymore.
+ */
+void Filter::dropSubdirectoryFiles() {
+    QStringList files = getFiles();
+
+    for (int i = 0; i < files.count(); i++) {
+        QString name = files[i].mid(m_dir.length());
+        if (name.startsWith(QDir::separator()))
+            name.remove(0, 1);
+
+        if (name.contains(QDir::separator()))
+            dropFile(files[i]);
+    }
+}
+
+/**
+ * Checks a file against the rules of the filter's plugins, from stored attribute values. A
+ * plugin whose attributes weren't all stored loads them from the file, unless its manifest
+ * excludes the file (they're <null> then). A plugin's script which can't retain the file isn't
+ * run. If retained, returns the file attributes to save.
+ */
+bool Filter::recheckFile(const QString &path, const IndexAttributes &stored, const IndexAttributes &own, IndexAttributes *attributesP) {
+    QHash<QString, QString> values;
+    QVector<WatchPredicate> predicates = getScriptPredicates();
+    bool                    retained = false;
+    AttributeRecord         record(path);
+
+    if (m_parentP && m_globs.excludesPath(m_dir, path))
+        return false;
+
+    for (int i = 0; i < own.count(); i++)
+        values.insert(own[i].first, own[i].second);
+    for (int i = 0; i < stored.count(); i++)
+        values.insert(stored[i].first, stored[i].second);
+
+    // the plugins whose manifest excludes the file load nothing, unless their script is run
+    QVector<bool>   checked(m_plugins.count());
+    QVector<bool>   loaded(m_plugins.count());
+    QSet<QString>   loadedNames;
+    for (int i = 0; i < m_plugins.count(); i++) {
+        checked[i] = i >= predicates.count() || predicates[i].acceptsFile(path);
+        loaded[i] = checked[i] || isHandled(m_plugins[i], &record);
+        if (loaded[i])
+            loadedNames += m_plugins[i]->getAttributeNames().toSet();
+    }
+
+    for (int i = 0; i < m_plugins.count(); i++) {
+        PluginInterface *pluginP = m_plugins[i];
+        QList<QString>  attributes = pluginP->getAttributeNames();
+        bool            complete = true;
+
+        if (!loaded[i]) {
+            *attributesP += nullAttributes(pluginP, loadedNames);
+            continue;
+        }
+
+        for (int j = 0; complete && j < attributes.count(); j++)
+            complete = values.contains(attributes[j]);
+
+        if (complete) {
+            for (int j = 0; j < attributes.count(); j++)
+                pluginP->setAttributeValue(attributes[j], toAttributeValue(values.value(attributes[j]), pluginP->getAttributeClassName(attributes[j])));
+        } else
+            pluginP->loadAttributes(path);
+
+        // if any plugin accepts the file, then its ref will be saved
+        if (!retained && checked[i])
+            retained = pluginP->runScript();
+
+        // collect the file attributes
+        for (int j = 0; j < attributes.count(); j++) {
+            QString attrName = attributes[j];
+            if (complete)
+                attributesP->append(qMakePair(attrName, values.value(attrName)));
+            else {
+                QVariant attrObjValue = pluginP->getAttributeValue(attrName);
+                attributesP->append(qMakePair(attrName, attrObjValue.isValid() ? attrObjValue.toString() : QString("<null>")));
+            }
+        }
+    }
+
+    return retained;
+}
+
+/**
+ * Converts an attribute value saved in the db back to the type of its class.
+ */
+QVariant Filter::toAttributeValue(const QString &value, const QString &className) {
+    if (value == "<null>")
+        return QVariant();
+
+    if (className == "Numeric") {
+        bool ok;
+        qlonglong integer = value.toLongLong(&ok);
+        if (ok)
+            return QVariant(integer);
+
+        double real = value.toDouble(&ok);
+        if (ok)
+            return QVariant(real);
+    } else if (className == "Date") {
+        QDateTime date = QDateTime::fromString(value, Qt::ISODate);
+        if (date.isValid())
+            return QVariant(date);
+    } else if (className == "Boolean")
+        return QVariant(value == "true");
+
+    return QVariant(value);
+}
+
 /**
  * Forces the filter to scan the associated directory. Shall be called *only* after the
  * Filter was created (and after its rules were set).
  */
 
 void Filter::scanDirectory() {
-    // delete root filter watcher and recreate one or
+    // have the root filter's watcher signal all its files again or
     // invoke parents up to root to do it.
     if (m_watcherP) {
-        stop();
-        delete m_watcherP;
-        m_watcherP = new Watcher(m_dir, m_recursive, this);
+        m_watcherP->resync(this);
         start();
     } else if (m_parentP)
         m_parentP->scanDirectory();
@@ -464,13 +1198,30 @@ void Filter::scanDirectory() {
  *
  */
 void Filter::cleanup() {
+    // the pending index operations on these filters become stale
+    lockTree();
+    cleanupFiles();
+    unlockTree();
+
+    // the watcher won't signal the files it watches again, it must after a restart
+    Filter *rootP = getRoot();
+    if (rootP->m_watcherP)
+        rootP->m_watcherP->invalidateCheckpoint(rootP);
+}
+
+void Filter::cleanupFiles() {
+    m_generation++;
 
     m_db.removeFiles(m_filterId); // remove all files from db
 
+    m_retainedMutex.lock();
+    m_retainedFiles.clear();
+    m_retainedMutex.unlock();
+
     // if children are present, broadcast cleanup
     for (QVector<Filter *>::iterator i = m_children.begin(); i != m_children.end(); i++) {
         Filter *fP = (Filter *)(*i);
-        fP->cleanup();
+        fP->cleanupFiles();
     }
 }
 
@@ -562,13 +1313,24 @@ QString Filter::getPluginTip(QString plugin) {
   *Returns the javascript's last error for the given plugin if found, an empty QString else.
   */
 QString Filter::getScriptLastError(QString plugin) {
-    for (QVector<PluginInterface *>::iterator i = m_plugins.begin(); i != m_plugins.end(); i++) {
-        PluginInterface *fiP = *i;
-        if (fiP->getName() == plugin)
-            return fiP->getScriptLastError();
+    QString error;
+
+    // the scripts run in the indexer workers' plugin instances
+    lockTree();
+
+    for (int i = 0; error.isEmpty() && i < m_plugins.count(); i++) {
+        if (m_plugins[i]->getName() != plugin)
+            continue;
+
+        error = m_plugins[i]->getScriptLastError();
+        for (int j = 0; error.isEmpty() && j < m_workerPlugins.count(); j++)
+            if (i < m_workerPlugins[j].count())
+                error = m_workerPlugins[j][i]->getScriptLastError();
     }
 
-    return "";
+    unlockTree();
+
+    return error;
 }
 
 /**
@@ -581,7 +1343,19 @@ void Filter::setScript(QString plugin, QString script) {
 #ifdef _VERBOSE_FILTER
             qDebug() << "Filter::setScript(" << m_virtualDirectoryPath << ", " << plugin << ", " << script << ")";
 #endif
+            lockTree();
             fiP->setScript(script);
+            deleteWorkerPlugins(); // recreated with the new script
+            unlockTree();
+
+            // its acceptance rate is the former script's
+            m_statsMutex.lock();
+            m_pluginStats[i - m_plugins.begin()] = PluginStats();
+            m_statsMutex.unlock();
+
+            // the files the new script may retain are now signaled
+            if (!m_parentP && m_watcherP)
+                m_watcherP->updatePredicate(this);
             return;
         }
     }
@@ -598,23 +1372,17 @@ void Filter::stop() {
         return;
     }
 
-    // stop watcher
-    if (m_watcherP && m_watcherP->isRunning()) {
-        m_watcherP->stop();
-
+    // stop watching, blocks until the watcher doesn't signal us anymore
+    if (m_watcherP) {
 #ifdef _VERBOSE_FILTER
         qDebug() << "Filter is stopping and will block until watcher exits";
 #endif
 
-        m_watcherP->wait();
+        m_watcherP->stop(this);
 
 #ifdef _VERBOSE_FILTER
         qDebug() << "Filter unblocked";
 #endif
-
-        // so we don't get caught waiting for the semaphore
-        // in case it wasn't release when the watcher was terminated
-        m_watcherP->releaseWatchSemaphore();
     }
 }
 
@@ -626,8 +1394,68 @@ void Filter::start() {
     }
 
     // start watcher
-    if (m_watcherP && !m_watcherP->isRunning())
-        m_watcherP->start();
+    if (m_watcherP)
+        m_watcherP->start(this);
+}
+
+/**
+  * Sets the I/O limits of the (root) filter's indexer threads and plugins. Its watcher, if shared,
+  * applies the strictest limits of its root filters.
+  */
+void Filter::setIoLimits(const IoLimits &limits) {
+    // not root, propagate up
+    if (m_parentP) {
+        m_parentP->setIoLimits(limits);
+        return;
+    }
+
+    m_ioThrottle.setLimits(limits);
+
+    if (m_watcherP)
+        m_watcherP->updateIoLimits();
+}
+
+/**
+  * Returns what the (root) filter's rules may retain, told from its plugins' scripts: a file is
+  * retained if a plugin's script retains it, whatever the plugin's manifest. The children filters
+  * only see what their parent retains, they don't widen it.
+  */
+WatchPredicate Filter::getWatchPredicate() {
+    WatchPredicate          predicate = WatchPredicate::none();
+    QVector<WatchPredicate> predicates = getScriptPredicates();
+
+    for (int i = 0; i < predicates.count(); i++)
+        predicate = predicate.united(predicates[i]);
+
+    return predicate;
+}
+
+/**
+  * Blocks until the files signaled by the (stopped) watcher were indexed.
+  */
+void Filter::waitForIndexing() {
+    // not root, propagate up
+    if (m_parentP) {
+        m_parentP->waitForIndexing();
+        return;
+    }
+
+    if (m_indexerP)
+        m_indexerP->waitForIdle();
+}
+
+/**
+  * Unblocks the watcher thread signaling a change while the indexer's queue is full.
+  */
+void Filter::interruptIndexing() {
+    // not root, propagate up
+    if (m_parentP) {
+        m_parentP->interruptIndexing();
+        return;
+    }
+
+    if (m_indexerP)
+        m_indexerP->interruptPosts();
 }
 
 /**
@@ -639,7 +1467,7 @@ bool Filter::isRunning() {
         return m_parentP->isRunning();
 
     // ask watcher
-    return m_watcherP && m_watcherP->isRunning();
+    return m_watcherP && m_watcherP->isActive(this);
 }
 
 /**
@@ -693,12 +1521,17 @@ void Filter::directoryAdded(const QString &path) {
 #endif
 }
 
+/**
+  * The file change slots are invoked from the watcher thread, they queue the change to the
+  * indexer (blocking while its queue is full).
+  */
 void Filter::fileModified(const QString &path) {
 #ifdef _VERBOSE_FILTER
     qDebug() << "Modified file: " << path;
 #endif
 
-    checkModifiedFile(path);
+    if (m_indexerP)
+        m_indexerP->fileModified(path);
 }
 
 void Filter::fileDeleted(const QString &path) {
@@ -706,7 +1539,17 @@ void Filter::fileDeleted(const QString &path) {
     qDebug() << "Deleted file: " << path;
 #endif
 
-    checkDeletedFile(path);
+    if (m_indexerP)
+        m_indexerP->fileDeleted(path);
+}
+
+void Filter::fileMoved(const QString &oldPath, const QString &path) {
+#ifdef _VERBOSE_FILTER
+    qDebug() << "Moved file: " << oldPath << " -> " << path;
+#endif
+
+    if (m_indexerP)
+        m_indexerP->fileMoved(oldPath, path);
 }
 
 void Filter::fileAdded(const QString &path) {
@@ -714,5 +1557,6 @@ void Filter::fileAdded(const QString &path) {
     qDebug() << "Added file: " << path;
 #endif
 
-    checkNewFile(path);
+    if (m_indexerP)
+        m_indexerP->fileAdded(path);
 }
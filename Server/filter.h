@@ -27,13 +27,48 @@
 #include <QVector>
 #include <QSemaphore>
 #include <QStringList>
+#include <QSet>
+#include <QMutex>
+#include <QPair>
 
 #include "filter.h"
+#include "indexer.h"
 #include "plugininterface.h"
+#include "iothrottle.h"
+#include "watchpredicate.h"
+#include "globset.h"
 #include "serverdatabase.h"
 
 //#define _VERBOSE_FILTER 1
 
+#define FILTER_REORDER_INTERVAL     64      // plugin checks between two reorderings of a filter's plugins
+
+/**
+  * What a filter's plugin cost and decided so far, when checking files. A plugin's attributes are
+  * extracted whatever the order (a retained file saves them all, a rejected one ran all the
+  * rules), the order only spares the rules run once a file is retained: the plugins are checked
+  * by increasing expected cost, their average script time over their acceptance rate.
+  */
+class PluginStats {
+public:
+    PluginStats() {
+        m_numChecks = 0;
+        m_numAccepted = 0;
+        m_extractTime = 0;
+        m_scriptTime = 0;
+    }
+
+    // the smoothed average script time (millisecs) over the smoothed acceptance rate
+    inline double expectedCost() const {
+        return ((m_scriptTime + 1.0) / (m_numChecks + 1)) / ((m_numAccepted + 1.0) / (m_numChecks + 2));
+    }
+
+    int     m_numChecks;        // rules run
+    int     m_numAccepted;      // rules which retained the file
+    qint64  m_extractTime;      // millisecs, extracting the attributes (or applying those recorded) before the rules
+    qint64  m_scriptTime;       // millisecs
+};
+
 /**
  * A Filter uses instances of plugins and watchers to watch the directory's content.
  * The watcher, usually associated with the root filter, is responsible for scanning
@@ -47,8 +82,24 @@
  * files filtered in by the parent filter, not the physical files. Thus, children
  * filters do not watch directly a directory unless explicitly asked for a 'rescan'.
  *
- * A parent filter is responsible for broadcasting the check<Created/Modified/Deleted>File
- * method invocation to its children.
+ * The files reported by the watcher are matched against the whole filter tree by the root
+ * filter's indexer, out of the server thread. A parent filter is responsible for passing the
+ * files it retains over to its children (evaluateFile). Each indexer worker uses its own
+ * instances of the filter plugins. The attributes of a file are extracted once per plugin type
+ * and event, whatever the depth of the tree, and recorded for the other filters.
+ *
+ * A filter keeps the paths of the files it retains in memory, loaded from the db when created
+ * and written through as the db is updated, so the indexer never asks the db whether a file is
+ * retained.
+ *
+ * A filter may have include/exclude globs (see GlobSet): a root filter's watcher doesn't walk
+ * or signal what they leave out, a child filter doesn't retain it.
+ *
+ * A plugin whose manifest excludes a file (see PluginInterface::getSuffixes) doesn't extract its
+ * attributes: they're saved as <null>, but those another plugin extracted (the FilePlugin ones
+ * the other plugins inherit), which keep their value. Its script isn't run on the file only if it can't retain
+ * it anyway (see WatchPredicate::fromScript), as the default scripts testing the file type: a
+ * custom script which may retain any file still has the file extracted and checked.
  *
  * When deleting a filter, all of the children filters are deleted (and so on, recursively).
  *
@@ -70,15 +121,16 @@ public slots:
     void fileAdded(const QString &path);
     void fileDeleted(const QString &path);
     void fileModified(const QString &path);
+    void fileMoved(const QString &oldPath, const QString &path);
     void directoryAdded(const QString &path);
     void directoryDeleted(const QString &path);
     void directoryModified(const QString &path);
 
 public:
-    explicit Filter(QString virtualDirectoryPath, QString url, bool recursive, QStringList pluginNames, Filter *parentP = 0);
+    explicit Filter(QString virtualDirectoryPath, QString url, bool recursive, QStringList pluginNames, QStringList globs, Filter *parentP = 0);
     ~Filter();
 
-    void modifyFilter(QString url, bool recursive, QStringList pluginFilenames);
+    void modifyFilter(QString url, bool recursive, QStringList pluginFilenames, QStringList globs);
 
     void deleteChildren(QVector<Filter *> *filtersP);
 
@@ -87,9 +139,16 @@ public:
 
     void scanDirectory();
     void rescanDirectory();
+    void reevaluate();
 
     void cleanup();
 
+    void evaluateFile(AttributeRecord *recordP, int worker, QList<IndexOperation> *operationsP);
+    void evaluateMove(QString oldPath, QString path, int worker, QList<IndexOperation> *operationsP);
+    void persistOperation(const IndexOperation &operation);
+
+    Filter *findFilter(const QString &filterId);
+
     QVector<PluginInterface *> *getPlugins();
     QString getPluginTip(QString plugin);
     QString getScript(QString plugin);
@@ -125,13 +184,57 @@ public:
         return m_parentP;
     }
 
+    inline Filter *getRoot() {
+        Filter *rootP = this;
+        while (rootP->m_parentP)
+            rootP = rootP->m_parentP;
+
+        return rootP;
+    }
+
+    inline int getGeneration() {
+        return m_generation;
+    }
+
     inline QStringList getPluginFilenames() {
         return m_pluginFilenames;
     }
 
+    inline GlobSet getGlobs() {
+        return m_globs;
+    }
+
     void stop();    // call these ones to start/stop a whole filter tree.
     void start();
     bool isRunning();
+    void waitForIndexing();
+    void interruptIndexing();
+
+    inline Watcher *getWatcher() {
+        return m_watcherP;
+    }
+
+    // the watcher signaling the root filter, shared with the root filters on the same tree
+    inline void setWatcher(Watcher *watcherP) {
+        m_watcherP = watcherP;
+    }
+
+    // root filter only, the limits of its indexer's and watcher's I/O
+    inline IoThrottle *getIoThrottle() {
+        return &m_ioThrottle;
+    }
+
+    inline IoLimits getIoLimits() {
+        return m_ioThrottle.getLimits();
+    }
+
+    void setIoLimits(const IoLimits &limits);
+
+    // root filter only, what its rules may retain, for its watcher to leave the rest out
+    WatchPredicate getWatchPredicate();
+
+    // the plugins' names and stats, in evaluation order
+    QList<QPair<QString, PluginStats> > getPluginStats();
 
     inline bool isRoot() {
         return !m_parentP;
@@ -139,6 +242,9 @@ public:
 
     unsigned long numFiles(const QString &path);
 
+    bool        isRetained(const QString &path);
+    QStringList getFiles();
+
 private:
     Filter                          *m_parentP;     // parent filter (if any)
     QVector<Filter *>               m_children;     // children filters
@@ -146,23 +252,59 @@ private:
     QString                         m_url;          // url to watch
     bool                            m_recursive;    // whether we recursively watch through the sub-directories starting from dir
     Watcher                         *m_watcherP;
+    Indexer                         *m_indexerP;    // root filter only, evaluates and saves the watched files
+    IoThrottle                      m_ioThrottle;   // root filter only, throttles the indexer's I/O (and the watcher's)
+    int                             m_generation;   // incremented on cleanup, stale index operations are dropped
     QVector<PluginInterface *>      m_plugins;      // WARNING: these two sets MUST contain the plugin in the same order
     QStringList                     m_pluginFilenames;
+    GlobSet                         m_globs;        // the names left out below the directory
     QString                         m_virtualDirectoryPath;
     QString                         m_filterId;     // computed and help in the db
+    QSet<QString>                   m_retainedFiles; // the files retained in the db, the paths are shared with the other filters'
+    QMutex                          m_retainedMutex;
+    QVector<QVector<PluginInterface *> > m_workerPlugins; // plugin instances of each indexer worker (same order as m_plugins)
+    QVector<WatchPredicate>         m_scriptPredicates; // what each plugin's script may retain (same order as m_plugins), made with the worker plugins
+    QVector<PluginStats>            m_pluginStats;  // same order as m_plugins
+    QVector<int>                    m_pluginOrder;  // the indexes of m_plugins, cheapest expected cost first
+    int                             m_numChecks;    // plugin checks since the last reordering
+    QMutex                          m_statsMutex;   // guards the stats and order, updated by the indexer workers
+    static QSemaphore               m_pluginsSem;   // plugin instances may share their library's state, serialize their creation/deletion
     static ServerDatabase           m_db;
 
     inline void setParent(Filter *parentP) {
         m_parentP = parentP;
     }
 
-    void checkNewFile(QString path);
-    void checkModifiedFile(QString path);
-    void checkDeletedFile(QString path);
-
-    bool checkAndSaveFile(QString path);
+    bool checkFile(AttributeRecord *recordP, int worker, IndexAttributes *attributesP);
+    static IndexAttributes extractAttributes(PluginInterface *pluginP, AttributeRecord *recordP, bool apply);
+    static bool isHandled(PluginInterface *pluginP, AttributeRecord *recordP);
+    static IndexAttributes nullAttributes(PluginInterface *pluginP, const QSet<QString> &extractedNames);
+    QVector<WatchPredicate> getScriptPredicates();
+    QVector<int> getPluginOrder();
+    void addPluginStats(const QVector<PluginStats> &checks);
+    void reorderPlugins();
+    void reevaluateStored();
+    void reevaluateFiles(const QStringList &paths, const QHash<QString, IndexAttributes> &stored, const QHash<QString, IndexAttributes> &own);
+    void saveMissingAttributes(const QString &path, const IndexAttributes &saved, const IndexAttributes &attributes);
+    void saveChangedAttributes(const QString &path, const IndexAttributes &saved, const IndexAttributes &attributes);
+    void dropSubdirectoryFiles();
+    bool recheckFile(const QString &path, const IndexAttributes &stored, const IndexAttributes &own, IndexAttributes *attributesP);
+    static QVariant toAttributeValue(const QString &value, const QString &className);
+    void saveFile(QString path, const IndexAttributes &attributes);
+    void dropFile(QString path);
+    void moveFile(QString oldPath, QString path);
+    static void setPathAttributes(const QString &path, IndexAttributes *attributesP);
+    bool entersDirectory(const QString &oldPath, const QString &path);
+
+    void lockTree();
+    void unlockTree();
 
     void deleteChildren();
+    void deleteDescendants(QVector<Filter *> *filtersP);
+    void cleanupFiles();
+
+    QVector<PluginInterface *> getWorkerPlugins(int worker);
+    void deleteWorkerPlugins();
 
     void loadPlugin(QString pluginName);
     void unloadPlugin(QString pluginFilename);
@@ -0,0 +1,294 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#include <QDir>
+
+#include "globset.h"
+
+/**
+  * Constructs an empty set, leaving nothing out.
+  */
+GlobSet::GlobSet() {
+    m_hasIncludes = false;
+    m_hasExcludes = false;
+}
+
+/**
+  * Compiles the globs, each one prefixed by GLOB_INCLUDE or GLOB_EXCLUDE (the default if there's
+  * no prefix). The empty and duplicate globs are ignored.
+  */
+GlobSet::GlobSet(const QStringList &globs) {
+    m_hasIncludes = false;
+    m_hasExcludes = false;
+
+    for (int i = 0; i < globs.count(); i++) {
+        QString pattern = globs[i];
+        bool    include = pattern.startsWith(GLOB_INCLUDE);
+
+        if (include || pattern.startsWith(GLOB_EXCLUDE))
+            pattern = pattern.mid(1);
+
+        if (pattern.isEmpty())
+            continue;
+
+        QString glob = QString(QChar(include ? GLOB_INCLUDE : GLOB_EXCLUDE)) + pattern;
+        if (m_globs.contains(glob))
+            continue;
+
+        m_globs.append(glob);
+        compile(pattern, include);
+
+        if (include)
+            m_hasIncludes = true;
+        else
+            m_hasExcludes = true;
+    }
+}
+
+/**
+  * Returns the globs leaving out what both sets leave out: their common exclude globs, and the
+  * include globs of both if both have some.
+  */
+GlobSet GlobSet::common(const GlobSet &globs1, const GlobSet &globs2) {
+    QStringList globs;
+
+    for (int i = 0; i < globs1.m_globs.count(); i++)
+        if (globs1.m_globs[i].startsWith(GLOB_EXCLUDE) && globs2.m_globs.contains(globs1.m_globs[i]))
+            globs.append(globs1.m_globs[i]);
+
+    if (globs1.m_hasIncludes && globs2.m_hasIncludes) {
+        QStringList includes = globs1.m_globs + globs2.m_globs;
+        for (int i = 0; i < includes.count(); i++)
+            if (includes[i].startsWith(GLOB_INCLUDE))
+                globs.append(includes[i]);
+    }
+
+    return GlobSet(globs);
+}
+
+/**
+  * Returns true if the directory's name matches an exclude glob, and it isn't kept.
+  */
+bool GlobSet::excludesDirectory(const QString &path) const {
+    return excludesName(name(path), true) && !isKept(path);
+}
+
+/**
+  * Returns true if the file's name matches an exclude glob, or none of the include globs.
+  */
+bool GlobSet::excludesFile(const QString &path) const {
+    return excludesName(name(path), false);
+}
+
+/**
+  * Returns true if the file is left out, or one of the directories leading to it from the given
+  * one (which isn't matched). A file out of the directory isn't left out.
+  */
+bool GlobSet::excludesPath(const QString &directory, const QString &path) const {
+    if (m_globs.isEmpty() || path.length() <= directory.length() || !path.startsWith(directory))
+        return false;
+
+    QStringList names = path.mid(directory.length()).split(QDir::separator(), QString::SkipEmptyParts);
+    for (int i = 0; i < names.count(); i++)
+        if (excludesName(names[i], i < names.count() - 1))
+            return true;
+
+    return false;
+}
+
+/**
+  * Returns true if an entry of that name is left out.
+  */
+bool GlobSet::excludesName(const QString &name, bool directory) const {
+    if (directory && !m_hasExcludes)
+        return false;
+
+    if (m_globs.isEmpty())
+        return false;
+
+    int matched = match(name);
+
+    if (matched & MatchExclude)
+        return true;
+
+    return !directory && m_hasIncludes && !(matched & MatchInclude);
+}
+
+/**
+  * Returns true if the directory is one of the kept ones, or above one of them.
+  */
+bool GlobSet::isKept(const QString &directory) const {
+    for (int i = 0; i < m_keptDirectories.count(); i++) {
+        const QString &kept = m_keptDirectories[i];
+
+        if (kept == directory)
+            return true;
+
+        if (kept.length() > directory.length() && kept.startsWith(directory) && (directory.endsWith(QDir::separator()) || kept[directory.length()] == QDir::separator()))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+  * Appends the states of a glob to the automaton, ended by its Include or Exclude state. An
+  * unterminated class is taken literally.
+  */
+void GlobSet::compile(const QString &pattern, bool include) {
+    m_starts.append(m_elements.count());
+
+    for (int i = 0; i < pattern.length(); i++) {
+        QChar character = pattern[i];
+
+        if (character == '*') {
+            // "**" is the same as "*"
+            if (m_elements.count() == m_starts.last() || m_elements.last().m_type != Element::AnyString)
+                m_elements.append(Element(Element::AnyString));
+        } else if (character == '?')
+            m_elements.append(Element(Element::AnyCharacter));
+        else if (character == '\\' && i + 1 < pattern.length())
+            m_elements.append(Element(Element::Literal, pattern[++i]));
+        else if (character == '[') {
+            Element element(Element::Class);
+            int     j = i + 1;
+
+            if (j < pattern.length() && (pattern[j] == '!' || pattern[j] == '^')) {
+                element.m_negated = true;
+                j++;
+            }
+
+            // a ']' first is a member
+            bool first = true;
+            while (j < pattern.length() && (first || pattern[j] != ']')) {
+                QChar last = pattern[j];
+
+                if (j + 2 < pattern.length() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+                    last = pattern[j + 2];
+                    element.m_ranges.append(pattern[j]);
+                    j += 3;
+                } else {
+                    element.m_ranges.append(pattern[j]);
+                    j++;
+                }
+
+                element.m_ranges.append(last);
+                first = false;
+            }
+
+            if (j < pattern.length()) {
+                m_elements.append(element);
+                i = j;
+            } else
+                m_elements.append(Element(Element::Literal, character));
+        } else
+            m_elements.append(Element(Element::Literal, character));
+    }
+
+    m_elements.append(Element(include ? Element::Include : Element::Exclude));
+}
+
+/**
+  * Runs the automaton over the name, all the globs at once: the states reached are tracked
+  * character after character, none of them is visited twice per character. Returns the
+  * MatchInclude and MatchExclude flags of the globs matching the whole name.
+  */
+int GlobSet::match(const QString &name) const {
+    QVector<int>    states;
+    QVector<int>    nextStates;
+    QVector<int>    marks(m_elements.count(), -1);  // the step each state was last reached at
+    int             matched = 0;
+
+    for (int i = 0; i < m_starts.count(); i++)
+        addState(m_starts[i], 0, &states, &marks);
+
+    for (int i = 0; i < name.length() && !states.isEmpty(); i++) {
+        nextStates.clear();
+
+        for (int j = 0; j < states.count(); j++) {
+            const Element &element = m_elements[states[j]];
+
+            if (element.m_type == Element::AnyString)
+                addState(states[j], i + 1, &nextStates, &marks);
+            else if (element.m_type != Element::Include && element.m_type != Element::Exclude && element.matches(name[i]))
+                addState(states[j] + 1, i + 1, &nextStates, &marks);
+        }
+
+        states = nextStates;
+    }
+
+    for (int i = 0; i < states.count(); i++) {
+        if (m_elements[states[i]].m_type == Element::Include)
+            matched |= MatchInclude;
+        else if (m_elements[states[i]].m_type == Element::Exclude)
+            matched |= MatchExclude;
+    }
+
+    return matched;
+}
+
+/**
+  * Adds a state reached at the given step, and the ones following the '*' it may skip.
+  */
+void GlobSet::addState(int state, int step, QVector<int> *statesP, QVector<int> *marksP) const {
+    while ((*marksP)[state] != step) {
+        (*marksP)[state] = step;
+        statesP->append(state);
+
+        if (m_elements[state].m_type != Element::AnyString)
+            break;
+
+        state++;
+    }
+}
+
+/**
+  * Returns true if the state takes the character.
+  */
+bool GlobSet::Element::matches(QChar character) const {
+    switch (m_type) {
+    case Literal:
+        return character == m_character;
+
+    case AnyCharacter:
+        return true;
+
+    case Class:
+        for (int i = 0; i + 1 < m_ranges.length(); i += 2)
+            if (character >= m_ranges[i] && character <= m_ranges[i + 1])
+                return !m_negated;
+
+        return m_negated;
+
+    default:
+        return false;
+    }
+}
+
+/**
+  * Returns the last segment of the path.
+  */
+QString GlobSet::name(const QString &path) {
+    int index = path.lastIndexOf(QDir::separator());
+
+    return index == -1 ? path : path.mid(index + 1);
+}
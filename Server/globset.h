@@ -0,0 +1,129 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#ifndef GLOBSET_H
+#define GLOBSET_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#define GLOB_INCLUDE    '+'     // prefix of the globs of the file names to keep
+#define GLOB_EXCLUDE    '-'     // prefix of the globs of the file and directory names to leave out (the default)
+
+/**
+  * A filter's include/exclude globs, matched against the names of the entries below its
+  * directory, one path segment at a time: an entry whose name matches an exclude glob is left
+  * out (a directory isn't listed at all), and if there are include globs, a file whose name
+  * matches none of them is left out. The directory itself isn't matched.
+  *
+  * A glob is made of '*' (any string), '?' (any character), '[...]' (a character among, or not
+  * among with '!' or '^', ranges allowed), '\' (escapes the next character) and literals. The
+  * globs are case sensitive, as the file names are. All of them are compiled into a single
+  * automaton, simulated once over a name whatever the number of globs.
+  *
+  * The directories kept (setKeptDirectories), and the ones above them, are never left out: a
+  * watcher uses it for the directories of its subscriptions, walked from further up.
+  */
+class GlobSet {
+public:
+    GlobSet();
+    explicit GlobSet(const QStringList &globs);
+
+    static GlobSet common(const GlobSet &globs1, const GlobSet &globs2);
+
+    bool excludesDirectory(const QString &path) const;
+    bool excludesFile(const QString &path) const;
+    bool excludesPath(const QString &directory, const QString &path) const;
+
+    inline bool isEmpty() const {
+        return m_globs.isEmpty();
+    }
+
+    // as given, each one prefixed by GLOB_INCLUDE or GLOB_EXCLUDE
+    inline QStringList getGlobs() const {
+        return m_globs;
+    }
+
+    inline void setKeptDirectories(const QStringList &directories) {
+        m_keptDirectories = directories;
+    }
+
+    inline bool operator==(const GlobSet &globs) const {
+        return m_globs == globs.m_globs;
+    }
+
+    inline bool operator!=(const GlobSet &globs) const {
+        return !(*this == globs);
+    }
+
+private:
+    /**
+      * A state of the automaton: matches a character and goes to the next state, or ends a glob.
+      */
+    class Element {
+    public:
+        enum Type {
+            Literal,
+            AnyCharacter,   // ?
+            AnyString,      // *, loops on itself, and goes to the next state without matching
+            Class,          // [...]
+            Include,        // end of an include glob
+            Exclude         // end of an exclude glob
+        };
+
+        explicit Element(Type type = Literal, QChar character = QChar()) {
+            m_type = type;
+            m_character = character;
+            m_negated = false;
+        }
+
+        bool matches(QChar character) const;
+
+        Type    m_type;
+        QChar   m_character;    // Literal
+        QString m_ranges;       // Class: pairs of characters, first and last of each range
+        bool    m_negated;      // Class
+    };
+
+    enum Match {
+        MatchInclude = 1,
+        MatchExclude = 2
+    };
+
+    QStringList         m_globs;
+    QVector<Element>    m_elements;     // all the globs, one after the other
+    QVector<int>        m_starts;       // the first element of each glob
+    bool                m_hasIncludes;
+    bool                m_hasExcludes;
+    QStringList         m_keptDirectories;
+
+    void compile(const QString &pattern, bool include);
+    int match(const QString &name) const;
+    void addState(int state, int step, QVector<int> *statesP, QVector<int> *marksP) const;
+    bool excludesName(const QString &name, bool directory) const;
+    bool isKept(const QString &directory) const;
+
+    static QString name(const QString &path);
+};
+
+#endif // GLOBSET_H
@@ -0,0 +1,505 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#include <QHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+
+#include "indexer.h"
+#include "filter.h"
+#include "qdirext.h"
+#include "iothrottle.h"
+
+/**
+  * Returns the (lower case) suffix of the file, nothing is read.
+  */
+QString AttributeRecord::getSuffix() {
+    if (m_suffix.isNull())
+        m_suffix = QFileInfo(m_path).suffix().toLower();
+
+    return m_suffix;
+}
+
+/**
+  * Returns the first bytes of the file, read the first time only.
+  */
+QByteArray AttributeRecord::getHead() {
+    if (m_headRead)
+        return m_head;
+
+    m_headRead = true;
+
+    QFile file(m_path);
+    IoThrottle::account(0, 1);
+    if (file.open(QIODevice::ReadOnly)) {
+        m_head = file.read(INDEXER_SIGNATURE_SIZE);
+        IoThrottle::account(m_head.size());
+    }
+
+    return m_head;
+}
+
+void IndexerThread::run() {
+    m_indexerP->work(m_worker);
+}
+
+/**
+  * Creates the queues and starts the coalescing thread, the evaluation workers (one per core)
+  * and the persist thread.
+  */
+Indexer::Indexer(Filter *rootP) : m_persistQueue(INDEXER_PERSIST_QUEUE_SIZE) {
+    m_rootP = rootP;
+    m_numPending = 0;
+    m_stopping = false;
+
+    int numWorkers = QThread::idealThreadCount();
+    if (numWorkers < 1)
+        numWorkers = 1;
+
+    for (int i = 0; i < numWorkers; i++) {
+        m_evaluationQueues.append(new IndexQueue<IndexEvent>(INDEXER_EVALUATION_QUEUE_SIZE));
+        m_threads.append(new IndexerThread(this, i));
+    }
+    m_threads.append(new IndexerThread(this, INDEXER_PERSIST_WORKER));
+    m_threads.append(new IndexerThread(this, INDEXER_COALESCE_WORKER));
+
+#ifdef _VERBOSE_INDEXER
+    qDebug() << "Indexer for " << rootP->getVirtualDirectoryPath() << " starts " << numWorkers << " evaluation workers";
+#endif
+
+    for (int i = 0; i < m_threads.count(); i++)
+        m_threads[i]->start();
+}
+
+/**
+  * Stops the pipeline. The settling and pending events and the pending operations are dropped,
+  * the current ones are completed.
+  */
+Indexer::~Indexer() {
+    m_settlingMutex.lock();
+    m_stopping = true;
+    m_settling.clear();
+    m_settlingWakeUp.wakeAll();
+    m_settlingMutex.unlock();
+
+    for (int i = 0; i < m_evaluationQueues.count(); i++)
+        m_evaluationQueues[i]->close();
+    m_persistQueue.close();
+
+    for (int i = 0; i < m_threads.count(); i++)
+        m_threads[i]->wait();
+
+    qDeleteAll(m_threads);
+    m_threads.clear();
+
+    qDeleteAll(m_evaluationQueues);
+    m_evaluationQueues.clear();
+}
+
+/**
+  * Unblocks the threads posting to a full worker's queue, so the watcher can be stopped. Their
+  * events are queued over capacity.
+  */
+void Indexer::interruptPosts() {
+    for (int i = 0; i < m_evaluationQueues.count(); i++)
+        m_evaluationQueues[i]->interrupt();
+}
+
+/**
+  * Called by the watcher thread. The changes are held by the coalescing stage until the file
+  * settles.
+  */
+void Indexer::fileAdded(const QString &path) {
+    settle(IndexEvent::Added, path);
+}
+
+void Indexer::fileModified(const QString &path) {
+    settle(IndexEvent::Modified, path);
+}
+
+void Indexer::fileDeleted(const QString &path) {
+    settle(IndexEvent::Deleted, path);
+}
+
+/**
+  * A move is handled by the worker in charge of the old path, after the events raised on it. The
+  * events raised on the new path may be handled first, the db rename then yields to them.
+  *
+  * The changes settling on either path are handed over first, so the move applies to what they
+  * left in the db. A file added (and never handed over) is simply added under its new path, and
+  * a file being modified keeps settling under its new path. Blocks while the worker's queue is
+  * full.
+  */
+void Indexer::fileMoved(const QString &oldPath, const QString &path) {
+    QList<IndexEvent>   events;
+    bool                moveModified = false;
+
+    m_settlingMutex.lock();
+
+    QHash<QString, SettlingEvent>::iterator i = m_settling.find(oldPath);
+    if (i != m_settling.end() && i->m_type == IndexEvent::Added) {
+        // not in the db yet, nothing to rename
+        m_settling.erase(i);
+        addPending(-1);
+        mergeSettling(IndexEvent::Added, path);
+        m_settlingMutex.unlock();
+        return;
+    }
+
+    if (i != m_settling.end()) {
+        if (i->m_type == IndexEvent::Modified) {
+            m_settling.erase(i);
+            addPending(-1);
+            moveModified = true;
+        } else {
+            events.append(IndexEvent(i->m_type, oldPath));
+            m_settling.erase(i);
+        }
+    }
+
+    i = m_settling.find(path);
+    if (i != m_settling.end()) {
+        events.append(IndexEvent(i->m_type, path));
+        m_settling.erase(i);
+    }
+
+    m_settlingMutex.unlock();
+
+    for (int j = 0; j < events.count(); j++)
+        handOver(events[j], events[j].m_path);
+
+    post(IndexEvent(IndexEvent::Moved, path, oldPath), oldPath);
+
+    if (moveModified)
+        settle(IndexEvent::Modified, path);
+}
+
+/**
+  * Merges a file change with the ones settling on the file. If the coalescing stage is full and
+  * nothing settles on the file, the change is posted right away (blocking while the worker's
+  * queue is full).
+  */
+void Indexer::settle(IndexEvent::Type type, const QString &path) {
+    m_settlingMutex.lock();
+
+    if (m_stopping) {
+        m_settlingMutex.unlock();
+        return;
+    }
+
+    if (m_settling.count() < INDEXER_MAX_SETTLING || m_settling.contains(path)) {
+        mergeSettling(type, path);
+        m_settlingMutex.unlock();
+        return;
+    }
+
+    m_settlingMutex.unlock();
+
+    post(IndexEvent(type, path), path);
+}
+
+/**
+  * Merges a file change with the ones settling on the file, called with the settling mutex
+  * held. A settling file is counted as pending, so waitForIdle can't miss it:
+  *
+  *     added then modified            -> added
+  *     added then deleted             -> nothing, the file never made it to the db
+  *     modified then deleted          -> deleted
+  *     deleted then added/modified    -> modified, the file was replaced
+  */
+void Indexer::mergeSettling(IndexEvent::Type type, const QString &path) {
+    QHash<QString, SettlingEvent>::iterator i = m_settling.find(path);
+
+    if (i == m_settling.end()) {
+        m_settling.insert(path, SettlingEvent(type));
+        addPending(1);
+        return;
+    }
+
+    switch (i->m_type) {
+        case IndexEvent::Added:
+            if (type == IndexEvent::Deleted) {
+#ifdef _VERBOSE_INDEXER
+                qDebug() << "Coalescing drops " << path << ", deleted before it settled";
+#endif
+                m_settling.erase(i);
+                addPending(-1);
+                return;
+            }
+            break;
+
+        case IndexEvent::Modified:
+            if (type == IndexEvent::Deleted)
+                i->m_type = IndexEvent::Deleted;
+            break;
+
+        default:
+            if (type != IndexEvent::Deleted)
+                i->m_type = IndexEvent::Modified;
+            break;
+    }
+
+    // changed again, its stability is to be checked again
+    i->m_last = QDateTime::currentDateTime();
+    i->m_hasStat = false;
+    ++i->m_sequence;
+}
+
+/**
+  * Takes the changes of the files which settled: a deleted file once it wasn't reported for
+  * INDEXER_SETTLE_TIME, an added or modified one once, in addition, its size and mtime didn't
+  * change over two checks. A file still changing after INDEXER_MAX_SETTLE_TIME is taken anyway.
+  */
+QList<IndexEvent> Indexer::takeSettled() {
+    QList<IndexEvent>           events;
+    QList<QPair<QString, int> > candidates; // the files to check, and the change they were at
+    QDateTime                   now = QDateTime::currentDateTime();
+
+    m_settlingMutex.lock();
+
+    for (QHash<QString, SettlingEvent>::iterator i = m_settling.begin(); i != m_settling.end();) {
+        if (i->m_last.addMSecs(INDEXER_SETTLE_TIME) > now) {
+            i++;
+            continue;
+        }
+
+        if (i->m_type == IndexEvent::Deleted || i->m_first.addMSecs(INDEXER_MAX_SETTLE_TIME) <= now) {
+            events.append(IndexEvent(i->m_type, i.key()));
+            i = m_settling.erase(i);
+            continue;
+        }
+
+        candidates.append(QPair<QString, int>(i.key(), i->m_sequence));
+        i++;
+    }
+
+    m_settlingMutex.unlock();
+
+    // checked without the mutex, the watcher keeps reporting meanwhile
+    QList<QDirExtEntry> entries;
+    for (int i = 0; i < candidates.count(); i++) {
+        QDirExtEntry entry;
+
+        IoThrottle::account(0, 1);
+        if (!QDirExt::readEntry(candidates[i].first, &entry))
+            entry.m_hasStat = false;
+        entries.append(entry);
+    }
+
+    m_settlingMutex.lock();
+
+    for (int j = 0; j < candidates.count(); j++) {
+        QHash<QString, SettlingEvent>::iterator i = m_settling.find(candidates[j].first);
+
+        // reported again meanwhile?
+        if (i == m_settling.end() || i->m_sequence != candidates[j].second)
+            continue;
+
+        // gone, the watcher will report the deletion
+        const QDirExtEntry &entry = entries[j];
+        if (!entry.m_hasStat)
+            continue;
+
+        if (i->m_hasStat && i->m_size == entry.m_size && i->m_lastModified == entry.m_lastModified) {
+            events.append(IndexEvent(i->m_type, i.key()));
+            m_settling.erase(i);
+            continue;
+        }
+
+        i->m_hasStat = true;
+        i->m_size = entry.m_size;
+        i->m_lastModified = entry.m_lastModified;
+    }
+
+    m_settlingMutex.unlock();
+
+    return events;
+}
+
+/**
+  * Hands all the settling changes over to the evaluation workers.
+  */
+void Indexer::flushSettling() {
+    QList<IndexEvent> events;
+
+    m_settlingMutex.lock();
+    for (QHash<QString, SettlingEvent>::const_iterator i = m_settling.constBegin(); i != m_settling.constEnd(); i++)
+        events.append(IndexEvent(i->m_type, i.key()));
+    m_settling.clear();
+    m_settlingMutex.unlock();
+
+    for (int i = 0; i < events.count(); i++)
+        handOver(events[i], events[i].m_path);
+}
+
+/**
+  * Queues the event to the worker in charge of the (routing) path, so the events of a file are
+  * handled in the order they were raised.
+  */
+void Indexer::post(const IndexEvent &event, const QString &routingPath) {
+    addPending(1);
+    handOver(event, routingPath);
+}
+
+/**
+  * Same as post, for an event already counted as pending (it was settling). Blocks while the
+  * worker's queue is full, which slows the watcher down to the indexing pace.
+  */
+void Indexer::handOver(const IndexEvent &event, const QString &routingPath) {
+    int worker = qHash(routingPath) % m_evaluationQueues.count();
+
+    if (!m_evaluationQueues[worker]->put(event))
+        addPending(-1);
+}
+
+void Indexer::addPending(int delta) {
+    QMutexLocker locker(&m_pendingMutex);
+
+    m_numPending += delta;
+    if (!m_numPending)
+        m_idle.wakeAll();
+}
+
+/**
+  * Blocks until the events posted so far were evaluated and their operations applied. The
+  * settling changes are handed over right away. The watcher must be stopped, or this may never
+  * return.
+  */
+void Indexer::waitForIdle() {
+    flushSettling();
+
+    QMutexLocker locker(&m_pendingMutex);
+
+    while (m_numPending)
+        m_idle.wait(&m_pendingMutex);
+}
+
+void Indexer::work(int worker) {
+    // the plugins' reads and the stats are throttled by the root's limits
+    IoThrottle::setCurrent(m_rootP->getIoThrottle());
+
+    if (worker == INDEXER_PERSIST_WORKER)
+        persist();
+    else if (worker == INDEXER_COALESCE_WORKER)
+        coalesce();
+    else
+        evaluate(worker);
+}
+
+/**
+  * Coalescing thread loop: hands the changes of the files which settled over to the evaluation
+  * workers, every half INDEXER_SETTLE_TIME.
+  */
+void Indexer::coalesce() {
+    for (;;) {
+        m_settlingMutex.lock();
+        if (!m_stopping)
+            m_settlingWakeUp.wait(&m_settlingMutex, INDEXER_SETTLE_TIME / 2);
+        bool stopping = m_stopping;
+        m_settlingMutex.unlock();
+
+        if (stopping)
+            return;
+
+        QList<IndexEvent> events = takeSettled();
+
+#ifdef _VERBOSE_INDEXER
+        if (events.count())
+            qDebug() << "Coalescing hands over " << events.count() << " settled files";
+#endif
+
+        for (int i = 0; i < events.count(); i++)
+            handOver(events[i], events[i].m_path);
+    }
+}
+
+/**
+  * Evaluation worker loop: matches the files against the filter tree and passes the resulting
+  * db operations over to the persist thread. The tree lock isn't held while waiting for room
+  * in the persist queue, the persist thread needs it to make progress.
+  */
+void Indexer::evaluate(int worker) {
+    IndexQueue<IndexEvent>  *queueP = m_evaluationQueues[worker];
+    IndexEvent              event;
+
+    while (queueP->take(&event)) {
+        QList<IndexOperation> operations;
+
+        // the plugins' reads are waited for once the tree is unlocked, not to hold its writers
+        IoThrottle::defer();
+        m_treeLock.lockForRead();
+
+#ifdef _VERBOSE_INDEXER
+        qDebug() << "Worker " << worker << " evaluates " << event.m_path;
+#endif
+
+        if (event.m_type == IndexEvent::Deleted)
+            operations.append(IndexOperation(IndexOperation::Drop, m_rootP->getFilterId(), m_rootP->getGeneration(), event.m_path));
+        else if (event.m_type == IndexEvent::Moved)
+            m_rootP->evaluateMove(event.m_oldPath, event.m_path, worker, &operations);
+        else {
+            AttributeRecord record(event.m_path);
+            m_rootP->evaluateFile(&record, worker, &operations);
+        }
+
+        m_treeLock.unlock();
+        IoThrottle::settle();
+
+        // the operations are pending before the event completes, so the count can't drop to 0 meanwhile
+        addPending(operations.count() - 1);
+
+        for (int i = 0; i < operations.count(); i++)
+            if (!m_persistQueue.put(operations[i]))
+                return; // stopping
+    }
+}
+
+/**
+  * Persist thread loop: applies the operations to the db, one at a time. The operations whose
+  * filter was removed or cleaned up since they were evaluated are dropped.
+  */
+void Indexer::persist() {
+    IndexOperation operation;
+
+    while (m_persistQueue.waitForItem()) {
+        // take the operation under the tree lock, so it can't be applied to a filter being
+        // cleaned up or removed
+        m_treeLock.lockForRead();
+
+        bool taken = m_persistQueue.tryTake(&operation);
+        if (taken) {
+            Filter *filterP = m_rootP->findFilter(operation.m_filterId);
+            if (filterP && filterP->getGeneration() == operation.m_generation)
+                filterP->persistOperation(operation);
+#ifdef _VERBOSE_INDEXER
+            else
+                qDebug() << "Dropping stale operation on " << operation.m_path;
+#endif
+        }
+
+        m_treeLock.unlock();
+
+        if (taken)
+            addPending(-1);
+    }
+}
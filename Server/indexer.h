@@ -0,0 +1,358 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#ifndef INDEXER_H
+#define INDEXER_H
+
+#include <QThread>
+#include <QQueue>
+#include <QVector>
+#include <QList>
+#include <QPair>
+#include <QHash>
+#include <QString>
+#include <QVariant>
+#include <QByteArray>
+#include <QDateTime>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QReadWriteLock>
+
+//#define _VERBOSE_INDEXER 1
+
+#define INDEXER_EVALUATION_QUEUE_SIZE   256     // max pending file events per evaluation worker
+#define INDEXER_PERSIST_QUEUE_SIZE      1024    // max pending db operations
+#define INDEXER_PERSIST_WORKER          -1      // worker index of the persist thread
+#define INDEXER_COALESCE_WORKER         -2      // worker index of the coalescing thread
+#define INDEXER_SETTLE_TIME             1000    // millisecs without change before a file is handed over (once its size and mtime are stable)
+#define INDEXER_MAX_SETTLE_TIME         60000   // millisecs, a file changing for longer is handed over anyway
+#define INDEXER_MAX_SETTLING            4096    // max files held by the coalescing stage, the others go straight through
+#define INDEXER_SIGNATURE_SIZE          64      // bytes read to match the plugins' signatures
+
+/**
+  * A bounded FIFO shared by two pipeline stages. put blocks while the queue is full, take
+  * blocks while it's empty. Once closed, put and take return false and the items are dropped.
+  */
+template <class T> class IndexQueue {
+public:
+    explicit IndexQueue(int capacity) {
+        m_capacity = capacity;
+        m_closed = false;
+        m_interrupts = 0;
+    }
+
+    // blocks while the queue is full, unless interrupted meanwhile: the item then goes over capacity
+    bool put(const T &item) {
+        QMutexLocker locker(&m_mutex);
+
+        int interrupts = m_interrupts;
+        while (!m_closed && m_items.count() >= m_capacity && interrupts == m_interrupts)
+            m_notFull.wait(&m_mutex);
+
+        if (m_closed)
+            return false;
+
+        m_items.enqueue(item);
+        m_notEmpty.wakeOne();
+
+        return true;
+    }
+
+    bool take(T *itemP) {
+        QMutexLocker locker(&m_mutex);
+
+        while (!m_closed && m_items.isEmpty())
+            m_notEmpty.wait(&m_mutex);
+
+        if (m_closed)
+            return false;
+
+        *itemP = m_items.dequeue();
+        m_notFull.wakeOne();
+
+        return true;
+    }
+
+    bool tryTake(T *itemP) {
+        QMutexLocker locker(&m_mutex);
+
+        if (m_closed || m_items.isEmpty())
+            return false;
+
+        *itemP = m_items.dequeue();
+        m_notFull.wakeOne();
+
+        return true;
+    }
+
+    // blocks until an item is available, returns false if the queue was closed
+    bool waitForItem() {
+        QMutexLocker locker(&m_mutex);
+
+        while (!m_closed && m_items.isEmpty())
+            m_notEmpty.wait(&m_mutex);
+
+        return !m_closed;
+    }
+
+    void close() {
+        QMutexLocker locker(&m_mutex);
+
+        m_closed = true;
+        m_items.clear();
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+
+    // wakes the puts blocked on the full queue, nothing is dropped
+    void interrupt() {
+        QMutexLocker locker(&m_mutex);
+
+        ++m_interrupts;
+        m_notFull.wakeAll();
+    }
+
+    int count() {
+        QMutexLocker locker(&m_mutex);
+        return m_items.count();
+    }
+
+private:
+    QQueue<T>       m_items;
+    int             m_capacity;
+    bool            m_closed;
+    int             m_interrupts;   // the times the blocked puts were interrupted
+    QMutex          m_mutex;
+    QWaitCondition  m_notEmpty;
+    QWaitCondition  m_notFull;
+};
+
+/**
+  * A file change reported by the watcher (stat stage).
+  */
+class IndexEvent {
+public:
+    enum Type {
+        Added,
+        Modified,
+        Deleted,
+        Moved
+    };
+
+    IndexEvent(Type type = Added, QString path = "", QString oldPath = "") {
+        m_type = type;
+        m_path = path;
+        m_oldPath = oldPath;
+    }
+
+    Type    m_type;
+    QString m_path;
+    QString m_oldPath;  // where a moved file was
+};
+
+/**
+  * A file change held by the coalescing stage until the file settles. The changes of the file
+  * reported meanwhile are merged into it.
+  */
+class SettlingEvent {
+public:
+    explicit SettlingEvent(IndexEvent::Type type = IndexEvent::Added) {
+        m_type = type;
+        m_first = QDateTime::currentDateTime();
+        m_last = m_first;
+        m_sequence = 0;
+        m_hasStat = false;
+        m_size = 0;
+    }
+
+    IndexEvent::Type    m_type;         // Added, Modified or Deleted
+    QDateTime           m_first;        // first change reported
+    QDateTime           m_last;         // last change reported
+    int                 m_sequence;     // changes merged so far
+    bool                m_hasStat;      // the file was checked, and looked like this
+    qint64              m_size;
+    QDateTime           m_lastModified;
+};
+
+typedef QList<QPair<QString, QString> > IndexAttributes; // attribute name/value pairs
+
+/**
+  * The attributes of the file an event is about, shared by the whole filter tree while the
+  * event is evaluated. They are extracted once per plugin type (by plugin name), by the first
+  * filter using it: the other filters run their rules against the recorded values instead of
+  * loading them again (see Filter::extractAttributes). A recorded extraction isn't modified.
+  * The file's suffix and first bytes, matched against the plugins' manifests, are read once too.
+  */
+class AttributeRecord {
+public:
+    explicit AttributeRecord(QString path = "") {
+        m_path = path;
+        m_headRead = false;
+    }
+
+    QString     getSuffix();
+    QByteArray  getHead();
+
+    class Extraction {
+    public:
+        QList<QPair<QString, QVariant> >    m_values;       // as loaded by the plugin
+        IndexAttributes                     m_attributes;   // as saved in the db
+    };
+
+    QString                     m_path;
+    QHash<QString, Extraction>  m_extractions;  // by plugin name
+
+private:
+    QString                     m_suffix;
+    QByteArray                  m_head;         // the first INDEXER_SIGNATURE_SIZE bytes
+    bool                        m_headRead;
+};
+
+/**
+  * A db update decided by the evaluation stage for one filter. The filter is referred to by
+  * id, and the operation is dropped if the filter was removed or cleaned up meanwhile (its
+  * generation changed).
+  */
+class IndexOperation {
+public:
+    enum Type {
+        Retain,     // save the file and its attributes
+        Drop,       // remove the file (and from the children filters) if it was retained
+        Move        // rename the file if it was retained, keeping its attributes
+    };
+
+    IndexOperation(Type type = Drop, QString filterId = "", int generation = 0, QString path = "", IndexAttributes attributes = IndexAttributes(), QString oldPath = "") {
+        m_type = type;
+        m_filterId = filterId;
+        m_generation = generation;
+        m_path = path;
+        m_attributes = attributes;
+        m_oldPath = oldPath;
+    }
+
+    Type            m_type;
+    QString         m_filterId;
+    int             m_generation;
+    QString         m_path;
+    IndexAttributes m_attributes;
+    QString         m_oldPath;      // Move only
+};
+
+class Filter;
+class Indexer;
+
+class IndexerThread : public QThread {
+    Q_OBJECT
+
+public:
+    explicit IndexerThread(Indexer *indexerP, int worker) : QThread() {
+        m_indexerP = indexerP;
+        m_worker = worker;
+    }
+
+protected:
+    void run();
+
+private:
+    Indexer *m_indexerP;
+    int     m_worker;       // evaluation worker index, or INDEXER_PERSIST_WORKER/INDEXER_COALESCE_WORKER
+};
+
+/**
+  * The indexer runs the filter tree of a root filter out of the server (GUI) thread. It is
+  * fed by the watcher thread (the stat stage), and is made of:
+  *
+  *     - a coalescing thread, holding the file changes until the files settle: nothing was
+  *       reported on a file for INDEXER_SETTLE_TIME, and its size and mtime didn't change over a
+  *       check. The changes reported meanwhile are merged (a file added then deleted is dropped),
+  *       so a file being written is extracted once, when complete. Once INDEXER_MAX_SETTLING
+  *       files are held, the changes of the others go straight to the evaluation workers, which
+  *       slows the watcher down to the indexing pace (a discovery, for instance).
+  *     - one evaluation worker per core, each with its own bounded queue and its own instances
+  *       of the filters' plugins. A worker loads the file attributes and runs the rules of the
+  *       whole filter tree (extract and evaluate stages). Events are dispatched by path so the
+  *       events of a given file are handled in order, by the same worker.
+  *     - a single persist thread, fed by a bounded queue, writing the db and signaling the
+  *       retained/dropped files.
+  *
+  * The filter tree can be modified while indexing: the workers hold the tree lock (for read)
+  * while they use it, the filter tree modifications take it for write (lockTree/unlockTree).
+  *
+  * The events and operations in the pipeline are counted, so waitForIdle can tell when
+  * everything the watcher reported made it to the db (the settling changes are handed over at once
+  * then).
+  */
+class Indexer {
+public:
+    explicit Indexer(Filter *rootP);
+    ~Indexer();
+
+    void fileAdded(const QString &path);
+    void fileModified(const QString &path);
+    void fileDeleted(const QString &path);
+    void fileMoved(const QString &oldPath, const QString &path);
+
+    void waitForIdle();
+    void interruptPosts();
+
+    inline int numWorkers() {
+        return m_evaluationQueues.count();
+    }
+
+    inline void lockTree() {
+        m_treeLock.lockForWrite();
+    }
+
+    inline void unlockTree() {
+        m_treeLock.unlock();
+    }
+
+    void work(int worker);
+
+private:
+    Filter                                  *m_rootP;
+    QReadWriteLock                          m_treeLock;
+    QVector<IndexQueue<IndexEvent> *>       m_evaluationQueues;
+    IndexQueue<IndexOperation>              m_persistQueue;
+    QList<IndexerThread *>                  m_threads;
+    int                                     m_numPending;   // events and operations not completed yet
+    QMutex                                  m_pendingMutex;
+    QWaitCondition                          m_idle;
+    QHash<QString, SettlingEvent>           m_settling;     // the changes held by the coalescing stage, by path
+    QMutex                                  m_settlingMutex;
+    QWaitCondition                          m_settlingWakeUp;
+    bool                                    m_stopping;
+
+    void settle(IndexEvent::Type type, const QString &path);
+    void mergeSettling(IndexEvent::Type type, const QString &path);
+    QList<IndexEvent> takeSettled();
+    void flushSettling();
+
+    void post(const IndexEvent &event, const QString &routingPath);
+    void handOver(const IndexEvent &event, const QString &routingPath);
+    void addPending(int delta);
+    void coalesce();
+    void evaluate(int worker);
+    void persist();
+};
+
+#endif // INDEXER_H
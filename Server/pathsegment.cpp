@@ -21,170 +21,234 @@
  */
 
 #include <QDir>
+#include <QVarLengthArray>
 #include <QDebug>
 
+#include <string.h>
+
 #include "pathsegment.h"
 
 /**
-  * Returns the full path of this PathSegment by walking recursively up to the root
-  * PathSegment.
+  * Returns in nameP the next segment name of the path, false if there's none left.
   */
-QString PathSegment::getPath(QString &path) {
-    if (!m_parentP || m_parentP->m_name.isEmpty()) {
-        path.prepend(m_name);
-        return path;
-    }
+bool PathTokenizer::next(QStringRef *nameP) {
+    int length = m_path.length();
+    int start = m_position;
 
-    path.prepend(m_name);
-    path.prepend(QDir::separator()); //  #### non local urls (<scheme>://<authority>/<path>) will be misformatted under windows, fix this
-    return m_parentP->getPath(path);
-}
+    if (start >= length)
+        return false;
 
-/**
-  * Returns the PathSegment corresponding to the given path if found
-  * else NULL. Call from root.
-  */
-PathSegment *PathSegment::findPath(QStringList path) {
-    PathSegment *segmentP = NULL;
-    QString     segmentName;
+    while (m_position < length) {
+        if (m_path.at(m_position) == QDir::separator()) {
+            // "<scheme>://", the authority belongs to the same segment
+            if (m_position > start && m_path.at(m_position - 1) == ':' &&
+                m_position + 1 < length && m_path.at(m_position + 1) == QDir::separator()) {
+                m_position += 2;
+                continue;
+            }
 
-    if (path.isEmpty())
-        return segmentP;
+            break;
+        }
+
+        m_position++;
+    }
 
-    // keep the path segment name and remove it from the path
-    segmentName = path[0];
-    path.removeFirst();
+    *nameP = QStringRef(&m_path, start, m_position - start);
+    skipSeparators();
 
-   // in the case we have a "" in the path... (split can do this)
-   if (segmentName.isEmpty())
-        return findPath(path);
+    return true;
+}
 
-    // exit if this path doesn't exist
-    segmentP = m_entries.value(segmentName);
-    if (!segmentP)
-        return segmentP;
+uint PathSegment::hash(const QChar *charsP, int length) {
+    uint h = 0;
 
-    // have we met the end of the path?
-    if (path.isEmpty())
-        return segmentP;
+    for (int i = 0; i < length; i++) {
+        h = (h << 4) + charsP[i].unicode();
+        h ^= (h & 0xf0000000) >> 23;
+        h &= 0x0fffffff;
+    }
 
-    // walk down the path
-    return segmentP->findPath(path);
+    return h;
+}
+
+inline bool PathSegment::matches(const QString &name, const QStringRef &ref) {
+    return name.length() == ref.length() && !memcmp(name.unicode(), ref.unicode(), ref.length() * sizeof(QChar));
 }
 
 /**
-  * Adds a path to this PathSegment. Call from root.
+  * Returns the child segment with the given name, NULL if none.
   */
-PathSegment *PathSegment::addPath(QStringList path, bool directory, QList<PathSegment *> *directoriesP, QList<PathSegment *> *filesP) {
-    PathSegment *segmentP = NULL;
-    QString     segmentName;
+PathSegment *PathSegment::findChild(const QStringRef &name) const {
+    if (!isHashed()) {
+        for (int i = 0; i < m_numChildren; i++)
+            if (matches(m_childrenP[i]->m_name, name))
+                return m_childrenP[i];
 
-    if (path.isEmpty())
         return NULL;
+    }
 
-    // keep the path segment name and remove it from the path
-    segmentName = path[0];
-    path.removeFirst();
-
-    // in the case we have a "" in the path... (split can do this)
-    if (segmentName.isEmpty())
-        return addPath(path, directory, directoriesP, filesP);
-
-    // check if this path segment doesn't already exist
-    segmentP = m_entries.value(segmentName);
-    if (!segmentP) {
-        // this one doesn't exist, add it
-        segmentP = new PathSegment(segmentName);
-        segmentP->m_parentP = this;
-        m_entries.insert(segmentName, segmentP);
-
-        // add it to the path list
-        if (path.isEmpty()) {
-            if (directory)
-                directoriesP->insert(0, segmentP);
-            else
-                filesP->insert(0, segmentP);
-        }
-    } else
-        // we've got one more path going through this segment
-        segmentP->m_refCount++;
+    uint mask = m_capacity - 1;
+    for (uint i = hash(name.unicode(), name.length()) & mask; m_childrenP[i]; i = (i + 1) & mask)
+        if (matches(m_childrenP[i]->m_name, name))
+            return m_childrenP[i];
+
+    return NULL;
+}
 
-    // have we met the end of the path?
-    if (path.isEmpty())
-        return segmentP;
+/**
+  * Puts a child in its slot, the table must have room for it.
+  */
+void PathSegment::place(PathSegment *childP) {
+    if (!isHashed()) {
+        m_childrenP[m_numChildren] = childP;
+        return;
+    }
 
-    // walk down the path
-    return segmentP->addPath(path, directory, directoriesP, filesP);
+    uint mask = m_capacity - 1;
+    uint i = hash(childP->m_name.unicode(), childP->m_name.length()) & mask;
+    while (m_childrenP[i])
+        i = (i + 1) & mask;
+
+    m_childrenP[i] = childP;
 }
 
 /**
-  * Deletes a path from this PathSegment. Call from root. Returns true if the path
-  * was found, false else.
+  * Moves the children in a new array or hash table of the given capacity.
   */
-bool PathSegment::deletePath(QStringList path, bool directory, QList<PathSegment *> *directoriesP, QList<PathSegment *> *filesP) {
-    PathSegment *segmentP = NULL;
-    QString     segmentName;
-    bool        deleted = false;
+void PathSegment::resize(int capacity, qint64 *footprintP) {
+    PathSegment **oldChildrenP = m_childrenP;
+    int         oldCapacity = m_capacity;
+
+    m_childrenP = capacity ? new PathSegment *[capacity] : NULL;
+    m_capacity = capacity;
+    m_numChildren = 0;
+    if (m_childrenP)
+        memset(m_childrenP, 0, capacity * sizeof(PathSegment *));
+
+    for (int i = 0; i < oldCapacity; i++) {
+        if (oldChildrenP[i]) {
+            place(oldChildrenP[i]);
+            m_numChildren++;
+        }
+    }
 
-    if (path.isEmpty())
-        return false;
+    delete [] oldChildrenP;
+    *footprintP += (qint64)(capacity - oldCapacity) * sizeof(PathSegment *);
+}
 
-    // keep the path segment name and remove it from the path
-    segmentName = path[0];
-    path.removeFirst();
+void PathSegment::insertChild(PathSegment *childP, qint64 *footprintP) {
+    childP->m_parentP = this;
 
-   // in the case we have a "" in the path... (split can do this)
-   if (segmentName.isEmpty())
-        return deletePath(path, directory, directoriesP, filesP);
+    // grow the array, or switch to a hash table, keep the table at most half full
+    if (!isHashed()) {
+        if (m_numChildren == m_capacity)
+            resize(m_capacity == PATH_SEGMENT_MAX_LISTED ? PATH_SEGMENT_MIN_HASHED : qMax(m_capacity * 2, 2), footprintP);
+    } else if ((m_numChildren + 1) * 2 > m_capacity)
+        resize(m_capacity * 2, footprintP);
 
-    // exit if this path doesn't exist
-    segmentP = m_entries.value(segmentName);
-    if (!segmentP)
-        return false;
+    place(childP);
+    m_numChildren++;
+}
 
-    // have we met the end of the path?
-    if (path.isEmpty()) {
-        if (segmentP && --segmentP->m_refCount == 0) {
-            // this segment is not referenced, anymore, drop it
-            m_entries.remove(segmentName);
-
-            // remove it from the path list
-            if (path.isEmpty()) {
-                int index;
-                if (directory) {
-                    if ((index = directoriesP->indexOf(segmentP)) != -1)
-                        directoriesP->removeAt(index);
-                }
-                else {
-                    if ((index = filesP->indexOf(segmentP)) != -1)
-                        filesP->removeAt(index);
-                }
+void PathSegment::removeChild(PathSegment *childP, qint64 *footprintP) {
+    if (!isHashed()) {
+        for (int i = 0; i < m_numChildren; i++) {
+            if (m_childrenP[i] == childP) {
+                // the array stays packed
+                m_childrenP[i] = m_childrenP[--m_numChildren];
+                m_childrenP[m_numChildren] = NULL;
+                break;
             }
+        }
 
-            delete segmentP;
+        if (!m_numChildren)
+            resize(0, footprintP);
 
-            return true;
-        }
+        return;
+    }
 
-        return false;
+    uint mask = m_capacity - 1;
+    uint i = hash(childP->m_name.unicode(), childP->m_name.length()) & mask;
+    while (m_childrenP[i] != childP)
+        i = (i + 1) & mask;
+
+    // shift back the following children which can't be reached anymore (linear probing)
+    m_childrenP[i] = NULL;
+    for (uint j = (i + 1) & mask; m_childrenP[j]; j = (j + 1) & mask) {
+        uint home = hash(m_childrenP[j]->m_name.unicode(), m_childrenP[j]->m_name.length()) & mask;
+
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+            continue;
+
+        m_childrenP[i] = m_childrenP[j];
+        m_childrenP[j] = NULL;
+        i = j;
     }
+    m_numChildren--;
+
+    // shrink, back to an array once small enough
+    if (!m_numChildren)
+        resize(0, footprintP);
+    else if (m_numChildren * 8 < m_capacity)
+        resize(m_capacity / 2 >= PATH_SEGMENT_MIN_HASHED ? m_capacity / 2 : PATH_SEGMENT_MAX_LISTED, footprintP);
+}
+
+/**
+  * Returns the children, the table may change meanwhile.
+  */
+void PathSegment::getChildren(QVarLengthArray<PathSegment *, PATH_WALK_CHILDREN> *childrenP) const {
+    for (int i = 0; i < m_capacity; i++)
+        if (m_childrenP[i])
+            childrenP->append(m_childrenP[i]);
+}
 
-    // walk down the path
-    if ((deleted = segmentP->deletePath(path, directory, directoriesP, filesP)) &&
-        --segmentP->m_refCount == 0) {
-        // this segment is not referenced, anymore, drop it
-        m_entries.remove(segmentName);
+/**
+  * Returns the full path of this PathSegment by walking up to the root PathSegment. Local
+  * files start with a '/', urls with their scheme.
+  */
+QString PathSegment::getPath() const {
+    QVarLengthArray<const PathSegment *, 32>    segments;
+    int                                         length = 0;
 
-        int index;
-        if ((index = directoriesP->indexOf(segmentP)) != -1)
-            directoriesP->removeAt(index);
+    for (const PathSegment *segmentP = this; segmentP->m_parentP; segmentP = segmentP->m_parentP) {
+        segments.append(segmentP);
+        length += segmentP->m_name.length() + 1;
+    }
 
-        delete segmentP;
+    QString result;
+    result.reserve(length);
 
-        return true;
+    for (int i = segments.count() - 1; i >= 0; i--) {
+        //  #### non local urls (<scheme>://<authority>/<path>) will be misformatted under windows, fix this
+        if (i != segments.count() - 1 || !segments[i]->m_name.contains("://"))
+            result.append(QDir::separator());
+        result.append(segments[i]->m_name);
     }
 
-    return deleted;
+    return result;
+}
+
+/**
+  * Appends to directoriesP and filesP the paths of the segments below this one, path
+  * being the path of this segment. Only the direct children are returned if not recursive.
+  */
+void PathSegment::getSubPaths(QString path, bool recursive, QStringList *directoriesP, QStringList *filesP) {
+    for (int i = 0; i < m_capacity; i++) {
+        PathSegment *segmentP = m_childrenP[i];
+        if (!segmentP)
+            continue;
+
+        QString segmentPath = path + QDir::separator() + segmentP->m_name;
+
+        if (!segmentP->m_directory) {
+            filesP->append(segmentPath);
+            continue;
+        }
+
+        directoriesP->append(segmentPath);
+        if (recursive)
+            segmentP->getSubPaths(segmentPath, recursive, directoriesP, filesP);
+    }
 }
 
 /**
@@ -192,39 +256,407 @@ bool PathSegment::deletePath(QStringList path, bool directory, QList<PathSegment
   */
 #ifdef _VERBOSE_PATH
 void PathSegment::dump(QString message) {
-    qDebug() << message << ", segment: " << m_name << ", ref count: " << m_refCount << ", nums entries: " << m_entries.count();
-    QList<PathSegment *> list = m_entries.values();
-    for (QList<PathSegment *>::iterator i = list.begin(); i != list.end(); i++)
-        (*i)->dump("\t" + message);
+    qDebug() << message << ", segment: " << m_name << ", ref count: " << m_refCount << ", nums entries: " << m_numChildren;
+    for (int i = 0; i < m_capacity; i++)
+        if (m_childrenP[i])
+            m_childrenP[i]->dump("\t" + message);
 }
 #endif
 
+PathArena::~PathArena() {
+    for (QList<PathSegment *>::iterator i = m_chunks.begin(); i != m_chunks.end(); i++)
+        delete [] *i;
+}
+
+/**
+  * Returns a new segment, its name interned.
+  */
+PathSegment *PathArena::allocate(const QStringRef &name, bool directory) {
+    if (!m_freeP) {
+        PathSegment *chunkP = new PathSegment[PATH_ARENA_CHUNK];
+        m_chunks.append(chunkP);
+
+        for (int i = 0; i < PATH_ARENA_CHUNK; i++) {
+            chunkP[i].m_parentP = m_freeP;
+            m_freeP = &chunkP[i];
+        }
+    }
+
+    PathSegment *segmentP = m_freeP;
+    m_freeP = segmentP->m_parentP;
+
+    segmentP->m_parentP = NULL;
+    segmentP->m_refCount = 1;
+    segmentP->m_slot = -1;
+    segmentP->m_directory = directory;
+
+    if (!name.isEmpty()) {
+        // look the name up without copying it
+        QHash<QString, int>::iterator i = m_names.find(QString::fromRawData(name.unicode(), name.length()));
+        if (i == m_names.end()) {
+            i = m_names.insert(name.toString(), 0);
+            m_namesFootprint += PATH_NAME_OVERHEAD + name.length() * sizeof(QChar);
+        }
+
+        ++*i;
+        segmentP->m_name = i.key();
+    }
+
+    return segmentP;
+}
+
+/**
+  * Gives a segment back, its children must have been released.
+  */
+void PathArena::release(PathSegment *segmentP) {
+    if (!segmentP->m_name.isEmpty()) {
+        QHash<QString, int>::iterator i = m_names.find(segmentP->m_name);
+        if (i != m_names.end() && !--*i) {
+            m_namesFootprint -= PATH_NAME_OVERHEAD + segmentP->m_name.length() * sizeof(QChar);
+            m_names.erase(i);
+        }
+    }
+
+    segmentP->m_name = QString();
+    delete [] segmentP->m_childrenP;
+    segmentP->m_childrenP = NULL;
+    segmentP->m_numChildren = 0;
+    segmentP->m_capacity = 0;
+
+    segmentP->m_parentP = m_freeP;
+    m_freeP = segmentP;
+}
+
+/**
+  * Creates a path set, its segments allocated by the given arena (shared with other sets), or
+  * by its own.
+  */
+PathSet::PathSet(PathArena *arenaP) {
+    m_ownArena = !arenaP;
+    m_arenaP = arenaP ? arenaP : new PathArena();
+    m_rootP = m_arenaP->allocate(QStringRef(), true);
+    m_footprint = 0;
+}
+
+PathSet::~PathSet() {
+    freeTree(m_rootP);
+
+    if (m_ownArena)
+        delete m_arenaP;
+}
+
+/**
+  * Gives a segment and everything below it back to the arena.
+  */
+void PathSet::freeTree(PathSegment *segmentP) {
+    for (int i = 0; i < segmentP->m_capacity; i++)
+        if (segmentP->m_childrenP[i])
+            freeTree(segmentP->m_childrenP[i]);
+
+    m_arenaP->release(segmentP);
+}
+
+/**
+  * Adds a path, returns its last segment.
+  */
+PathSegment *PathSet::addPath(const QString &path, bool directory) {
+    PathTokenizer   tokenizer(path);
+    QStringRef      name;
+    PathSegment     *segmentP = m_rootP;
+
+    while (tokenizer.next(&name)) {
+        bool        last = tokenizer.atEnd();
+        PathSegment *childP = segmentP->findChild(name);
+
+        if (!childP) {
+            // this one doesn't exist, add it
+            childP = m_arenaP->allocate(name, directory || !last);
+            segmentP->insertChild(childP, &m_footprint);
+            m_footprint += sizeof(PathSegment);
+
+            // add it to the path list
+            if (last)
+                listSegment(childP);
+        } else
+            // we've got one more path going through this segment
+            childP->m_refCount++;
+
+        if (last)
+            return childP;
+
+        segmentP = childP;
+    }
+
+    return NULL;
+}
+
+/**
+  * Returns the segment of the given path, NULL if not found.
+  */
+PathSegment *PathSet::findPath(const QString &path) const {
+    PathTokenizer   tokenizer(path);
+    QStringRef      name;
+    PathSegment     *segmentP = NULL;
+
+    for (PathSegment *parentP = m_rootP; tokenizer.next(&name); parentP = segmentP)
+        if (!(segmentP = parentP->findChild(name)))
+            return NULL;
+
+    return segmentP;
+}
+
 /**
-  * Merge the PathSet pointed by setP to this.
+  * Lists a path's last segment, with the directories or the files.
+  */
+void PathSet::listSegment(PathSegment *segmentP) {
+    QVector<PathSegment *> *listP = segmentP->m_directory ? &m_directorySet : &m_fileSet;
+
+    segmentP->m_slot = listP->count();
+    listP->append(segmentP);
+}
+
+/**
+  * Removes a segment from its list, the last one listed takes its slot.
+  */
+void PathSet::unlistSegment(PathSegment *segmentP) {
+    if (segmentP->m_slot == -1)
+        return;
+
+    QVector<PathSegment *>  *listP = segmentP->m_directory ? &m_directorySet : &m_fileSet;
+    PathSegment             *lastP = listP->last();
+
+    (*listP)[segmentP->m_slot] = lastP;
+    lastP->m_slot = segmentP->m_slot;
+    listP->remove(listP->count() - 1);
+
+    segmentP->m_slot = -1;
+}
+
+/**
+  * Drops a segment which isn't referenced anymore.
+  */
+void PathSet::removeSegment(PathSegment *segmentP) {
+    unlistSegment(segmentP);
+    segmentP->m_parentP->removeChild(segmentP, &m_footprint);
+    m_footprint -= sizeof(PathSegment);
+    m_arenaP->release(segmentP);
+}
+
+/**
+  * Deletes a path. Returns true if its last segment was dropped (no other path goes through
+  * it), false else.
+  */
+bool PathSet::deletePath(const QString &path) {
+    QVarLengthArray<PathSegment *, 32>  segments;
+    PathTokenizer                       tokenizer(path);
+    QStringRef                          name;
+
+    for (PathSegment *segmentP = m_rootP; tokenizer.next(&name); segments.append(segmentP))
+        if (!(segmentP = segmentP->findChild(name)))
+            return false;
+
+    if (segments.isEmpty())
+        return false;
+
+    // the path's last segment is still referenced, nothing changes above
+    PathSegment *segmentP = segments[segments.count() - 1];
+    if (--segmentP->m_refCount)
+        return false;
+
+    removeSegment(segmentP);
+
+    // one path less going through the segments above
+    for (int i = segments.count() - 2; i >= 0; i--) {
+        segmentP = segments[i];
+        if (!--segmentP->m_refCount)
+            removeSegment(segmentP);
+    }
+
+    return true;
+}
+
+/**
+  * Moves the paths of the set pointed by setP to this, setP is left empty. The subtrees this
+  * set doesn't have are spliced in, if the sets share their arena.
   */
 PathSet *PathSet::merge(PathSet *setP) {
-    if (!setP || setP->isEmpty())
+    if (!setP || setP == this || setP->isEmpty())
         return this;
 
-    // directories first
-    for (QList<PathSegment *>::const_iterator i = setP->getPaths(true)->begin(); i != setP->getPaths(true)->end(); i++) {
-#ifdef _VERBOSE_PATH
-        qDebug() << "merging directory: " << (*i)->getPath();
-#endif
-        addPath((*i)->getPath(), true);
-    }
+    if (setP->m_arenaP == m_arenaP)
+        mergeSegment(m_rootP, setP->m_rootP, setP);
+    else {
+        // the segments can't change arena, add the paths
+        QStringList directories;
+        QStringList files;
 
-    // then files
-    for (QList<PathSegment *>::const_iterator i = setP->getPaths()->begin(); i != setP->getPaths()->end(); i++) {
-#ifdef _VERBOSE_PATH
-        qDebug() << "merging file: " << (*i)->getPath();
-#endif
-        addPath((*i)->getPath());
+        setP->listPaths(&directories, &files);
+
+        for (QStringList::const_iterator i = directories.begin(); i != directories.end(); i++)
+            addPath(*i, true);
+        for (QStringList::const_iterator i = files.begin(); i != files.end(); i++)
+            addPath(*i);
     }
 
+    setP->deleteAll();
+
     return this;
 }
 
+/**
+  * Merges the children of sourceP, a segment of setP, in segmentP, its counterpart. Returns the
+  * number of paths listed below sourceP, as many more paths go through segmentP.
+  */
+int PathSet::mergeSegment(PathSegment *segmentP, PathSegment *sourceP, PathSet *setP) {
+    QVarLengthArray<PathSegment *, PATH_WALK_CHILDREN>  children;
+    int                                                 numListed = 0;
+
+    sourceP->getChildren(&children);
+
+    for (int i = 0; i < children.count(); i++) {
+        PathSegment *childP = children[i];
+        PathSegment *counterpartP = segmentP->findChild(childP);
+        int         numChildListed;
+
+        if (counterpartP) {
+            // the path goes through an existing segment (which isn't listed if it wasn't)
+            numChildListed = mergeSegment(counterpartP, childP, setP) + (childP->isListed() ? 1 : 0);
+            counterpartP->m_refCount += numChildListed;
+        } else {
+            // missing here, take the subtree over
+            sourceP->removeChild(childP, &setP->m_footprint);
+
+            if ((numChildListed = adoptSegment(childP, setP)))
+                segmentP->insertChild(childP, &m_footprint);
+            else {
+                m_footprint -= sizeof(PathSegment) + childP->m_capacity * sizeof(PathSegment *);
+                m_arenaP->release(childP);
+            }
+        }
+
+        numListed += numChildListed;
+    }
+
+    return numListed;
+}
+
+/**
+  * Takes over a segment (and its subtree) detached from setP: it's listed and accounted for
+  * here, referenced by the paths listed below it. The segments without any are dropped. Returns
+  * the number of paths listed.
+  */
+int PathSet::adoptSegment(PathSegment *segmentP, PathSet *setP) {
+    QVarLengthArray<PathSegment *, PATH_WALK_CHILDREN>  children;
+    qint64                                              bytes = sizeof(PathSegment) + segmentP->m_capacity * sizeof(PathSegment *);
+    int                                                 numListed = 0;
+
+    setP->m_footprint -= bytes;
+    m_footprint += bytes;
+
+    segmentP->getChildren(&children);
+
+    for (int i = 0; i < children.count(); i++) {
+        int numChildListed = adoptSegment(children[i], setP);
+        if (!numChildListed)
+            removeSegment(children[i]);
+
+        numListed += numChildListed;
+    }
+
+    if (segmentP->isListed()) {
+        setP->unlistSegment(segmentP);
+        listSegment(segmentP);
+        numListed++;
+    }
+
+    segmentP->m_refCount = numListed;
+
+    return numListed;
+}
+
+/**
+  * Returns in directoriesP and filesP (if not NULL) the listed paths.
+  */
+void PathSet::listPaths(QStringList *directoriesP, QStringList *filesP) const {
+    QString path;
+
+    listSegment(m_rootP, path, directoriesP, filesP);
+}
+
+void PathSet::listSegment(const PathSegment *segmentP, QString &path, QStringList *directoriesP, QStringList *filesP) {
+    for (int i = 0; i < segmentP->m_capacity; i++) {
+        const PathSegment *childP = segmentP->m_childrenP[i];
+        if (!childP)
+            continue;
+
+        int length = path.length();
+        appendName(path, childP);
+
+        if (childP->isListed()) {
+            QStringList *pathsP = childP->m_directory ? directoriesP : filesP;
+            if (pathsP)
+                pathsP->append(path);
+        }
+
+        listSegment(childP, path, directoriesP, filesP);
+        path.truncate(length);
+    }
+}
+
+/**
+  * Compares two sets in a single walk: returns in diffP the paths listed in oldP only (removed),
+  * in newP only (added), and in both (kept). The parent directories come before their entries.
+  */
+void PathSet::diff(const PathSet *oldP, const PathSet *newP, PathDiff *diffP) {
+    QString path;
+
+    diffSegment(oldP->m_rootP, newP->m_rootP, path, diffP);
+}
+
+/**
+  * Compares the children of two counterpart segments, either may be NULL.
+  */
+void PathSet::diffSegment(const PathSegment *oldP, const PathSegment *newP, QString &path, PathDiff *diffP) {
+    int length = path.length();
+
+    for (int i = 0; oldP && i < oldP->m_capacity; i++) {
+        const PathSegment *childP = oldP->m_childrenP[i];
+        if (!childP)
+            continue;
+
+        const PathSegment *counterpartP = newP ? newP->findChild(childP) : NULL;
+        bool listed = counterpartP && counterpartP->isListed();
+
+        appendName(path, childP);
+
+        if (childP->isListed()) {
+            if (listed)
+                (childP->m_directory ? diffP->m_keptDirectories : diffP->m_keptFiles).append(path);
+            else
+                (childP->m_directory ? diffP->m_removedDirectories : diffP->m_removedFiles).append(path);
+        } else if (listed)
+            (counterpartP->m_directory ? diffP->m_addedDirectories : diffP->m_addedFiles).append(path);
+
+        diffSegment(childP, counterpartP, path, diffP);
+        path.truncate(length);
+    }
+
+    // the new segments
+    for (int i = 0; newP && i < newP->m_capacity; i++) {
+        const PathSegment *childP = newP->m_childrenP[i];
+        if (!childP || (oldP && oldP->findChild(childP)))
+            continue;
+
+        appendName(path, childP);
+
+        if (childP->isListed())
+            (childP->m_directory ? diffP->m_addedDirectories : diffP->m_addedFiles).append(path);
+
+        diffSegment(NULL, childP, path, diffP);
+        path.truncate(length);
+    }
+}
+
 /**
   * Dumps this PathSet.
   */
@@ -235,14 +667,14 @@ void PathSet::dump(QString message) {
     qDebug() << "\t num directories: " << m_directorySet.count();
 
     // directories first
-    for (QList<PathSegment *>::const_iterator i = getPaths(true)->begin(); i != getPaths(true)->end(); i++)
+    for (QVector<PathSegment *>::const_iterator i = getPaths(true)->begin(); i != getPaths(true)->end(); i++)
         qDebug() << "\t directory: " << (*i)->getPath();
 
     // num files
     qDebug() << "\t num files: " << m_fileSet.count();
 
     // then files
-    for (QList<PathSegment *>::const_iterator i = getPaths()->begin(); i != getPaths()->end(); i++)
+    for (QVector<PathSegment *>::const_iterator i = getPaths()->begin(); i != getPaths()->end(); i++)
         qDebug() << "\t file: " << (*i)->getPath();
 
     // now the tree
@@ -257,13 +689,18 @@ void PathSet::dump(QString message) {
   * Delete all the paths of this PathSet.
   */
 void PathSet::deleteAll() {
-    // deleting root deletes everything
-    delete m_rootP;
+    // the root stays
+    for (int i = 0; i < m_rootP->m_capacity; i++)
+        if (m_rootP->m_childrenP[i])
+            freeTree(m_rootP->m_childrenP[i]);
+
+    delete [] m_rootP->m_childrenP;
+    m_rootP->m_childrenP = NULL;
+    m_rootP->m_numChildren = 0;
+    m_rootP->m_capacity = 0;
 
     // files and directories are just cleared (pointers to path segments were hold by the PathSegments tree.
     m_fileSet.clear();
     m_directorySet.clear();
-
-    // recreate root
-    m_rootP = new PathSegment("");
+    m_footprint = 0;
 }
@@ -23,97 +23,185 @@
 #ifndef PATHSEGMENT_H
 #define PATHSEGMENT_H
 
-#include <QMap>
+#include <QHash>
+#include <QList>
+#include <QVarLengthArray>
+#include <QVector>
 #include <QStringList>
 #include <QDir>
-#include <QStack>
 #include <QString>
 
 //#define _VERBOSE_PATH 1
 
+#define PATH_ARENA_CHUNK                1024    // segments allocated at once by an arena
+#define PATH_SEGMENT_MAX_LISTED         8       // children a segment holds in a plain array, in a hash table above
+#define PATH_SEGMENT_MIN_HASHED         32      // slots of a segment's children hash table, at least
+#define PATH_WALK_CHILDREN              64      // children of a segment held on the stack while walking it
+#define PATH_NAME_OVERHEAD              48      // bytes, hash node and string header of an interned name, on top of its characters
+
 /**
-  * A path segment is a segment of a file/directory path. If a directory,
-  * a segment will store child segments in its m_entries QMap for fast searches.
-  * The resulting tree represents a sets of files/directories organized as a tree,
-  * hence saving space by sharing the common path segments (directories).
+  * Splits a path into its segment names, without copying them: the empty segments are skipped,
+  * and a scheme separator ("://") is kept in its segment (the first one of an url).
   */
-class PathSegment {
+class PathTokenizer {
 public:
-    PathSegment(QString name) {
-        m_parentP = NULL;
-        m_name = name;
-        m_refCount = 1;
-    }
-    ~PathSegment() {
-        qDeleteAll(m_entries);
-        m_entries.clear();
+    explicit PathTokenizer(const QString &path) : m_path(path) {
+        m_position = 0;
+        skipSeparators();
     }
 
-    static void sanitizePath(QString &path) {
-        path.replace("://", "%SC%");
-    }
+    bool next(QStringRef *nameP);
 
-    static void unsanitizePath(QString &path) {
-        path.replace("%SC%", "://");
+    // no more segments
+    inline bool atEnd() {
+        return m_position >= m_path.length();
     }
 
-    PathSegment *addPath(QStringList path, bool directory, QList<PathSegment *> *directoriesP, QList<PathSegment *> *filesP);
-    bool        deletePath(QStringList path, bool directory, QList<PathSegment *> *directoriesP, QList<PathSegment *> *filesP);
-    PathSegment *findPath(QStringList path);
+private:
+    const QString   &m_path;
+    int             m_position;
 
-    inline QMap<QString, PathSegment *> *entries() {
-        return &m_entries;
+    inline void skipSeparators() {
+        while (m_position < m_path.length() && m_path.at(m_position) == QDir::separator())
+            m_position++;
     }
+};
 
-    inline bool isEmpty() {
-        return m_entries.isEmpty();
+/**
+  * A path segment is a segment of a file/directory path. If a directory, a segment holds its
+  * child segments in a small array, or in an open addressing hash table once it has more than
+  * PATH_SEGMENT_MAX_LISTED of them. The resulting tree represents a sets of files/directories
+  * organized as a tree, hence saving space by sharing the common path segments (directories).
+  *
+  * The segments are allocated by a PathArena, their names are interned by it.
+  */
+class PathSegment {
+public:
+    PathSegment() {
+        m_parentP = NULL;
+        m_childrenP = NULL;
+        m_numChildren = 0;
+        m_capacity = 0;
+        m_refCount = 1;
+        m_slot = -1;
+        m_directory = true;
     }
 
-    inline QString getPath() {
-        QString result;
+    PathSegment *findChild(const QStringRef &name) const;
+    void        getSubPaths(QString path, bool recursive, QStringList *directoriesP, QStringList *filesP);
+    QString     getPath() const;
 
-        // retrieve the path, restore the scheme if any ("://")
-        getPath(result);
-        unsanitizePath(result);
-
-        // local files must start with a '/'
-        if (!result.contains("://"))
-            result.prepend(QDir::separator());
+    inline const QString &getName() const {
+        return m_name;
+    }
 
-        return result;
+    inline bool isEmpty() const {
+        return !m_numChildren;
     }
 
-    QString getPath(QString &path);
+    inline bool isDirectory() const {
+        return m_directory;
+    }
 
 #ifdef _VERBOSE_PATH
     void dump(QString message = "dumping");
 #endif
 
 private:
-    QString                         m_name;
-    int                             m_refCount;   // number of path going through this
-    QMap<QString, PathSegment *>    m_entries;
-    PathSegment                     *m_parentP;
+    friend class PathArena;
+    friend class PathSet;
+
+    QString         m_name;         // shared with the arena's names
+    PathSegment     *m_parentP;     // or the next free segment of the arena
+    PathSegment     **m_childrenP;  // array (m_numChildren first slots used) or hash table (NULL slots empty)
+    int             m_numChildren;
+    int             m_capacity;     // slots, the children are hashed above PATH_SEGMENT_MAX_LISTED
+    int             m_refCount;     // number of path going through this
+    int             m_slot;         // index in its set's file or directory list, -1 if not listed
+    bool            m_directory;    // this segment is a directory (intermediate segments always are)
+
+    inline bool isHashed() const {
+        return m_capacity > PATH_SEGMENT_MAX_LISTED;
+    }
+
+    inline bool isListed() const {
+        return m_slot != -1;
+    }
+
+    inline PathSegment *findChild(const PathSegment *segmentP) const {
+        return findChild(QStringRef(&segmentP->m_name));
+    }
+
+    void getChildren(QVarLengthArray<PathSegment *, PATH_WALK_CHILDREN> *childrenP) const;
+
+    void insertChild(PathSegment *childP, qint64 *footprintP);
+    void removeChild(PathSegment *childP, qint64 *footprintP);
+    void resize(int capacity, qint64 *footprintP);
+    void place(PathSegment *childP);
+
+    static uint hash(const QChar *charsP, int length);
+    static bool matches(const QString &name, const QStringRef &ref);
 };
 
 /**
-  * A path set represents a set of files/directories stores as PathSegment trees.
+  * A path arena allocates segments by chunks of PATH_ARENA_CHUNK, and reuses the ones freed. It
+  * interns the segment names: the segments with the same name share a single string. Path sets
+  * may share an arena (a watcher's do), then they must be used from a single thread.
   */
-class PathSet {
+class PathArena {
 public:
-    PathSet() {
-        m_rootP = new PathSegment("");
+    PathArena() {
+        m_freeP = NULL;
+        m_namesFootprint = 0;
     }
 
-    ~PathSet() {
-        // deleting root deletes everything
-        delete m_rootP;
+    ~PathArena();
+
+    PathSegment *allocate(const QStringRef &name, bool directory);
+    void        release(PathSegment *segmentP);
 
-        // files and directories are just cleared (pointers to path segments were held by the PathSegments tree).
-        m_fileSet.clear();
-        m_directorySet.clear();
+    // bytes used by the interned names
+    inline qint64 footprint() {
+        return m_namesFootprint;
     }
 
+private:
+    QList<PathSegment *>    m_chunks;
+    PathSegment             *m_freeP;           // the free segments, chained by their parent
+    QHash<QString, int>     m_names;            // the interned names and their number of segments
+    qint64                  m_namesFootprint;
+};
+
+/**
+  * The paths listed in one path set only, or in both, as found by PathSet::diff.
+  */
+class PathDiff {
+public:
+    QStringList m_addedDirectories;     // listed in the new set only
+    QStringList m_addedFiles;
+    QStringList m_removedDirectories;   // listed in the old set only
+    QStringList m_removedFiles;
+    QStringList m_keptDirectories;      // listed in both
+    QStringList m_keptFiles;
+};
+
+/**
+  * A path set represents a set of files/directories stores as PathSegment trees. The memory
+  * used by its segments is accounted for as they're added and deleted (footprint), the names
+  * are accounted for by the arena.
+  *
+  * The paths added are also listed, files and directories apart (getPaths). A listed segment
+  * knows its slot, so it's unlisted in constant time: the last one of the list takes its slot.
+  * The lists are in no particular order.
+  *
+  * The sets are merged, compared (diff) and listed (listPaths) by walking their tries: a path
+  * is built as the walk goes down, and the subtrees missing from a set are spliced in.
+  */
+class PathSet {
+public:
+    explicit PathSet(PathArena *arenaP = NULL);
+    ~PathSet();
+
     void deleteAll();
 
     inline const PathSegment *getRoot() {
@@ -126,49 +214,61 @@ public:
 
     PathSet *merge(PathSet *setP);
 
-    inline PathSegment *addPath(QString path, bool directory = false) {
-        PathSegment::sanitizePath(path);
-        QStringList segmentNames = path.split(QDir::separator());
-
-        return m_rootP->addPath(segmentNames,
-                                directory,
-                                &m_directorySet,
-                                &m_fileSet);
-    }
-
-    inline PathSegment *findPath(QString path) {
-        PathSegment::sanitizePath(path);
-        QStringList segmentNames = path.split(QDir::separator());
-
-        return m_rootP->findPath(segmentNames);
-    }
-
-    inline bool deletePath(QString path, bool directory = false) {
-        PathSegment::sanitizePath(path);
-        PathSegment *segmentP;
-        QStringList segmentNames = path.split(QDir::separator());
-
-        if (!(segmentP = m_rootP->findPath(segmentNames)))
-            return false;
-
-        return m_rootP->deletePath(segmentNames,
-                                   directory,
-                                   &m_directorySet,
-                                   &m_fileSet);
+    void        listPaths(QStringList *directoriesP, QStringList *filesP) const;
+    static void diff(const PathSet *oldP, const PathSet *newP, PathDiff *diffP);
+
+    PathSegment *addPath(const QString &path, bool directory = false);
+    PathSegment *findPath(const QString &path) const;
+    bool        deletePath(const QString &path);
+
+    /**
+      * Returns in directoriesP and filesP the paths of the entries below the given directory
+      * (only its direct children if not recursive).
+      */
+    inline void getSubPaths(QString path, bool recursive, QStringList *directoriesP, QStringList *filesP) {
+        PathSegment *segmentP = findPath(path);
+        if (segmentP)
+            segmentP->getSubPaths(path, recursive, directoriesP, filesP);
     }
 
 #ifdef _VERBOSE_PATH
     void dump(QString message = "dumping");
 #endif
 
-    inline const QList<PathSegment *> *getPaths(bool directory = false) {
+    inline const QVector<PathSegment *> *getPaths(bool directory = false) {
         return directory ? &m_directorySet : &m_fileSet;
     }
 
+    // bytes used by the segments, and the path lists (and the names if the arena isn't shared)
+    inline qint64 footprint() {
+        return m_footprint + (m_fileSet.count() + m_directorySet.count()) * sizeof(PathSegment *) +
+               (m_ownArena ? m_arenaP->footprint() : 0);
+    }
+
 private:
-    QList<PathSegment *>    m_fileSet;
-    QList<PathSegment *>    m_directorySet;
+    QVector<PathSegment *>  m_fileSet;
+    QVector<PathSegment *>  m_directorySet;
+    PathArena               *m_arenaP;
+    bool                    m_ownArena;
     PathSegment             *m_rootP;
+    qint64                  m_footprint;    // bytes used by the segments
+
+    void listSegment(PathSegment *segmentP);
+    void unlistSegment(PathSegment *segmentP);
+    void removeSegment(PathSegment *segmentP);
+    void freeTree(PathSegment *segmentP);
+    int  mergeSegment(PathSegment *segmentP, PathSegment *sourceP, PathSet *setP);
+    int  adoptSegment(PathSegment *segmentP, PathSet *setP);
+
+    static void listSegment(const PathSegment *segmentP, QString &path, QStringList *directoriesP, QStringList *filesP);
+    static void diffSegment(const PathSegment *oldP, const PathSegment *newP, QString &path, PathDiff *diffP);
+
+    // local paths start with a '/', urls with their scheme
+    static inline void appendName(QString &path, const PathSegment *segmentP) {
+        if (!path.isEmpty() || !segmentP->m_name.contains("://"))
+            path.append(QDir::separator());
+        path.append(segmentP->m_name);
+    }
 };
 
 #endif // PATHSEGMENT_H
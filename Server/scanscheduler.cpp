@@ -0,0 +1,208 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#include <QUrl>
+#include <QDebug>
+
+#include "scanscheduler.h"
+#include "qdirext.h"
+
+ScanScheduler::ScanScheduler() {
+}
+
+/**
+  * Returns the device an url is on: the local device id, or the remote host.
+  */
+QString ScanScheduler::getDevice(const QString &url) {
+    QUrl    parsedUrl(url);
+    QString scheme = parsedUrl.scheme();
+
+    if (!scheme.isEmpty() && scheme != "file")
+        return scheme + "://" + parsedUrl.host();
+
+    QDirExtEntry entry;
+    if (QDirExt::readEntry(url, &entry) && entry.m_device)
+        return QString("device:%1").arg(entry.m_device);
+
+    return url;
+}
+
+/**
+  * Starts scheduling a root (again).
+  */
+void ScanScheduler::addRoot(Watcher *watcherP, const QString &url) {
+    QString device = getDevice(url);
+
+    QMutexLocker locker(&m_mutex);
+
+    Root &root = m_roots[watcherP];
+    root.m_stats.m_device = device;
+}
+
+void ScanScheduler::removeRoot(Watcher *watcherP) {
+    QMutexLocker locker(&m_mutex);
+
+    QHash<Watcher *, Root>::iterator root = m_roots.find(watcherP);
+    if (root == m_roots.end())
+        return;
+
+    if (root->m_scanning) {
+        --m_devices[root->m_stats.m_device].m_numScanning;
+        m_deviceReleased.wakeAll();
+    }
+
+    m_roots.erase(root);
+}
+
+/**
+  * Blocks until the root's device is available. Returns false if stopped meanwhile.
+  */
+bool ScanScheduler::beginScan(Watcher *watcherP, volatile bool *stopP) {
+    QTime waitStart;
+
+    waitStart.start();
+
+    QMutexLocker locker(&m_mutex);
+
+    QHash<Watcher *, Root>::iterator root = m_roots.find(watcherP);
+    if (root == m_roots.end())
+        return !*stopP;
+
+    // the hashes may change while waiting, the entries are looked up again
+    QString device = root->m_stats.m_device;
+
+    ++m_devices[device].m_numWaiting;
+    while (!*stopP && m_devices[device].m_numScanning >= SCHEDULER_SCANS_PER_DEVICE)
+        m_deviceReleased.wait(&m_mutex, SCHEDULER_WAIT_STEP);
+    --m_devices[device].m_numWaiting;
+
+    if (*stopP)
+        return false;
+
+    // the root may have been removed meanwhile
+    root = m_roots.find(watcherP);
+    if (root == m_roots.end())
+        return false;
+
+    ++m_devices[device].m_numScanning;
+    root->m_scanning = true;
+    root->m_numListings = 0;
+    root->m_sliceStart.start();
+    root->m_stats.m_lastWaitTime = waitStart.elapsed();
+
+#ifdef _VERBOSE_SCHEDULER
+    qDebug() << "Scheduler grants " << root->m_stats.m_device << " after " << root->m_stats.m_lastWaitTime << " ms";
+#endif
+
+    return true;
+}
+
+/**
+  * Returns true if the scan must stop and give the device over: its slice is over, and another
+  * root waits for the device.
+  */
+bool ScanScheduler::mustYield(Watcher *watcherP) {
+    QMutexLocker locker(&m_mutex);
+
+    QHash<Watcher *, Root>::iterator root = m_roots.find(watcherP);
+    if (root == m_roots.end() || !root->m_scanning)
+        return false;
+
+    if (root->m_sliceStart.elapsed() < SCHEDULER_TIME_SLICE && root->m_numListings < SCHEDULER_LISTINGS_PER_SLICE)
+        return false;
+
+    return m_devices.value(root->m_stats.m_device).m_numWaiting > 0;
+}
+
+/**
+  * Accounts a directory listing in the scan's slice.
+  */
+void ScanScheduler::listed(Watcher *watcherP) {
+    QMutexLocker locker(&m_mutex);
+
+    QHash<Watcher *, Root>::iterator root = m_roots.find(watcherP);
+    if (root != m_roots.end())
+        ++root->m_numListings;
+}
+
+/**
+  * Gives the device back, and returns the millisecs until the next pass of the root. If no pass
+  * is given, the scan didn't happen and the root's schedule is left untouched.
+  */
+int ScanScheduler::endScan(Watcher *watcherP, const ScanPass *passP) {
+    QMutexLocker locker(&m_mutex);
+
+    QHash<Watcher *, Root>::iterator root = m_roots.find(watcherP);
+    if (root == m_roots.end())
+        return SCHEDULER_MIN_INTERVAL;
+
+    if (root->m_scanning) {
+        root->m_scanning = false;
+        --m_devices[root->m_stats.m_device].m_numScanning;
+        m_deviceReleased.wakeAll();
+    }
+
+    ScanStats &stats = root->m_stats;
+    if (!passP)
+        return stats.m_interval;
+
+    // a root which changed is scanned again soon, a quiet one less and less often
+    if (passP->m_changed || passP->m_numDeferred)
+        stats.m_interval = SCHEDULER_MIN_INTERVAL;
+    else
+        stats.m_interval = qMin(stats.m_interval * 2, SCHEDULER_MAX_INTERVAL);
+
+    int latency = stats.m_lastWaitTime + root->m_sliceStart.elapsed();
+
+    stats.m_lastPassTime = root->m_sliceStart.elapsed();
+    stats.m_averageLatency = stats.m_numPasses ? (stats.m_averageLatency * 3 + latency) / 4 : latency;
+    stats.m_lastPass = *passP;
+    ++stats.m_numPasses;
+    if (passP->m_numDeferred)
+        ++stats.m_numYields;
+
+#ifdef _VERBOSE_SCHEDULER
+    qDebug() << "Scheduler: pass on " << stats.m_device << " took " << stats.m_lastPassTime << " ms, next in " << stats.m_interval << " ms";
+#endif
+
+    return stats.m_interval;
+}
+
+ScanStats ScanScheduler::getStats(Watcher *watcherP) {
+    QMutexLocker locker(&m_mutex);
+
+    return m_roots.value(watcherP).m_stats;
+}
+
+/**
+  * Returns true if a directory found unchanged the given number of listings in a row must be
+  * listed again: hot directories always are, cold ones every 2, 4, ... up to
+  * SCHEDULER_MAX_BACKOFF passes.
+  */
+bool ScanScheduler::isDue(int unchangedPasses, int passesSinceListed) {
+    int backoff = 1;
+
+    for (int i = SCHEDULER_COOLING_PASSES; i <= unchangedPasses && backoff < SCHEDULER_MAX_BACKOFF; i += SCHEDULER_COOLING_PASSES)
+        backoff *= 2;
+
+    return passesSinceListed >= backoff;
+}
@@ -0,0 +1,155 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#ifndef SCANSCHEDULER_H
+#define SCANSCHEDULER_H
+
+#include <QString>
+#include <QHash>
+#include <QTime>
+#include <QMutex>
+#include <QWaitCondition>
+
+//#define _VERBOSE_SCHEDULER 1
+
+#define SCHEDULER_SCANS_PER_DEVICE      1       // roots scanned at once on the same device
+#define SCHEDULER_TIME_SLICE            2000    // millisecs a scan runs before yielding the device to a waiting root
+#define SCHEDULER_LISTINGS_PER_SLICE    2000    // directories a scan lists before yielding the device to a waiting root
+#define SCHEDULER_MIN_INTERVAL          1000    // millisecs between the passes of a root which just changed
+#define SCHEDULER_MAX_INTERVAL          60000   // millisecs between the passes of a root which doesn't change
+#define SCHEDULER_COOLING_PASSES        4       // a directory unchanged this many listings is cold, and listed half as often per as many more
+#define SCHEDULER_MAX_BACKOFF           16      // passes, a cold directory is listed at least that often
+#define SCHEDULER_WAIT_STEP             100     // millisecs, a scan waiting for its device checks it wasn't stopped that often
+
+/**
+  * What a pass (or a poll) of a root did, as reported to the scheduler.
+  */
+class ScanPass {
+public:
+    ScanPass() {
+        m_changed = false;
+        m_numHot = 0;
+        m_numCold = 0;
+        m_numBackedOff = 0;
+        m_numDeferred = 0;
+    }
+
+    bool    m_changed;      // something was signaled
+    int     m_numHot;       // directories listed first, they changed recently
+    int     m_numCold;      // cold directories listed, they were due
+    int     m_numBackedOff; // cold directories skipped, they weren't due
+    int     m_numDeferred;  // directories left for the next pass, the slice was over
+};
+
+/**
+  * The scheduling of a root, and what its last pass did.
+  */
+class ScanStats {
+public:
+    ScanStats() {
+        m_numPasses = 0;
+        m_numYields = 0;
+        m_interval = SCHEDULER_MIN_INTERVAL;
+        m_lastPassTime = 0;
+        m_lastWaitTime = 0;
+        m_averageLatency = 0;
+    }
+
+    QString     m_device;           // the roots on the same device are scanned SCHEDULER_SCANS_PER_DEVICE at a time
+    int         m_numPasses;
+    int         m_numYields;        // passes cut short for a waiting root
+    int         m_interval;         // millisecs until the next pass
+    int         m_lastPassTime;     // millisecs
+    int         m_lastWaitTime;     // millisecs waited for the device
+    int         m_averageLatency;   // millisecs from a pass being due to its completion, moving average
+    ScanPass    m_lastPass;
+};
+
+class Watcher;
+
+/**
+  * The scan scheduler is shared by all the watchers. It hands out the device of a root to
+  * SCHEDULER_SCANS_PER_DEVICE scans at a time (beginScan/endScan), the others wait. A scan runs
+  * until completed unless another root waits for the device: then it yields once its time or
+  * listings slice is over (mustYield), and resumes where it stopped next pass.
+  *
+  * The interval between the passes of a root adapts: SCHEDULER_MIN_INTERVAL after a pass which
+  * found changes (or was cut short), doubling after every quiet pass up to SCHEDULER_MAX_INTERVAL.
+  * Within a root, the watcher lists the hot directories first, and the cold ones less and less
+  * often (isDue).
+  */
+class ScanScheduler {
+public:
+    ScanScheduler();
+
+    void        addRoot(Watcher *watcherP, const QString &url);
+    void        removeRoot(Watcher *watcherP);
+
+    bool        beginScan(Watcher *watcherP, volatile bool *stopP);
+    bool        mustYield(Watcher *watcherP);
+    void        listed(Watcher *watcherP);
+    int         endScan(Watcher *watcherP, const ScanPass *passP);
+
+    ScanStats   getStats(Watcher *watcherP);
+
+    static bool isDue(int unchangedPasses, int passesSinceListed);
+
+private:
+    /**
+      * A root being scheduled.
+      */
+    class Root {
+    public:
+        Root() {
+            m_scanning = false;
+            m_numListings = 0;
+        }
+
+        ScanStats   m_stats;
+        bool        m_scanning;     // holds its device
+        QTime       m_sliceStart;
+        int         m_numListings;  // in the current slice
+    };
+
+    /**
+      * A device the roots are on.
+      */
+    class Device {
+    public:
+        Device() {
+            m_numScanning = 0;
+            m_numWaiting = 0;
+        }
+
+        int m_numScanning;
+        int m_numWaiting;
+    };
+
+    QMutex                      m_mutex;
+    QWaitCondition              m_deviceReleased;
+    QHash<Watcher *, Root>      m_roots;
+    QHash<QString, Device>      m_devices;
+
+    static QString getDevice(const QString &url);
+};
+
+#endif // SCANSCHEDULER_H
@@ -26,6 +26,7 @@
 
 #include "qdirext.h"
 #include "server.h"
+#include "watcher.h"
 
 /**
   * A SINGLE connection meta indexing server. Dialogs with a single connected client (other clients are blocked until
@@ -74,14 +75,17 @@ void Server::stop() {
     // stops listening
     close();
 
+    // stops the filters, and let them index what they were told about, so the saved db holds
+    // every file the watchers' checkpoint knows
+    m_classifier.stop();
+    m_classifier.waitForIndexing();
+
     // save the filters
     if (!m_filtersFilename.isEmpty()) {
         m_classifier.saveDatabase(m_filtersFilename + DB_EXTENSION);
         m_classifier.saveFilters(m_filtersFilename);
+        m_classifier.saveWatcherStates(m_filtersFilename + WATCH_STATE_EXTENSION);
     }
-
-    // stops the filters
-    m_classifier.stop();
 }
 
 /**
@@ -100,6 +104,23 @@ void Server::sendReply(QString reply, bool urgent) {
     sendMessage(fullReply, urgent);
 }
 
+/**
+  * Reads the globs following the plugin list starting at the first argument: an empty argument
+  * ends the list, the globs come after it. Returns false if there's no glob list (not even an
+  * empty one).
+  */
+bool Server::readGlobs(int first, QStringList *globsP) {
+    int end = m_arguments.indexOf("", first);
+    if (end == -1)
+        return false;
+
+    for (int i = end + 1; i < m_arguments.count(); i++)
+        if (!m_arguments[i].isEmpty())
+            globsP->append(m_arguments[i]);
+
+    return true;
+}
+
 /**
   * Processes a command sent by the client.
   */
@@ -247,6 +268,12 @@ void Server::processCommand(QString &string) {
         return;
     }
 
+    // get filter globs
+    if (m_command == GET_FILTER_GLOBS_COMMAND){
+        getFilterGlobsCommand();
+        return;
+    }
+
     // cleanup filter
     if (m_command == CLEANUP_FILTER_COMMAND){
         cleanupFilterCommand();
@@ -313,6 +340,12 @@ void Server::processCommand(QString &string) {
         return;
     }
 
+    // run filter's rules again against the stored attributes
+    if (m_command == REEVALUATE_FILTER_COMMAND){
+        reevaluateFilterCommand();
+        return;
+    }
+
     // rescan all watched physical dirs
     if (m_command == RESCAN_COMMAND){
         rescanCommand();
@@ -337,6 +370,36 @@ void Server::processCommand(QString &string) {
         return;
     }
 
+    // get/set the watchers memory budget
+    if (m_command == WATCH_BUDGET_COMMAND){
+        watchBudgetCommand();
+        return;
+    }
+
+    // get the watchers stats
+    if (m_command == WATCH_STATS_COMMAND){
+        watchStatsCommand();
+        return;
+    }
+
+    // get the scan scheduling stats
+    if (m_command == SCAN_STATS_COMMAND){
+        scanStatsCommand();
+        return;
+    }
+
+    // get the plugin evaluation stats
+    if (m_command == PLUGIN_STATS_COMMAND){
+        pluginStatsCommand();
+        return;
+    }
+
+    // get/set the I/O limits
+    if (m_command == IO_LIMITS_COMMAND){
+        ioLimitsCommand();
+        return;
+    }
+
     // help
     if (m_command == HELP_COMMAND){
         helpCommand();
@@ -414,11 +477,15 @@ void Server::addFilterCommand() {
         plugins.append(plugin);
     }
 
+    // read globs
+    QStringList globs;
+    readGlobs(4, &globs);
+
     // find parent
     Filter *parentP = m_classifier.findFilter(parentVirDirPath);
 
     // add the (non started) filter
-    m_classifier.addFilter(parentP, virtualDirectoryPath, dir, recursive, plugins, true);
+    m_classifier.addFilter(parentP, virtualDirectoryPath, dir, recursive, plugins, globs, true);
 
     m_dirty = true;
 }
@@ -492,8 +559,13 @@ void Server::modifyFilterCommand() {
             plugins.append(plugin);
         }
 
+        // read globs, kept if not given
+        QStringList globs;
+        if (!readGlobs(3, &globs))
+            globs = filterP->getGlobs().getGlobs();
+
         // modify the filter
-        m_classifier.modifyFilter(filterP, dir, recursive, plugins);
+        m_classifier.modifyFilter(filterP, dir, recursive, plugins, globs);
 
         m_dirty = true;
     }
@@ -726,6 +798,7 @@ void Server::scanCommand() {
 void Server::cleanupCommand() {
     // faster implementation
     m_db.cleanup();
+    m_classifier.invalidateWatcherStates();
 }
 
 void Server::filesCommand() {
@@ -739,7 +812,7 @@ void Server::filesCommand() {
     Filter *filterP = m_classifier.findFilter(virDirPath);
     if (filterP) {
         // retrieve files
-        QStringList files = m_db.getFiles(filterP->getFilterId());
+        QStringList files = filterP->getFiles();
         for (QStringList::iterator i = files.begin(); i != files.end(); i++)
             sendReply(*i);
     }
@@ -781,6 +854,32 @@ void Server::getFilterDirCommand() {
         sendReply(filterP->getDirectory());
 }
 
+void Server::getFilterGlobsCommand() {
+    if (m_arguments.count() < 1)
+        return;
+
+    // read filter virtual path
+    QString virDirPath = m_arguments[0];
+
+    // find filter
+    Filter *filterP = m_classifier.findFilter(virDirPath);
+    if (filterP) {
+        QString reply;
+
+        // get the filter globs...
+        QStringList globs = filterP->getGlobs().getGlobs();
+        for (int i = 0; i < globs.count(); i++) {
+            reply += globs[i];
+            reply += CMD_SEPARATOR;
+        }
+
+        // remove the trailing separator if any
+        if (!reply.isEmpty())
+            reply.chop(1);
+        sendReply(reply);
+    }
+}
+
 void Server::getFileAttributeValueCommand() {
     if (m_arguments.count() < 3)
         return;
@@ -850,6 +949,19 @@ void Server::rescanFilterCommand() {
         filterP->rescanDirectory();
 }
 
+void Server::reevaluateFilterCommand() {
+    if (m_arguments.count() < 1)
+        return;
+
+    // read filter virtual path
+    QString virDirPath = m_arguments[0];
+
+    // find filter
+    Filter *filterP = m_classifier.findFilter(virDirPath);
+    if (filterP)
+        filterP->reevaluate();
+}
+
 void Server::cleanupFilterCommand() {
     if (m_arguments.count() < 1)
         return;
@@ -892,6 +1004,9 @@ void Server::saveSetCommand() {
         // save the db
         m_classifier.saveDatabase(m_filtersFilename + DB_EXTENSION);
 
+        // the files being indexed may be missing from this db, an older checkpoint could claim them
+        QFile::remove(m_filtersFilename + WATCH_STATE_EXTENSION);
+
         // send 'unexpected' reply
         QString msg = ADD_FILTER_SET_MSG;
         msg += CMD_SEPARATOR;
@@ -933,6 +1048,9 @@ void Server::loadSetCommand() {
             // load the filters
             m_classifier.loadFilters(m_filtersFilename);
 
+            // the watchers will only signal what changed since the db was saved
+            m_classifier.loadWatcherStates(m_filtersFilename + WATCH_STATE_EXTENSION);
+
             m_dirty = false;
         }
     }
@@ -968,6 +1086,9 @@ void Server::deleteSetCommand() {
                 file.remove();
             }
 
+            // and the watchers' checkpoint
+            QFile::remove(filepath + WATCH_STATE_EXTENSION);
+
             // send 'unexpected' reply
             QString msg;
             msg = DELETE_SET_COMMAND;
@@ -1035,3 +1156,187 @@ void Server::newSetCommand() {
     m_dirty = false;
 }
 
+void Server::watchBudgetCommand() {
+    // read the new budget if any (megabytes)
+    if (m_arguments.count() >= 1) {
+        bool    ok;
+        qint64  megabytes = m_arguments[0].toLongLong(&ok);
+        if (!ok || megabytes <= 0)
+            return;
+
+        Watcher::setMemoryBudget(megabytes * 1024 * 1024);
+    }
+
+    QString reply;
+    reply += QString::number(Watcher::getMemoryBudget());
+    reply += CMD_SEPARATOR;
+    reply += QString::number(Watcher::getTotalFootprint());
+    sendReply(reply);
+}
+
+void Server::watchStatsCommand() {
+    Filter *filterP = NULL;
+
+    // read filter virtual path if any, its root's watcher only then
+    if (m_arguments.count() >= 1 && !m_arguments[0].isEmpty()) {
+        filterP = m_classifier.findFilter(m_arguments[0]);
+        if (!filterP)
+            return;
+
+        filterP = filterP->getRoot();
+    }
+
+    QVector<Filter *> *filtersP = m_classifier.getFilters();
+    for (int i = 0; i < filtersP->count(); i++) {
+        Filter *rootP = filtersP->at(i);
+        if (!rootP->isRoot() || (filterP && rootP != filterP) || !rootP->getWatcher())
+            continue;
+
+        WatchStats stats = rootP->getWatcher()->getStats();
+
+        QString reply;
+        reply += rootP->getVirtualDirectoryPath();
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_numDirectories);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_numFiles);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_numCoarseDirectories);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_numCoarseFiles);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_footprint);
+        sendReply(reply);
+    }
+}
+
+void Server::scanStatsCommand() {
+    Filter *filterP = NULL;
+
+    // read filter virtual path if any, its root's watcher only then
+    if (m_arguments.count() >= 1 && !m_arguments[0].isEmpty()) {
+        filterP = m_classifier.findFilter(m_arguments[0]);
+        if (!filterP)
+            return;
+
+        filterP = filterP->getRoot();
+    }
+
+    QVector<Filter *> *filtersP = m_classifier.getFilters();
+    for (int i = 0; i < filtersP->count(); i++) {
+        Filter *rootP = filtersP->at(i);
+        if (!rootP->isRoot() || (filterP && rootP != filterP) || !rootP->getWatcher())
+            continue;
+
+        ScanStats stats = rootP->getWatcher()->getScanStats();
+
+        QString reply;
+        reply += rootP->getVirtualDirectoryPath();
+        reply += CMD_SEPARATOR;
+        reply += stats.m_device;
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_numPasses);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_interval);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_lastPassTime);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_lastWaitTime);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_averageLatency);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_numYields);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_lastPass.m_numHot);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_lastPass.m_numCold);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_lastPass.m_numBackedOff);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(stats.m_lastPass.m_numDeferred);
+        sendReply(reply);
+    }
+}
+
+void Server::pluginStatsCommand() {
+    Filter *filterP = NULL;
+
+    // read filter virtual path if any, this filter only then
+    if (m_arguments.count() >= 1 && !m_arguments[0].isEmpty()) {
+        filterP = m_classifier.findFilter(m_arguments[0]);
+        if (!filterP)
+            return;
+    }
+
+    QVector<Filter *> *filtersP = m_classifier.getFilters();
+    for (int i = 0; i < filtersP->count(); i++) {
+        Filter *fP = filtersP->at(i);
+        if (filterP && fP != filterP)
+            continue;
+
+        QList<QPair<QString, PluginStats> > stats = fP->getPluginStats();
+
+        QString reply;
+        reply += fP->getVirtualDirectoryPath();
+        for (int j = 0; j < stats.count(); j++) {
+            reply += CMD_SEPARATOR;
+            reply += stats[j].first;
+            reply += CMD_SEPARATOR;
+            reply += QString::number(stats[j].second.m_numChecks);
+            reply += CMD_SEPARATOR;
+            reply += QString::number(stats[j].second.m_numAccepted);
+            reply += CMD_SEPARATOR;
+            reply += QString::number(stats[j].second.m_extractTime);
+            reply += CMD_SEPARATOR;
+            reply += QString::number(stats[j].second.m_scriptTime);
+        }
+        sendReply(reply);
+    }
+}
+
+void Server::ioLimitsCommand() {
+    Filter *filterP = NULL;
+
+    // read filter virtual path if any, its root's limits only then
+    if (m_arguments.count() >= 1 && !m_arguments[0].isEmpty()) {
+        filterP = m_classifier.findFilter(m_arguments[0]);
+        if (!filterP)
+            return;
+
+        filterP = filterP->getRoot();
+    }
+
+    // read the new limits if any
+    if (filterP && m_arguments.count() >= 4) {
+        IoLimits    limits;
+        bool        bytesOk, opsOk;
+
+        qint64 kbytes = m_arguments[2].toLongLong(&bytesOk);
+        int ops = m_arguments[3].toInt(&opsOk);
+        if (!IoLimits::parseClassName(m_arguments[1], &limits.m_ioClass) || !bytesOk || !opsOk || kbytes < 0 || ops < 0)
+            return;
+
+        limits.m_bytesPerSec = kbytes * 1024;
+        limits.m_opsPerSec = ops;
+        filterP->setIoLimits(limits);
+    }
+
+    QVector<Filter *> *filtersP = m_classifier.getFilters();
+    for (int i = 0; i < filtersP->count(); i++) {
+        Filter *rootP = filtersP->at(i);
+        if (!rootP->isRoot() || (filterP && rootP != filterP))
+            continue;
+
+        IoLimits limits = rootP->getIoLimits();
+
+        QString reply;
+        reply += rootP->getVirtualDirectoryPath();
+        reply += CMD_SEPARATOR;
+        reply += IoLimits::className(limits.m_ioClass);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(limits.m_bytesPerSec / 1024);
+        reply += CMD_SEPARATOR;
+        reply += QString::number(limits.m_opsPerSec);
+        sendReply(reply);
+    }
+}
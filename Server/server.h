@@ -55,9 +55,10 @@ SION! Server is a rule based meta-indexer. It accepts the following commands:\n\
         \t'new_set' : resets the current filter set (deletes filters, clears dirty flag, resets name)\n\
         \t'filters' : lists all the installed filters\n\
         \t'directories' : lists all the directories under the given directory\n\
-        \t'add_filter:parent_filter:filter:directory:is_recursive:pluginlib_1:..:pluginlib_n' : adds/installs a new filter\n\
-        \t'modify_filter:filter:directory:recursive:plugin 1:..:plugin n' : modifies a filter\n\
+        \t'add_filter:parent_filter:filter:directory:is_recursive:pluginlib_1:..:pluginlib_n[::glob_1:..:glob_n]' : adds/installs a new filter, '+glob' keeps the matching file names only, '-glob' leaves the matching names out\n\
+        \t'modify_filter:filter:directory:recursive:plugin 1:..:plugin n[::glob_1:..:glob_n]' : modifies a filter, the globs are kept if not given\n\
         \t'get_filter_dir:filter' : returns the physical directory associated with the filter\n\
+        \t'get_filter_globs:filter' : returns the include (+) and exclude (-) globs of the filter\n\
         \t'remove_filter:filter' : removes/uninstalls an existing filter\n\
         \t'available_plugins' : lists the available plugins\n\
         \t'plugins:filter' : lists the plugins ('filename'/'title' pairs) used by a filter\n\
@@ -72,13 +73,19 @@ SION! Server is a rule based meta-indexer. It accepts the following commands:\n\
         \t'get_file_attribute_value:filter:file:attribute' : gets the value of a (filtered in) file attribute\n\
         \t'get_file:file' : gets the given file content hexadecimal representation\n\
         \t'filter_rescan:filter' : forces a full scan (cleanup +) of a filter\n\
+        \t'reevaluate_filter:filter' : runs the rules of a filter again against the stored file attributes, only the changes are saved and signaled\n\
         \t'filter_cleanup:filter' : removes (from db) the files retained by a filter\n\
         \t'filter_start:filter' : starts a filter\n\
         \t'filter_stop:filter' : stops a filter\n\
         \t'filter_is_running:filter' : returns true if the filter is running\n\
         \t'cleanup' : removes (from db) the files retained by all filters\n\
         \t'scan' : forces a full scan of the system (all filters)\n\
-        \t'rescan' : forces a full (cleanup +) rescan of the system (all filters)\n\n"
+        \t'rescan' : forces a full (cleanup +) rescan of the system (all filters)\n\
+        \t'watch_budget[:megabytes]' : sets the memory budget of the watchers (all filters), returns it and the memory used (bytes)\n\
+        \t'watch_stats[:filter]' : returns, per root filter, the directories, files, directory level tracked directories and files, and memory (bytes) its watcher uses (a watcher shared by root filters is reported for each)\n\
+        \t'scan_stats[:filter]' : returns, per root filter, its device, passes, interval, last pass and wait times, average latency (ms), yields, and last pass hot, cold, backed off and deferred directories\n\
+        \t'plugin_stats[:filter]' : returns, per filter, its plugins in the order they're checked in, each with its rules run and accepted files, and its total extraction and rule times (ms)\n\
+        \t'io_limits[:filter[:class:kbytes:ops]]' : sets the I/O class (default, besteffort or idle) and reads per second (0 for unlimited) of a root filter's watcher and indexer, returns them per root filter\n\n"
 
 class Server : public QTcpServer {
     Q_OBJECT
@@ -185,6 +192,7 @@ public slots:
                                            // the server.
 
     void    sendReply(QString reply, bool urgent = false);
+    bool    readGlobs(int first, QStringList *globsP);
 
     void    accessCommand();
     void    helpCommand();
@@ -192,6 +200,7 @@ public slots:
     void    addFilterCommand();
     void    modifyFilterCommand();
     void    getFilterDirCommand();
+    void    getFilterGlobsCommand();
     void    removeFilterCommand();
     void    filtersCommand();
     void    directoriesCommand();
@@ -208,6 +217,7 @@ public slots:
     void    cleanupFilterCommand();
     void    rescanCommand();
     void    rescanFilterCommand();
+    void    reevaluateFilterCommand();
     void    scanCommand();
     void    startFilterCommand();
     void    stopFilterCommand();
@@ -222,6 +232,11 @@ public slots:
     void    isSetDirtyCommand();
     void    setCommand();
     void    newSetCommand();
+    void    watchBudgetCommand();
+    void    watchStatsCommand();
+    void    scanStatsCommand();
+    void    pluginStatsCommand();
+    void    ioLimitsCommand();
 };
 
 #endif // SERVER_H
@@ -29,6 +29,7 @@
 #define PLUGIN_SUFFIX                           "Plugin.so"     // plugin names must end like this (and any file in the server working directory which ends like this is considered a plugin)
 #define FILTER_SET_SUFFIX                       "SION!"        	// SION! Filter set file...
 #define DB_EXTENSION                            ".DB"           // SION! Filter set Database extension
+#define WATCH_STATE_EXTENSION                   ".WS"           // SION! Filter set watchers' checkpoint extension (valid with the Database saved along)
 
 #define MAX_FILE_CHUNK_SIZE                     10240           // when exchanging files with the server, max chunk size
 
@@ -45,6 +46,7 @@
 #define MODIFY_FILTER_COMMAND                   "MODIFY_FILTER"
 #define REMOVE_FILTER_COMMAND                   "REMOVE_FILTER"
 #define GET_FILTER_DIR_COMMAND                  "GET_FILTER_DIR"
+#define GET_FILTER_GLOBS_COMMAND                "GET_FILTER_GLOBS"
 
 #define SETS_COMMAND                            "SETS"
 #define SET_COMMAND                             "SET"
@@ -72,10 +74,17 @@
 #define FILES_COMMAND                           "FILES"
 #define RESCAN_COMMAND                          "RESCAN"
 #define RESCAN_FILTER_COMMAND                   "RESCAN_FILTER"
+#define REEVALUATE_FILTER_COMMAND               "REEVALUATE_FILTER"
 #define SCAN_COMMAND                            "SCAN"
 #define CLEANUP_COMMAND                         "CLEANUP"
 #define CLEANUP_FILTER_COMMAND                  "CLEANUP_FILTER"
 
+#define WATCH_BUDGET_COMMAND                    "WATCH_BUDGET"
+#define WATCH_STATS_COMMAND                     "WATCH_STATS"
+#define SCAN_STATS_COMMAND                      "SCAN_STATS"
+#define PLUGIN_STATS_COMMAND                    "PLUGIN_STATS"
+#define IO_LIMITS_COMMAND                       "IO_LIMITS"
+
 // unexpected messages sent by the server
 #define ADD_FILE_MSG                            "ADD_FILE"
 #define DEL_FILE_MSG                            "DEL_FILE"
@@ -21,33 +21,148 @@
  */
 
 #include <QApplication>
+#include <QUrl>
+#include <QtAlgorithms>
 
 #include "watcher.h"
+#include "dirwalker.h"
 #include "qdirext.h"
 #include "qfileinfoext.h"
 
+QDataStream &operator<<(QDataStream &out, const FileState &state) {
+    out << state.m_lastModified << state.m_size << state.m_device << state.m_inode;
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, FileState &state) {
+    in >> state.m_lastModified >> state.m_size >> state.m_device >> state.m_inode;
+    return in;
+}
+
+/**
+  * Returns the index of the named file, -1 if not there.
+  */
+int CoarseDirectory::indexOf(const QString &name) const {
+    QByteArray  utf8 = name.toUtf8();
+    uint        hash = qHash(utf8);
+
+    for (QMultiHash<uint, int>::const_iterator i = m_index.constFind(hash); i != m_index.constEnd() && i.key() == hash; i++) {
+        const char *nameP = m_names.constData() + m_offsets[*i];
+        if (!qstrncmp(nameP, utf8.constData(), utf8.size() + 1))
+            return *i;
+    }
+
+    return -1;
+}
+
+/**
+  * Returns the file names, in index order.
+  */
+QStringList CoarseDirectory::names() const {
+    QStringList names;
+
+    for (int i = 0; i < count(); i++)
+        names.append(QString::fromUtf8(m_names.constData() + m_offsets[i]));
+
+    return names;
+}
+
+void CoarseDirectory::append(const QString &name, uint lastModified, qint64 size) {
+    QByteArray utf8 = name.toUtf8();
+
+    m_index.insert(qHash(utf8), count());
+    m_offsets.append(m_names.size());
+    m_names.append(utf8);
+    m_names.append('\0');
+    m_lastModified.append(lastModified);
+    m_sizes.append(size);
+}
+
+/**
+  * Removes a file, the last one takes its index. Its name is left in place until the removed
+  * names take half of the names' bytes.
+  */
+void CoarseDirectory::removeAt(int index) {
+    int last = count() - 1;
+    const char *nameP = m_names.constData() + m_offsets[index];
+
+    m_index.remove(qHash(QByteArray(nameP)), index);
+    m_garbage += qstrlen(nameP) + 1;
+
+    if (index != last) {
+        const char *lastNameP = m_names.constData() + m_offsets[last];
+        uint        hash = qHash(QByteArray(lastNameP));
+
+        m_index.remove(hash, last);
+        m_index.insert(hash, index);
+
+        m_offsets[index] = m_offsets[last];
+        m_lastModified[index] = m_lastModified[last];
+        m_sizes[index] = m_sizes[last];
+    }
+
+    m_offsets.remove(last);
+    m_lastModified.remove(last);
+    m_sizes.remove(last);
+
+    if (m_garbage > m_names.size() / 2)
+        compact();
+}
+
+/**
+  * Drops the removed names from the names' bytes.
+  */
+void CoarseDirectory::compact() {
+    QByteArray names;
+
+    names.reserve(m_names.size() - m_garbage);
+    for (int i = 0; i < count(); i++) {
+        const char *nameP = m_names.constData() + m_offsets[i];
+
+        m_offsets[i] = names.size();
+        names.append(nameP, qstrlen(nameP) + 1);
+    }
+
+    m_names = names;
+    m_garbage = 0;
+}
+
+QList<Watcher *> Watcher::m_watchers;
+ScanScheduler Watcher::m_scheduler;
+QMutex Watcher::m_budgetMutex;
+qint64 Watcher::m_memoryBudget = WATCH_MEMORY_BUDGET;
+qint64 Watcher::m_totalFootprint = 0;
+
 /**
-  * Creates a new instance of watcher thread. The watcher is not started but keeps the references
-  * to the directory to be watched, and the associated filter. The lastPass member is used to
-  * detect modification/creation of files between two passes.
+  * Creates a new instance of watcher thread, for subscribe. The watcher is not started but keeps
+  * the references to the directory to be watched. The lastPass member is used to detect
+  * modification/creation of files between two passes.
   */
-Watcher::Watcher(QString url, bool recursive, Filter *filterP) : QThread(), m_watchSem(1) {
-    m_url = url;
+Watcher::Watcher(QString url, bool recursive) : QThread(), m_files(&m_pathArena), m_newFiles(&m_pathArena), m_removedFiles(&m_pathArena) {
+    // kernel notifications and file states are only available for local directories
+    QString scheme = QUrl(url).scheme();
+    m_local = scheme.isEmpty() || scheme == "file";
+    m_url = watchedUrl(url);
+
     m_recursive = recursive;
-    m_filterP = filterP;
     m_lastPass = QDateTime::currentDateTime();
+    m_coarseFootprint = 0;
+    m_numCoarseFiles = 0;
+    m_stateFootprint = 0;
+    m_heatFootprint = 0;
+    m_fruitlessFootprint = -1;
+    m_interval = SCHEDULER_MIN_INTERVAL;
+}
 
-    // connect the activity signals/slots
-    connect(this, SIGNAL(displayActivity(QString)), filterP, SIGNAL(displayActivity(QString)));
-    connect(this, SIGNAL(displayProgress(int,int,int)), filterP, SIGNAL(displayProgress(int,int,int)));
+/**
+  * Gives the memory the watcher used back to the budget, leaves the scan schedule.
+  */
+Watcher::~Watcher() {
+    m_scheduler.removeRoot(this);
 
-    // connect the scan results signals/slots
-    connect(this, SIGNAL(fileAdded(QString)), filterP, SLOT(fileAdded(QString)));
-    connect(this, SIGNAL(fileDeleted(QString)), filterP, SLOT(fileDeleted(QString)));
-    connect(this, SIGNAL(fileModified(QString)), filterP, SLOT(fileModified(QString)));
-    connect(this, SIGNAL(directoryAdded(QString)), filterP, SLOT(directoryAdded(QString)));
-    connect(this, SIGNAL(directoryDeleted(QString)), filterP, SLOT(directoryDeleted(QString)));
-    connect(this, SIGNAL(directoryModified(QString)), filterP, SLOT(directoryModified(QString)));
+    QMutexLocker locker(&m_budgetMutex);
+
+    m_totalFootprint -= m_stats.m_footprint;
 }
 
 /**
@@ -60,14 +175,16 @@ void Watcher::getNewSubDirectories(QString root) {
     //  add new root to the list of directories
     m_newFiles.addPath(root, true);
 
+    // watch it before listing it, so we don't miss what's created meanwhile
+    addDirectoryWatch(root);
+
     // signal new directory
     directoryAdded(root);
 
-    // create a directory
-    QDirExt rootDir(root);
-
-    // get the directory entries
-    QStringList entries = rootDir.entryList();
+    // get the directory entries (only their type is needed)
+    QList<QDirExtEntry> entries;
+    QDirExt::readEntries(root, &entries);
+    IoThrottle::account(0, 1);
 
     if (entries.isEmpty())
         return;
@@ -76,18 +193,17 @@ void Watcher::getNewSubDirectories(QString root) {
     displayActivity(tr("Exploring directory %1").arg(root));
 
     // walk down recursively through the directories
-    for (QList<QString>::iterator i = entries.begin(); !m_stop && i != entries.end(); i++) {
+    for (QList<QDirExtEntry>::iterator i = entries.begin(); !m_stop && i != entries.end(); i++) {
         QString entryPath = root;
         entryPath.append(QDirExt::separator(root));
-        entryPath.append(*i);
-        QFileInfoExt entry(entryPath);
+        entryPath.append(i->m_name);
 
-        if (entry.isHidden())
+        if (i->m_isHidden)
             continue;
 
-        if (entry.isDir()) {
-            // recursively go through children dirs if required
-            if (m_recursive && !m_files.findPath(entryPath)) {
+        if (i->m_isDir) {
+            // recursively go through children dirs if required, and if they may hold a file retained
+            if (m_recursive && !m_files.findPath(entryPath) && isWalked(entryPath)) {
                 getNewSubDirectories(entryPath);
 
 #ifdef _VERBOSE_WATCHER
@@ -99,194 +215,1988 @@ void Watcher::getNewSubDirectories(QString root) {
 }
 
 /**
-  * Watches the given directory. Detects the new directories but delegates their initial inspection
-  * to the getSubDirectories method. The latter will recursively list all of their sub directories.
+  * Discovers the whole tree under root (or just root if not recursive) with a parallel walker, and
+  * adds its directories and files to the watched files as the walker hands them over. The
+  * checkpointed files found unchanged are watched without being signaled. What no subscription
+  * may retain, or what all their globs leave out, is left out by the walker.
   */
-void Watcher::watchDirectory(QString directory) {
-    if (m_stop)
+void Watcher::discover(const QString &root) {
+    DirWalker   walker(m_recursive, m_useNotifier ? &m_notifier : NULL, m_local, &m_predicate, &m_globs);
+    WalkerBatch batch;
+    int         numEntries = 0;
+
+    if (root.isEmpty() || m_stop)
         return;
 
-    // now watch all contained files
-    QDirExt rootDir(directory);
+    // give the user a hint about what's going on down here
+    displayActivity(tr("Exploring directory %1").arg(root));
+
+    walker.start(root);
 
-    // get the directory entries
-    QStringList entries = rootDir.entryList();
+    while (!m_stop && walker.nextBatch(&batch)) {
+        for (QStringList::iterator i = batch.m_directories.begin(); i != batch.m_directories.end(); i++) {
+            if (m_files.findPath(*i))
+                continue;
+
+            m_files.addPath(*i, true);
 
 #ifdef _VERBOSE_WATCHER
-    qDebug() << "Watching into " << directory;
+            qDebug() << "Detected new directory " << *i;
 #endif
+            // signal new directory
+            directoryAdded(*i);
+        }
 
-    // has the directory been removed?
-    // if so, just return, the removal signal will be sent later on.
-    QFileInfoExt entryInfo(directory);
-    if (!entryInfo.exists())
-        return;
+        for (QStringList::iterator i = batch.m_unwatchedDirectories.begin(); i != batch.m_unwatchedDirectories.end(); i++)
+            m_polledDirectories.insert(*i);
+
+        for (int i = 0; i < batch.m_files.count(); i++) {
+            QString         filepath = batch.m_files[i];
+            QDirExtEntry    &entry = batch.m_fileEntries[i];
+
+            if (m_files.findPath(filepath))
+                continue;
+
+            // signaled before the restart, and still the same?
+            bool unchanged = false;
+            bool wasSignaled = false;
+            FileStates::iterator checkpointed = m_checkpoint.find(filepath);
+            if (checkpointed != m_checkpoint.end()) {
+                unchanged = entry.m_hasStat && checkpointed->isUnchanged(FileState(entry));
+                wasSignaled = true;
+
+                FileId id(checkpointed->m_device, checkpointed->m_inode);
+                if (m_checkpointIds.value(id) == filepath)
+                    m_checkpointIds.remove(id);
+                m_checkpoint.erase(checkpointed);
+            } else if (checkMovedFile(filepath, entry, &m_files))
+                continue;
+
+            m_files.addPath(filepath);
+            recordFileState(filepath, &entry);
+
+            if (unchanged)
+                continue;
+
+            // signaled before the restart, it may be in the db: the indexer mustn't take it for new
+            if (wasSignaled) {
+                signalFileModified(entry.m_absoluteFilePath);
+                continue;
+            }
 
-    // has the directory changed since last pass?
-    if (entryInfo.lastModified() >= m_lastPass) {
 #ifdef _VERBOSE_WATCHER
-        qDebug() << "Detected modified directory " << directory;
+            qDebug() << "Detected new file " << filepath;
 #endif
-        // signal
-        directoryModified(directory);
+            // signal new file
+            signalFileAdded(entry.m_absoluteFilePath);
+        }
+
+        numEntries += batch.count();
+        displayActivity(tr("Exploring directory %1 (%2 entries)").arg(root).arg(numEntries));
+        displayProgress(0, 0, 0); // back and forth moving progress
+
+        // a directory's files all come in the same batch, it can be degraded right away
+        checkBudget();
     }
 
-    // walk through the list
-    int numNewDirs = 0;
-    for (QList<QString>::iterator i = entries.begin(); !m_stop && numNewDirs < NEW_DIRS_PER_PASS && i != entries.end(); i++) {
-        QString entryPath = directory;
-        entryPath.append(QDirExt::separator(directory));
-        entryPath.append(*i);
-        QFileInfoExt entryInfo(entryPath);
+    walker.stop();
+}
 
-        if (entryInfo.isHidden())
-            continue; // we don't care about these ones.
+/**
+  * Returns the url as watched: local directories are watched by their absolute path, which is
+  * how their files are listed and notified.
+  */
+QString Watcher::watchedUrl(const QString &url) {
+    QString scheme = QUrl(url).scheme();
 
-        if (!entryInfo.isDir()) {
-            // a regular file found
+    if ((scheme.isEmpty() || scheme == "file") && !url.isEmpty())
+        return QFileInfo(QDirExt::localPath(url)).absoluteFilePath();
 
-            // is it new?
-            if (!m_files.findPath(entryPath) && m_numWatchedFiles < MAX_WATCHED_FILES) {
-                m_newFiles.addPath(entryPath);
-                ++m_numWatchedFiles;
+    return url;
+}
 
-#ifdef _VERBOSE_PATH
-            m_newFiles.dump("file added, dumping new files");
-#endif
+/**
+  * Returns true if the watcher's tree covers the directory: the same directory (the direct
+  * children only if not recursive), or a directory below a recursively watched local one. The
+  * remote files are signaled by their local copy, remote directories are only shared as is.
+  */
+bool Watcher::covers(const QString &url, bool recursive) {
+    if (url == m_url)
+        return m_local ? m_recursive || !recursive : m_recursive == recursive;
+
+    if (!m_local || !m_recursive || url.length() <= m_url.length() || !url.startsWith(m_url))
+        return false;
+
+    return m_url.endsWith(QDir::separator()) || url[m_url.length()] == QDir::separator();
+}
 
+/**
+  * Subscribes a root filter to the changes under its directory (url), and returns the watcher it's
+  * now signaled by: the existing watcher covering the directory, or a new one. A new watcher takes
+  * the subscriptions of the watchers it covers over, and replaces them. The filter isn't started.
+  */
+Watcher *Watcher::subscribe(Filter *filterP, const QString &url, bool recursive) {
+    WatchSubscription   subscription(filterP, watchedUrl(url), recursive);
+    Watcher             *watcherP;
+
+    for (int i = 0; i < m_watchers.count(); i++) {
+        watcherP = m_watchers[i];
+
+        // it'll be caught up once started
+        if (watcherP->covers(subscription.m_url, recursive)) {
 #ifdef _VERBOSE_WATCHER
-            qDebug() << "Detected new file " << entryPath;
+            qDebug() << "Watcher shares " << watcherP->m_url << " with " << subscription.m_url;
 #endif
-                // signal new file
-                fileAdded(entryInfo.absoluteFilePath());
-            } else if (entryInfo.lastModified() >= m_lastPass) {
+            watcherP->addSubscription(subscription);
+            return watcherP;
+        }
+    }
+
+    // signaled everything the watcher discovers, the watcher's checkpoint is its own
+    watcherP = new Watcher(subscription.m_url, recursive);
+    subscription.m_live = true;
+    watcherP->addSubscription(subscription);
+
+    bool active = false;
+    for (int i = m_watchers.count(); i > 0; i--) {
+        Watcher *coveredP = m_watchers[i - 1];
+
+        if (!watcherP->covers(coveredP->m_url, coveredP->m_recursive))
+            continue;
+
 #ifdef _VERBOSE_WATCHER
-                qDebug() << "Detected modified file " << entryPath;
-#endif
-                // signal modified file
-                fileModified(entryInfo.absoluteFilePath());
-            }
-        } else {
-            // if the directory is not in the list, and doing a recursive watch, browse it.
-            if (m_recursive && !m_files.findPath(entryPath)) {
-                // go through new dir's content
-                displayProgress(0, 0, 0); // back and forth moving progress
-                getNewSubDirectories(entryPath);
-#ifdef _VERBOSE_PATH
-                m_newFiles.dump("new directory browsed, dumping new files");
+        qDebug() << "Watcher " << watcherP->m_url << " takes over " << coveredP->m_url;
 #endif
-                ++numNewDirs;
-            }
+
+        // what its subscriptions were signaled is all that's kept, they'll be caught up
+        coveredP->stopThread();
+        for (int j = 0; j < coveredP->m_subscriptions.count(); j++) {
+            WatchSubscription taken = coveredP->m_subscriptions[j];
+
+            if (taken.m_live)
+                coveredP->checkpointStates(taken, &taken.m_baseline);
+            taken.m_live = false;
+            active |= taken.m_active;
+
+            taken.m_filterP->setWatcher(watcherP);
+            watcherP->addSubscription(taken);
         }
+
+        m_watchers.removeAt(i - 1);
+        delete coveredP;
     }
+
+    m_watchers.append(watcherP);
+
+    if (active)
+        watcherP->startThread();
+
+    return watcherP;
 }
 
 /**
-  * This is the watcher thread main stuff. It iterates on watching its 'known' directories and
-  * notifying the associated filter with the directories/files changes.
+  * Unsubscribes a root filter from its watcher. The watcher is deleted along with its last
+  * subscription.
   */
-void Watcher::run() {
-    QTime                       passStart;
-    int                         numEntries = 0;
-    const QList<PathSegment *>  *pathsP = NULL;
+void Watcher::unsubscribe(Filter *filterP) {
+    Watcher *watcherP = filterP->getWatcher();
 
-    // do nothing if no root url set
-    if (m_url.isEmpty())
+    if (!watcherP)
         return;
 
-    m_stop = false;
-    m_numWatchedFiles = 0;
+    filterP->setWatcher(NULL);
 
-    // we'll start by scanning this one
-    m_files.addPath(m_url, true);
-    do {
-        passStart.restart();
+    watcherP->stopThread();
+
+    int index = watcherP->findSubscription(filterP);
+    if (index != -1) {
+        disconnect(watcherP, 0, filterP, 0);
+
+        watcherP->m_subscriptionsMutex.lock();
+        watcherP->m_subscriptions.removeAt(index);
+        watcherP->m_subscriptionsMutex.unlock();
+    }
+
+    if (watcherP->m_subscriptions.isEmpty()) {
+        m_watchers.removeAll(watcherP);
+        delete watcherP;
+        return;
+    }
+
+    watcherP->updateIoLimits();
+    watcherP->startThread();
+}
+
+int Watcher::findSubscription(Filter *filterP) {
+    for (int i = 0; i < m_subscriptions.count(); i++)
+        if (m_subscriptions[i].m_filterP == filterP)
+            return i;
+
+    return -1;
+}
+
+/**
+  * Throttles the watcher with the strictest I/O limits of its subscriptions.
+  */
+void Watcher::updateIoLimits() {
+    IoLimits limits;
+
+    for (int i = 0; i < m_subscriptions.count(); i++)
+        limits = i ? IoLimits::strictest(limits, m_subscriptions[i].m_filterP->getIoLimits()) : m_subscriptions[i].m_filterP->getIoLimits();
+
+    m_ioThrottle.setLimits(limits);
+}
+
+/**
+  * Applies the (new) predicate of the filter's rules, and its (new) globs. Unless nothing was
+  * signaled yet, the subscription is caught up once the thread restarts, against what it was
+  * signaled with the former ones: the files it doesn't accept anymore are signaled deleted, the
+  * ones it now accepts added.
+  */
+void Watcher::updatePredicate(Filter *filterP) {
+    int index = findSubscription(filterP);
+
+    if (index == -1)
+        return;
+
+    WatchPredicate predicate = filterP->getWatchPredicate();
+    GlobSet        globs = filterP->getGlobs();
+    if (predicate == m_subscriptions[index].m_predicate && globs == m_subscriptions[index].m_globs)
+        return;
+
+    stopThread();
+
+    m_subscriptionsMutex.lock();
+
+    WatchSubscription &subscription = m_subscriptions[index];
+    if (subscription.m_live && !m_files.isEmpty()) {
+        checkpointStates(subscription, &subscription.m_baseline);
+        subscription.m_live = false;
+    }
+    subscription.m_predicate = predicate;
+    subscription.m_globs = globs;
+
+    m_subscriptionsMutex.unlock();
 
 #ifdef _VERBOSE_WATCHER
-        qDebug() << "(File)Watcher does a pass at " << passStart;
+    qDebug() << "Watcher " << m_url << " predicate for " << subscription.m_url << " is " << predicate.toString();
 #endif
-        // now, don't let the filter play concurrently
-        if (!tryAcquireWatchSemaphore())
-            goto nextPass;
 
-        // check for new or modified files/directories
-        pathsP = m_files.getPaths(true);
-        numEntries = pathsP->count();
-        for (int i = 0; !m_stop && i < numEntries; i++) {
-            QString filepath = pathsP->at(i)->getPath();
+    startThread();
+}
+
+/**
+  * Has a subscription's filter check all its files against its modified rules: the files it
+  * retains were checked again from their stored attributes (see Filter::reevaluate), the other
+  * files it accepts are signaled as added by the catch up, its former rules rejected them or its
+  * former predicate left them out. Its predicate and globs are updated meanwhile.
+  */
+void Watcher::recheck(Filter *filterP) {
+    int index = findSubscription(filterP);
+
+    if (index == -1)
+        return;
+
+    stopThread();
+
+    m_subscriptionsMutex.lock();
+
+    WatchSubscription &subscription = m_subscriptions[index];
+    if (subscription.m_live) {
+        checkpointStates(subscription, &subscription.m_baseline);
+        subscription.m_live = false;
+    }
+    subscription.m_predicate = filterP->getWatchPredicate();
+    subscription.m_globs = filterP->getGlobs();
+
+    // the files it rejected weren't stored, they're signaled again
+    for (FileStates::iterator i = subscription.m_baseline.begin(); i != subscription.m_baseline.end(); ) {
+        if (filterP->isRetained(i.key()))
+            i++;
+        else
+            i = subscription.m_baseline.erase(i);
+    }
+
+    m_subscriptionsMutex.unlock();
+
+    startThread();
+}
+
+void Watcher::addSubscription(const WatchSubscription &subscription) {
+    Filter *filterP = subscription.m_filterP;
+
+    // connect the activity signals/slots
+    connect(this, SIGNAL(displayActivity(QString)), filterP, SIGNAL(displayActivity(QString)));
+    connect(this, SIGNAL(displayProgress(int,int,int)), filterP, SIGNAL(displayProgress(int,int,int)));
+    connect(this, SIGNAL(directoryAdded(QString)), filterP, SLOT(directoryAdded(QString)));
+    connect(this, SIGNAL(directoryDeleted(QString)), filterP, SLOT(directoryDeleted(QString)));
+    connect(this, SIGNAL(directoryModified(QString)), filterP, SLOT(directoryModified(QString)));
+
+    QMutexLocker locker(&m_subscriptionsMutex);
+
+    m_subscriptions.append(subscription);
+    m_subscriptions.last().m_whole = subscription.m_url == m_url && subscription.m_recursive == m_recursive;
+    m_subscriptions.last().m_predicate = filterP->getWatchPredicate();
+    m_subscriptions.last().m_globs = filterP->getGlobs();
+
+    locker.unlock();
+
+    updateIoLimits();
+}
+
+/**
+  * Starts the thread if a subscription is active. The inactive subscriptions won't be signaled
+  * what changes from now on: the files they were signaled are kept, to catch them up later.
+  */
+void Watcher::startThread() {
+    if (isRunning())
+        return;
+
+    QMutexLocker locker(&m_subscriptionsMutex);
 
-            // show progress
-            displayActivity(tr("Scanning directory %1").arg(filepath));
-            displayProgress(0, numEntries - 1, i);
+    bool active = false;
+    bool live = false;
+    WatchPredicate predicate = WatchPredicate::none();
+    GlobSet globs;
+    QStringList urls;
+    for (int i = 0; i < m_subscriptions.count(); i++) {
+        WatchSubscription &subscription = m_subscriptions[i];
 
-            watchDirectory(filepath);
+        if (!subscription.m_active && subscription.m_live) {
+            checkpointStates(subscription, &subscription.m_baseline);
+            subscription.m_live = false;
         }
 
-        // add the new files and directories to the watch lists
-#ifdef _VERBOSE_PATH
-        m_files.dump("dumping watched files before merging");
-        m_newFiles.dump("dumping new files before merging");
-#endif
+        active |= subscription.m_active;
+        live |= subscription.m_live;
 
-        m_files.merge(&m_newFiles);
-        m_newFiles.deleteAll();
+        // the inactive subscriptions are caught up from the watched files too
+        predicate = predicate.united(subscription.m_predicate);
+        globs = i ? GlobSet::common(globs, subscription.m_globs) : subscription.m_globs;
+        urls.append(subscription.m_url);
+    }
 
-#ifdef _VERBOSE_PATH
-        m_files.dump("dumping watched files after merging");
-        m_newFiles.dump("dumping new files after merging");
-#endif
+    // the subscribed directories are walked down whatever their name
+    m_predicate = predicate;
+    m_globs = globs;
+    m_globs.setKeptDirectories(urls);
+
+    if (!active)
+        return;
 
-        // now check if any of the watched files have disappeared
+    // the checkpoint is what the live subscriptions were signaled before a restart
+    if (!live) {
+        m_checkpoint.clear();
+        m_checkpointIds.clear();
+    }
 
-        // check removed directories
-        for (QList<PathSegment *>::const_iterator i = m_files.getPaths(true)->begin(); i != m_files.getPaths(true)->end(); i++) {
-            QString filepath = (*i)->getPath();
-            QFileInfoExt entryInfo(filepath);
-            if (!entryInfo.exists()) {
-                // we DO NOT need to check the content and signal for everything...
-                // because the content will be checked later on...
 #ifdef _VERBOSE_WATCHER
-                qDebug() << "Detected deleted directory " << filepath;
+    qDebug() << "WATCHER START!";
 #endif
-                directoryDeleted(filepath);
-                m_removedFiles.addPath(filepath, true);
-            }
-        }
 
-        // check removed files
-        for (QList<PathSegment *>::const_iterator i = m_files.getPaths()->begin(); !m_stop && i != m_files.getPaths()->end(); i++) {
-            QString filepath = (*i)->getPath();
-            QFileInfoExt entryInfo(filepath);
-            if (!entryInfo.exists()) {
+    m_stop = false;
+    QThread::start(IdlePriority);
+}
+
+/**
+  * Stops the thread, and blocks until it exits.
+  */
+void Watcher::stopThread() {
+    if (!isRunning())
+        return;
+
 #ifdef _VERBOSE_WATCHER
-                qDebug() << "Detected deleted file " << filepath;
+    qDebug() << "WATCHER STOP!";
 #endif
-//              fileDeleted(filepath);
-                fileDeleted(entryInfo.absoluteFilePath());
-                m_removedFiles.addPath(filepath);
-                --m_numWatchedFiles;
-            }
-        }
 
-        // and remove
+    m_stop = true;
+    m_notifier.wakeUp();
 
-        // directories
-        for (QList<PathSegment *>::const_iterator i = m_removedFiles.getPaths(true)->begin(); i != m_removedFiles.getPaths(true)->end(); i++)
-            m_files.deletePath((*i)->getPath(), true);
+    // it may be blocked signaling a filter whose indexer's queue is full
+    while (!wait(WATCH_STOP_INTERVAL))
+        interruptSignals();
+}
 
-        // files
-        for (QList<PathSegment *>::const_iterator i = m_removedFiles.getPaths()->begin(); !m_stop && i != m_removedFiles.getPaths()->end(); i++)
-            m_files.deletePath((*i)->getPath());
+/**
+  * Unblocks the thread signaling a change to a filter whose indexer's queue is full.
+  */
+void Watcher::interruptSignals() {
+    QMutexLocker locker(&m_subscriptionsMutex);
 
-        m_removedFiles.deleteAll();
+    for (int i = 0; i < m_subscriptions.count(); i++)
+        m_subscriptions[i].m_filterP->interruptIndexing();
+}
 
-        // keep last pass time
-        m_lastPass = QDateTime::currentDateTime();
+/**
+  * Starts signaling the filter (again). Missing changes, it's caught up first: the thread is
+  * restarted for that if running.
+  */
+void Watcher::start(Filter *filterP) {
+    int index = findSubscription(filterP);
+
+    if (index == -1 || m_subscriptions[index].m_active)
+        return;
+
+    if (!m_subscriptions[index].m_live)
+        stopThread();
+
+    m_subscriptionsMutex.lock();
+    m_subscriptions[index].m_active = true;
+    m_subscriptionsMutex.unlock();
+
+    startThread();
+}
+
+/**
+  * Stops signaling the filter, nothing is signaled to it anymore once this returns. The thread
+  * keeps running if other subscriptions are active.
+  */
+void Watcher::stop(Filter *filterP) {
+    int index = findSubscription(filterP);
+
+    if (index == -1 || !m_subscriptions[index].m_active)
+        return;
+
+    stopThread();
+
+    m_subscriptionsMutex.lock();
+    m_subscriptions[index].m_active = false;
+    m_subscriptionsMutex.unlock();
+
+    startThread();
+}
 
-        // now, the filter can play
-        releaseWatchSemaphore();
+/**
+  * Signals the filter all the watched files under its directory again, as added, once the thread
+  * (re)starts.
+  */
+void Watcher::resync(Filter *filterP) {
+    int index = findSubscription(filterP);
+
+    if (index == -1)
+        return;
+
+    stopThread();
+
+    m_subscriptionsMutex.lock();
+    m_subscriptions[index].m_live = false;
+    m_subscriptions[index].m_baseline.clear();
+    m_subscriptionsMutex.unlock();
+
+    startThread();
+}
+
+bool Watcher::isActive(Filter *filterP) {
+    int index = findSubscription(filterP);
+
+    return index != -1 && m_subscriptions[index].m_active;
+}
+
+/**
+  * Catches the active subscriptions which missed changes up, once the discovery is over: the
+  * watched files under their directory which they accept are compared with the files they were
+  * signaled, and signaled as added, modified or deleted. Nothing is listed. A subscription whose
+  * catch up is stopped is caught up again next time.
+  */
+void Watcher::catchUp() {
+    for (int i = 0; !m_stop && i < m_subscriptions.count(); i++) {
+        m_subscriptionsMutex.lock();
+        WatchSubscription subscription = m_subscriptions[i];
+        m_subscriptionsMutex.unlock();
+
+        if (!subscription.m_active || subscription.m_live)
+            continue;
+
+        Filter      *filterP = subscription.m_filterP;
+        FileStates  baseline = subscription.m_baseline;
+        FileStates  coarseStates;
+        QStringList directories;
+        QStringList files;
+
+        displayActivity(tr("Catching up %1").arg(subscription.m_url));
+
+        m_files.getSubPaths(subscription.m_url, subscription.m_recursive, &directories, &files);
+
+        for (QHash<QString, CoarseDirectory>::const_iterator j = m_coarseDirectories.constBegin(); j != m_coarseDirectories.constEnd(); j++) {
+            QStringList names = j->names();
+
+            for (int k = 0; k < names.count(); k++) {
+                QString path = j.key() + QDirExt::separator(j.key()) + names[k];
+
+                if (!subscription.covers(path))
+                    continue;
+
+                FileState state;
+                state.m_lastModified = QDateTime::fromTime_t(j->m_lastModified[k]);
+                state.m_size = j->m_sizes[k];
+
+                files.append(path);
+                coarseStates.insert(path, state);
+            }
+        }
+
+        for (int j = 0; !m_stop && j < files.count(); j++) {
+            QString path = files[j];
+
+            // not signaled, or signaled deleted below if it was
+            qint64 size = coarseStates.contains(path) ? coarseStates.value(path).m_size : knownSize(path);
+            if (!subscription.retains(path, size))
+                continue;
+
+            // the remote files are signaled by their local copy
+            if (!m_local) {
+                QDirExtEntry entry;
+                IoThrottle::account(0, 1);
+                if (QDirExt::readEntry(path, &entry))
+                    path = entry.m_absoluteFilePath;
+
+                filterP->fileAdded(path);
+                continue;
+            }
+
+            FileStates::iterator known = baseline.find(path);
+            if (known == baseline.end()) {
+                filterP->fileAdded(path);
+                continue;
+            }
+
+            // a file whose state is unknown was signaled as modified
+            FileStates::const_iterator state = m_fileStates.constFind(path);
+            bool unchanged = state != m_fileStates.constEnd() && known->isUnchanged(*state);
+
+            if (coarseStates.contains(path))
+                unchanged = known->isUnchanged(coarseStates.value(path));
+
+            if (!unchanged)
+                filterP->fileModified(path);
+
+            baseline.erase(known);
+        }
+
+        if (m_stop)
+            return;
+
+        // signaled, not watched anymore
+        for (FileStates::const_iterator j = baseline.constBegin(); j != baseline.constEnd(); j++)
+            filterP->fileDeleted(j.key());
+
+#ifdef _VERBOSE_WATCHER
+        qDebug() << "Watcher caught " << subscription.m_url << " up (" << files.count() << " files)";
+#endif
+
+        m_subscriptionsMutex.lock();
+        m_subscriptions[i].m_live = true;
+        m_subscriptions[i].m_baseline.clear();
+        m_subscriptionsMutex.unlock();
+    }
+}
+
+/**
+  * Returns the size of a watched file as last signaled, -1 if unknown.
+  */
+qint64 Watcher::knownSize(const QString &path) {
+    FileStates::const_iterator state = m_fileStates.constFind(path);
+
+    return state != m_fileStates.constEnd() ? state->m_size : -1;
+}
+
+/**
+  * Returns true if a file found new may be retained by a subscription, and must be watched.
+  */
+bool Watcher::isWanted(const QString &path, const QDirExtEntry &entry) {
+    return m_predicate.acceptsFile(path, entry.m_hasStat ? entry.m_size : -1) && !m_globs.excludesFile(path);
+}
+
+/**
+  * Returns true if a directory found new may hold a file retained by a subscription, and must be
+  * walked down.
+  */
+bool Watcher::isWalked(const QString &directory) {
+    return m_predicate.acceptsDirectory(directory) && !m_globs.excludesDirectory(directory);
+}
+
+/**
+  * Signals a file change to the live subscriptions covering it and accepting it, from the watcher
+  * thread straight to their filter's indexer. A move is signaled as a deletion or an addition to
+  * the subscriptions accepting only one of its ends, a modified file which isn't accepted anymore
+  * (its size) as a deletion. The deletions are signaled whatever the predicate.
+  *
+  * The filters are signaled once the subscriptions mutex is released: they block while their
+  * indexer's queue is full. The subscriptions are only removed with the thread stopped.
+  */
+void Watcher::signalFileAdded(const QString &path) {
+    QList<Filter *> added;
+    qint64          size = knownSize(path);
+
+    m_subscriptionsMutex.lock();
+    for (int i = 0; i < m_subscriptions.count(); i++)
+        if (m_subscriptions[i].m_live && m_subscriptions[i].accepts(path, size))
+            added.append(m_subscriptions[i].m_filterP);
+    m_subscriptionsMutex.unlock();
+
+    for (int i = 0; i < added.count(); i++)
+        added[i]->fileAdded(path);
+}
+
+void Watcher::signalFileDeleted(const QString &path) {
+    QList<Filter *> deleted;
+
+    m_subscriptionsMutex.lock();
+    for (int i = 0; i < m_subscriptions.count(); i++)
+        if (m_subscriptions[i].m_live && m_subscriptions[i].covers(path))
+            deleted.append(m_subscriptions[i].m_filterP);
+    m_subscriptionsMutex.unlock();
+
+    for (int i = 0; i < deleted.count(); i++)
+        deleted[i]->fileDeleted(path);
+}
+
+void Watcher::signalFileModified(const QString &path) {
+    QList<Filter *> modified;
+    QList<Filter *> deleted;
+    qint64          size = knownSize(path);
+
+    m_subscriptionsMutex.lock();
+    for (int i = 0; i < m_subscriptions.count(); i++) {
+        const WatchSubscription &subscription = m_subscriptions[i];
+
+        if (!subscription.m_live || !subscription.covers(path))
+            continue;
+
+        if (subscription.retains(path, size))
+            modified.append(subscription.m_filterP);
+        else if (subscription.retains(path, -1))
+            deleted.append(subscription.m_filterP);
+    }
+    m_subscriptionsMutex.unlock();
+
+    for (int i = 0; i < modified.count(); i++)
+        modified[i]->fileModified(path);
+    for (int i = 0; i < deleted.count(); i++)
+        deleted[i]->fileDeleted(path);
+}
+
+void Watcher::signalFileMoved(const QString &oldPath, const QString &path) {
+    QList<Filter *> moved;
+    QList<Filter *> deleted;
+    QList<Filter *> added;
+
+    // the file may have been signaled with another size
+    qint64 size = knownSize(path);
+
+    m_subscriptionsMutex.lock();
+    for (int i = 0; i < m_subscriptions.count(); i++) {
+        const WatchSubscription &subscription = m_subscriptions[i];
+
+        if (!subscription.m_live)
+            continue;
+
+        bool from = subscription.accepts(oldPath, -1);
+        bool to = subscription.accepts(path, size);
+
+        if (from && to)
+            moved.append(subscription.m_filterP);
+        else if (from)
+            deleted.append(subscription.m_filterP);
+        else if (to)
+            added.append(subscription.m_filterP);
+    }
+    m_subscriptionsMutex.unlock();
+
+    for (int i = 0; i < moved.count(); i++)
+        moved[i]->fileMoved(oldPath, path);
+    for (int i = 0; i < deleted.count(); i++)
+        deleted[i]->fileDeleted(oldPath);
+    for (int i = 0; i < added.count(); i++)
+        added[i]->fileAdded(path);
+}
+
+/**
+  * Signals the deletion of the checkpointed files the discovery didn't find again: they were
+  * deleted while the watcher wasn't running.
+  */
+void Watcher::removeMissingCheckpointedFiles() {
+    for (FileStates::const_iterator i = m_checkpoint.constBegin(); i != m_checkpoint.constEnd(); i++) {
+#ifdef _VERBOSE_WATCHER
+        qDebug() << "Checkpointed file is gone " << i.key();
+#endif
+        signalFileDeleted(i.key());
+    }
+
+    m_checkpoint.clear();
+    m_checkpointIds.clear();
+}
+
+/**
+  * Keeps the state of a (local) file being signaled, from its listing entry or stat'ed if none
+  * is given.
+  */
+void Watcher::recordFileState(const QString &path, const QDirExtEntry *entryP) {
+    QDirExtEntry entry;
+
+    if (!m_local)
+        return;
+
+    if (!entryP) {
+        IoThrottle::account(0, 1);
+        if (QDirExt::readEntry(path, &entry))
+            entryP = &entry;
+    }
+
+    forgetFileState(path);
+
+    // unknown, it will be signaled again after a restart
+    if (!entryP || !entryP->m_hasStat)
+        return;
+
+    m_fileStates.insert(path, FileState(*entryP));
+    m_stateFootprint += path.capacity() * sizeof(QChar) + WATCH_FILE_STATE_OVERHEAD;
+    if (entryP->m_inode)
+        m_fileIds.insert(FileId(entryP->m_device, entryP->m_inode), path);
+
+    warmDirectory(path, entryP->m_lastModified.toTime_t());
+}
+
+/**
+  * Drops the state of a file not watched anymore (or about to be recorded again).
+  */
+void Watcher::forgetFileState(const QString &path) {
+    FileStates::iterator i = m_fileStates.find(path);
+    if (i == m_fileStates.end())
+        return;
+
+    // several links to the same file may be watched, only the last one recorded is known by id
+    FileId id(i->m_device, i->m_inode);
+    if (m_fileIds.value(id) == path)
+        m_fileIds.remove(id);
+
+    m_stateFootprint -= i.key().capacity() * sizeof(QChar) + WATCH_FILE_STATE_OVERHEAD;
+    m_fileStates.erase(i);
+
+    coolDirectory(path);
+}
+
+/**
+  * Accounts a file state recorded in its directory's heat.
+  */
+void Watcher::warmDirectory(const QString &path, uint lastModified) {
+    QString directory = path.left(path.lastIndexOf(QDir::separator()));
+
+    QHash<QString, DirectoryHeat>::iterator heat = m_directoryHeat.find(directory);
+    if (heat == m_directoryHeat.end()) {
+        heat = m_directoryHeat.insert(directory, DirectoryHeat());
+        heat->m_newest = lastModified;
+        m_coldDirectories.insert(qMakePair(lastModified, directory), true);
+        m_heatFootprint += directory.capacity() * sizeof(QChar) + WATCH_DIR_HEAT_BYTES;
+    } else if (heat->m_newest < lastModified) {
+        m_coldDirectories.remove(qMakePair(heat->m_newest, directory));
+        heat->m_newest = lastModified;
+        m_coldDirectories.insert(qMakePair(lastModified, heat.key()), true);
+    }
+
+    heat->m_numFiles++;
+}
+
+/**
+  * Accounts a file state forgotten in its directory's heat, forgets the directory's heat once none
+  * of its files has a state.
+  */
+void Watcher::coolDirectory(const QString &path) {
+    QString directory = path.left(path.lastIndexOf(QDir::separator()));
+
+    QHash<QString, DirectoryHeat>::iterator heat = m_directoryHeat.find(directory);
+    if (heat != m_directoryHeat.end() && !--heat->m_numFiles)
+        forgetDirectoryHeat(directory);
+}
+
+void Watcher::forgetDirectoryHeat(const QString &directory) {
+    QHash<QString, DirectoryHeat>::iterator heat = m_directoryHeat.find(directory);
+    if (heat == m_directoryHeat.end())
+        return;
+
+    m_coldDirectories.remove(qMakePair(heat->m_newest, directory));
+    m_heatFootprint -= heat.key().capacity() * sizeof(QChar) + WATCH_DIR_HEAT_BYTES;
+    m_directoryHeat.erase(heat);
+}
+
+/**
+  * Checks whether a file found new is a watched (or checkpointed) file moved there: it has the
+  * same identity, and the old path doesn't lead to it anymore. If so, the file is moved in the
+  * watched files (added to filesP) and fileMoved is signaled, followed by fileModified if the
+  * file changed too.
+  */
+bool Watcher::checkMovedFile(const QString &path, const QDirExtEntry &entry, PathSet *filesP) {
+    if (!m_local || !entry.m_hasStat || !entry.m_inode)
+        return false;
+
+    FileId  id(entry.m_device, entry.m_inode);
+    QString oldPath = m_fileIds.value(id);
+    bool    checkpointed = oldPath.isEmpty();
+
+    if (checkpointed)
+        oldPath = m_checkpointIds.value(id);
+
+    if (oldPath.isEmpty() || oldPath == path)
+        return false;
+
+    // still there, this is another link to the file
+    QDirExtEntry oldEntry;
+    IoThrottle::account(0, 1);
+    if (QDirExt::readEntry(oldPath, &oldEntry) && FileId(oldEntry.m_device, oldEntry.m_inode) == id)
+        return false;
+
+    FileState oldState;
+    if (checkpointed) {
+        // it wasn't watched yet
+        oldState = m_checkpoint.take(oldPath);
+        m_checkpointIds.remove(id);
+    } else {
+        oldState = m_fileStates.value(oldPath);
+        forgetFileState(oldPath);
+        if (!m_files.deletePath(oldPath))
+            m_newFiles.deletePath(oldPath); // found earlier in the same pass
+    }
+
+    filesP->addPath(path);
+    recordFileState(path, &entry);
+
+#ifdef _VERBOSE_WATCHER
+    qDebug() << "Detected moved file " << oldPath << " -> " << path;
+#endif
+    signalFileMoved(oldPath, path);
+
+    if (oldState != FileState(entry))
+        signalFileModified(entry.m_absoluteFilePath);
+
+    return true;
+}
+
+/**
+  * Returns the filter's url and the states of the files it was signaled, to be given back to
+  * setCheckpoint after a restart. Call while the filter is stopped.
+  */
+void Watcher::getCheckpoint(Filter *filterP, QString *urlP, FileStates *statesP) {
+    QMutexLocker locker(&m_subscriptionsMutex);
+
+    statesP->clear();
+
+    int index = findSubscription(filterP);
+    if (index == -1)
+        return;
+
+    const WatchSubscription &subscription = m_subscriptions[index];
+
+    *urlP = subscription.m_url;
+
+    if (subscription.m_live)
+        checkpointStates(subscription, statesP);
+    else if (!subscription.m_checkpointInvalid)
+        *statesP = subscription.m_baseline;
+}
+
+/**
+  * Returns the states of the files signaled to a live subscription: the watched files under its
+  * directory which it accepts, as the thread (stopped) last saw them. The files modified too
+  * recently for their mtime to tell a later change are left out, they'll be signaled again.
+  */
+void Watcher::checkpointStates(const WatchSubscription &subscription, FileStates *statesP) {
+    QDateTime recent = QDateTime::currentDateTime().addSecs(-WATCH_MTIME_GRANULARITY);
+
+    statesP->clear();
+
+    if (subscription.m_checkpointInvalid)
+        return;
+
+    // the checkpointed files not discovered yet (the watcher was stopped meanwhile) are still valid
+    for (FileStates::const_iterator i = m_checkpoint.constBegin(); i != m_checkpoint.constEnd(); i++)
+        if (subscription.accepts(i.key(), i->m_size))
+            statesP->insert(i.key(), *i);
+
+    // the files it doesn't accept weren't signaled to it, or were signaled deleted
+    for (FileStates::const_iterator i = m_fileStates.constBegin(); i != m_fileStates.constEnd(); i++) {
+        if (!subscription.covers(i.key()))
+            continue;
+
+        if (i->m_lastModified < recent && subscription.retains(i.key(), i->m_size))
+            statesP->insert(i.key(), *i);
+        else
+            statesP->remove(i.key());
+    }
+
+    // the files tracked at the directory level, their identity isn't known
+    for (QHash<QString, CoarseDirectory>::const_iterator i = m_coarseDirectories.constBegin(); i != m_coarseDirectories.constEnd(); i++) {
+        QStringList names = i->names();
+
+        for (int j = 0; j < names.count(); j++) {
+            QString     path = i.key() + QDirExt::separator(i.key()) + names[j];
+            FileState   state;
+
+            if (!subscription.covers(path))
+                continue;
+
+            state.m_lastModified = QDateTime::fromTime_t(i->m_lastModified[j]);
+            state.m_size = i->m_sizes[j];
+
+            if (state.m_lastModified < recent && subscription.retains(path, state.m_size))
+                statesP->insert(path, state);
+            else
+                statesP->remove(path);
+        }
+    }
+}
+
+/**
+  * Sets the states of the files the filter was signaled before a restart (by getCheckpoint).
+  * Ignored if it was for another url, or if the filter was signaled files since.
+  */
+void Watcher::setCheckpoint(Filter *filterP, const QString &url, const FileStates &states) {
+    int index = findSubscription(filterP);
+
+    if (!m_local || index == -1 || url != m_subscriptions[index].m_url)
+        return;
+
+    QMutexLocker locker(&m_subscriptionsMutex);
+
+    // it'll be caught up against it
+    if (!m_subscriptions[index].m_live) {
+        m_subscriptions[index].m_baseline = states;
+        return;
+    }
+
+    // the discovery will only signal it what changed since
+    if (isRunning() || !m_files.isEmpty())
+        return;
+
+    m_checkpoint = states;
+
+    m_checkpointIds.clear();
+    for (FileStates::const_iterator i = m_checkpoint.constBegin(); i != m_checkpoint.constEnd(); i++)
+        if (i->m_inode)
+            m_checkpointIds.insert(FileId(i->m_device, i->m_inode), i.key());
+}
+
+/**
+  * The db was cleaned up, the files signaled to the filter aren't indexed anymore.
+  */
+void Watcher::invalidateCheckpoint(Filter *filterP) {
+    QMutexLocker locker(&m_subscriptionsMutex);
+
+    int index = findSubscription(filterP);
+    if (index == -1)
+        return;
+
+    m_subscriptions[index].m_checkpointInvalid = true;
+    m_subscriptions[index].m_baseline.clear();
+}
+
+/**
+  * Returns true if the (local) directory wasn't modified since it was last listed: no entry was
+  * added, removed or renamed in there. Always false on full checks.
+  */
+bool Watcher::isDirectoryUnchanged(const QString &directory, const QDateTime &lastModified) {
+    if (!m_local || m_fullCheck)
+        return false;
+
+    QHash<QString, DirState>::const_iterator i = m_directoryStates.constFind(directory);
+    if (i == m_directoryStates.constEnd())
+        return false;
+
+    // a change done within the same second as the listing may not show in the (coarse) mtime
+    return i->m_lastModified == lastModified && i->m_lastModified.secsTo(i->m_listed) > WATCH_MTIME_GRANULARITY;
+}
+
+/**
+  * Watches the given directory. Detects the new directories but delegates their initial inspection
+  * to the getSubDirectories method. The latter will recursively list all of their sub directories.
+  *
+  * The directories which didn't change since they were last listed are skipped. Files rewritten
+  * in place don't touch their directory though, so these are only detected on full checks.
+  */
+void Watcher::watchDirectory(QString directory) {
+    if (m_stop)
+        return;
+
+#ifdef _VERBOSE_WATCHER
+    qDebug() << "Watching into " << directory;
+#endif
+
+    // has the directory been removed?
+    // if so, just return, the removal signal will be sent later on.
+    QFileInfoExt entryInfo(directory);
+    if (!entryInfo.exists())
+        return;
+
+    // cold directories aren't looked at every pass, what changed since they were last listed is new
+    QHash<QString, DirState>::iterator previousState = m_directoryStates.find(directory);
+    bool        listedBefore = previousState != m_directoryStates.end();
+    QDateTime   since = listedBefore ? previousState->m_listed.addSecs(-WATCH_MTIME_GRANULARITY) : m_lastPass;
+    int         unchangedPasses = listedBefore ? previousState->m_unchangedPasses : 0;
+
+    // has the directory changed since last pass?
+    QDateTime lastModified = entryInfo.lastModified();
+    if (lastModified >= since) {
+#ifdef _VERBOSE_WATCHER
+        qDebug() << "Detected modified directory " << directory;
+#endif
+        // signal
+        directoryModified(directory);
+    }
+
+    // nothing to find in there, the directory cools down
+    if (isDirectoryUnchanged(directory, lastModified)) {
+        ++previousState->m_unchangedPasses;
+        previousState->m_lastListedPass = m_numPasses;
+        return;
+    }
+
+    // get the directory entries (once stat'ed, so a change made meanwhile shows next pass), with
+    // their type and modification time
+    QList<QDirExtEntry> entries;
+    QStringList         names;
+
+    QDirExt::readEntries(directory, &entries, true);
+    IoThrottle::account(0, 1 + entries.count());
+    m_scheduler.listed(this);
+    for (QList<QDirExtEntry>::iterator i = entries.begin(); i != entries.end(); i++)
+        names.append(i->m_name);
+
+    // keep what the directory looks like
+    DirState state;
+    state.m_lastModified = lastModified;
+    state.m_listed = QDateTime::currentDateTime();
+    state.m_numEntries = names.count();
+    state.m_lastListedPass = m_numPasses;
+    for (QStringList::iterator i = names.begin(); i != names.end(); i++)
+        state.m_fingerprint ^= qHash(*i);
+
+    // if entries were renamed or removed since the last listing, those we watch are gone
+    bool namesChanged = !listedBefore ||
+                        previousState->m_numEntries != state.m_numEntries ||
+                        previousState->m_fingerprint != state.m_fingerprint;
+    if (namesChanged || m_fullCheck)
+        checkDeletedEntries(directory, names);
+
+    // anything signaled, or never listed, keeps the directory hot
+    bool changed = namesChanged;
+
+    // the files of a directory tracked at the directory level are told from the whole listing
+    bool coarse = m_coarseDirectories.contains(directory);
+    if (coarse && checkCoarseDirectory(directory, entries))
+        changed = true;
+
+    // walk through the list
+    bool deferred = false; // new sub directories were left for later
+    QList<QDirExtEntry>::iterator i;
+    for (i = entries.begin(); !m_stop && i != entries.end(); i++) {
+        QDirExtEntry &entryInfo = *i;
+        QString entryPath = directory;
+        entryPath.append(QDirExt::separator(directory));
+        entryPath.append(entryInfo.m_name);
+
+        if (entryInfo.m_isHidden)
+            continue; // we don't care about these ones.
+
+        if (!entryInfo.m_isDir) {
+            // a regular file found
+            if (coarse)
+                continue;
+
+            // is it new?
+            bool watched = m_files.findPath(entryPath);
+
+            // no subscription may retain it
+            if (!watched && !isWanted(entryPath, entryInfo))
+                continue;
+
+            // or moved from another watched place?
+            if (!watched && checkMovedFile(entryPath, entryInfo, &m_newFiles)) {
+                changed = true;
+                continue;
+            }
+
+            if (!watched) {
+                m_newFiles.addPath(entryPath);
+                recordFileState(entryPath, &entryInfo);
+
+#ifdef _VERBOSE_PATH
+            m_newFiles.dump("file added, dumping new files");
+#endif
+
+#ifdef _VERBOSE_WATCHER
+            qDebug() << "Detected new file " << entryPath;
+#endif
+                // signal new file
+                signalFileAdded(entryInfo.m_absoluteFilePath);
+                changed = true;
+                continue;
+            }
+
+            // the recorded state tells, else its mtime
+            FileStates::const_iterator recorded = m_fileStates.constFind(entryPath);
+            bool modified = recorded != m_fileStates.constEnd() && entryInfo.m_hasStat ?
+                            *recorded != FileState(entryInfo) :
+                            entryInfo.m_lastModified >= since;
+
+            if (modified) {
+#ifdef _VERBOSE_WATCHER
+                qDebug() << "Detected modified file " << entryPath;
+#endif
+                recordFileState(entryPath, &entryInfo);
+
+                // signal modified file
+                signalFileModified(entryInfo.m_absoluteFilePath);
+                changed = true;
+            }
+        } else {
+            // if the directory is not in the list, and doing a recursive watch, browse it (unless
+            // no file in there may be retained)
+            if (m_recursive && !m_files.findPath(entryPath) && isWalked(entryPath)) {
+                // out of slice, the directory will be listed again
+                if (mustYield()) {
+                    deferred = true;
+                    continue;
+                }
+
+                // go through new dir's content
+                displayProgress(0, 0, 0); // back and forth moving progress
+                getNewSubDirectories(entryPath);
+#ifdef _VERBOSE_PATH
+                m_newFiles.dump("new directory browsed, dumping new files");
+#endif
+                changed = true;
+            }
+        }
+    }
+
+    if (changed)
+        m_pass.m_changed = true;
+
+    // the directory can be skipped until it changes, unless some entries weren't handled
+    if (!deferred && i == entries.end()) {
+        state.m_unchangedPasses = changed ? 0 : unchangedPasses + 1;
+        m_directoryStates.insert(directory, state);
+        return;
+    }
+
+    m_directoryStates.remove(directory);
+
+    // a directory watched by the notifier wouldn't be listed again unless it changes
+    if (deferred) {
+        ++m_pass.m_numDeferred;
+        if (m_useNotifier)
+            m_polledDirectories.insert(directory);
+    }
+}
+
+/**
+  * Compares the watched entries of a directory with its listing. The missing ones are added to
+  * m_removedFiles, see removeDeletedEntries.
+  */
+void Watcher::checkDeletedEntries(const QString &directory, const QStringList &entries) {
+    QSet<QString>   names = entries.toSet();
+    QStringList     subDirectories;
+    QStringList     files;
+
+    m_files.getSubPaths(directory, false, &subDirectories, &files);
+
+    for (QStringList::iterator i = files.begin(); i != files.end(); i++)
+        if (!names.contains(i->mid(i->lastIndexOf(QDir::separator()) + 1)))
+            m_removedFiles.addPath(*i);
+
+    for (QStringList::iterator i = subDirectories.begin(); i != subDirectories.end(); i++)
+        if (!names.contains(i->mid(i->lastIndexOf(QDir::separator()) + 1)))
+            m_removedFiles.addPath(*i, true);
+}
+
+/**
+  * Stops watching the entries found deleted during a pass, signals their (and their content's)
+  * deletion.
+  */
+void Watcher::removeDeletedEntries() {
+    PathDiff diff;
+
+    // the deleted entries still watched, the parent directories first
+    PathSet::diff(&m_removedFiles, &m_files, &diff);
+    m_removedFiles.deleteAll();
+
+    for (QStringList::iterator i = diff.m_keptFiles.begin(); i != diff.m_keptFiles.end(); i++)
+        if (m_files.findPath(*i))
+            removeFile(*i);
+
+    // a directory's sub directories are gone along with it
+    for (QStringList::iterator i = diff.m_keptDirectories.begin(); i != diff.m_keptDirectories.end(); i++)
+        if (m_files.findPath(*i))
+            removeDirectory(*i);
+}
+
+/**
+  * Registers the directory with the kernel notifier. If it can't be watched it will be polled
+  * with the scheduled passes.
+  */
+void Watcher::addDirectoryWatch(const QString &directory) {
+    if (m_useNotifier && !m_notifier.addWatch(directory))
+        m_polledDirectories.insert(directory);
+}
+
+/**
+  * Merges the directories found by getNewSubDirectories in m_newFiles into the watched files, then
+  * lists their content, so the files they hold are known as soon as the directories are watched.
+  */
+void Watcher::exploreNewDirectories() {
+    QStringList directories;
+
+    // the new sub trees are spliced in, m_newFiles is left empty
+    m_newFiles.listPaths(&directories, NULL);
+    m_files.merge(&m_newFiles);
+
+    for (QStringList::iterator i = directories.begin(); !m_stop && i != directories.end(); i++)
+        watchDirectory(*i);
+
+    m_files.merge(&m_newFiles);
+}
+
+/**
+  * Starts watching a file the notifier reported.
+  */
+void Watcher::addFile(const QString &path) {
+    QDirExtEntry entry;
+
+    if (m_files.findPath(path) || updateCoarseFile(path, false))
+        return;
+
+    if (m_local)
+        IoThrottle::account(0, 1);
+    bool known = m_local && QDirExt::readEntry(path, &entry);
+
+    // no subscription may retain it
+    if (!isWanted(path, entry))
+        return;
+
+    // moved from another watched place?
+    if (known && checkMovedFile(path, entry, &m_files))
+        return;
+
+    m_files.addPath(path);
+    recordFileState(path, &entry);
+
+#ifdef _VERBOSE_WATCHER
+    qDebug() << "Notified new file " << path;
+#endif
+
+    signalFileAdded(path);
+}
+
+/**
+  * Starts watching a directory the notifier reported, and its content.
+  */
+void Watcher::addDirectory(const QString &path) {
+    if (!m_recursive || m_files.findPath(path) || !isWalked(path))
+        return;
+
+#ifdef _VERBOSE_WATCHER
+    qDebug() << "Notified new directory " << path;
+#endif
+
+    discover(path);
+}
+
+/**
+  * Stops watching a file.
+  */
+void Watcher::removeFile(const QString &path) {
+#ifdef _VERBOSE_WATCHER
+    qDebug() << "Detected deleted file " << path;
+#endif
+
+    signalFileDeleted(path);
+    m_files.deletePath(path);
+    forgetFileState(path);
+}
+
+/**
+  * Stops watching a directory and everything below it. Nobody will tell us about the content of
+  * a directory moved out of the watched tree, so the content deletion is signaled here.
+  */
+void Watcher::removeDirectory(const QString &path) {
+    QStringList directories;
+    QStringList files;
+
+    m_files.getSubPaths(path, true, &directories, &files);
+
+    for (QStringList::iterator i = files.begin(); i != files.end(); i++)
+        removeFile(*i);
+
+    // deepest directories first
+    directories.prepend(path);
+    for (int i = directories.count(); i > 0; i--) {
+        QString directory = directories[i - 1];
+
+#ifdef _VERBOSE_WATCHER
+        qDebug() << "Detected deleted directory " << directory;
+#endif
+        removeCoarseDirectory(directory);
+        directoryDeleted(directory);
+        m_notifier.removeWatch(directory);
+        m_polledDirectories.remove(directory);
+        m_directoryStates.remove(directory);
+        m_files.deletePath(directory);
+    }
+}
+
+/**
+  * Turns the kernel notifications into the watcher signals.
+  */
+void Watcher::processEvents() {
+    QList<DirEvent>         events = m_notifier.readEvents();
+    QHash<QString, bool>    movedOut; // renamed entries (whether directories), removed once the events are processed
+
+    for (QList<DirEvent>::iterator i = events.begin(); !m_stop && i != events.end(); i++) {
+        DirEvent &event = *i;
+
+        // the kernel lost events, only a full pass can tell what happened
+        if (event.m_type == DirEvent::Overflow) {
+            displayActivity(tr("Too many changes, rescanning %1").arg(m_url));
+            m_rescanNeeded = true;
+            return;
+        }
+
+        QString parent = event.m_path.left(event.m_path.lastIndexOf(QDir::separator()));
+
+        switch (event.m_type) {
+            case DirEvent::Created:
+                // an entry renamed away and replaced
+                if (movedOut.contains(event.m_path))
+                    removeEntry(event.m_path, movedOut.take(event.m_path));
+
+                if (QFileInfo(event.m_path).isHidden())
+                    break; // we don't care about these ones.
+
+                if (event.m_isDir)
+                    addDirectory(event.m_path);
+                else
+                    addFile(event.m_path);
+
+                directoryModified(parent);
+                break;
+
+            case DirEvent::Modified:
+                if (QFileInfo(event.m_path).isHidden())
+                    break;
+
+                if (event.m_isDir) {
+                    if (m_files.findPath(event.m_path))
+                        directoryModified(event.m_path);
+                } else if (m_files.findPath(event.m_path)) {
+#ifdef _VERBOSE_WATCHER
+                    qDebug() << "Notified modified file " << event.m_path;
+#endif
+                    recordFileState(event.m_path);
+                    signalFileModified(event.m_path);
+                } else
+                    addFile(event.m_path); // tracked at the directory level, or missed
+                break;
+
+            case DirEvent::Deleted:
+                // the first half of a rename, keep watching the entry so that if the second half
+                // is among the events, the move is told from its identity
+                if (event.m_cookie)
+                    movedOut.insert(event.m_path, event.m_isDir);
+                else
+                    removeEntry(event.m_path, event.m_isDir);
+                break;
+
+            case DirEvent::SelfDeleted:
+                // sub directories are handled through their parent, only the root needs care
+                if (event.m_path == m_url && m_files.findPath(m_url))
+                    removeDirectory(m_url);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    // what's left of the renamed entries was moved out of the watched tree
+    for (QHash<QString, bool>::const_iterator i = movedOut.constBegin(); !m_stop && i != movedOut.constEnd(); i++)
+        removeEntry(i.key(), *i);
+}
+
+/**
+  * Stops watching a file or directory the notifier reported deleted, if it's still watched.
+  */
+void Watcher::removeEntry(const QString &path, bool isDir) {
+    if (!isDir && updateCoarseFile(path, true)) {
+        directoryModified(path.left(path.lastIndexOf(QDir::separator())));
+        return;
+    }
+
+    if (!m_files.findPath(path))
+        return;
+
+    if (isDir)
+        removeDirectory(path);
+    else
+        removeFile(path);
+
+    directoryModified(path.left(path.lastIndexOf(QDir::separator())));
+}
+
+/**
+  * Returns what the watcher keeps track of, as of its last footprint update.
+  */
+WatchStats Watcher::getStats() {
+    QMutexLocker locker(&m_budgetMutex);
+
+    return m_stats;
+}
+
+/**
+  * Sets the memory budget shared by all the watchers. The watchers over it degrade their cold
+  * directories at their next check.
+  */
+void Watcher::setMemoryBudget(qint64 bytes) {
+    QMutexLocker locker(&m_budgetMutex);
+
+    m_memoryBudget = bytes;
+}
+
+qint64 Watcher::getMemoryBudget() {
+    QMutexLocker locker(&m_budgetMutex);
+
+    return m_memoryBudget;
+}
+
+qint64 Watcher::getTotalFootprint() {
+    QMutexLocker locker(&m_budgetMutex);
+
+    return m_totalFootprint;
+}
+
+/**
+  * Updates the stats and the memory used by the watcher, and returns the memory used by all the
+  * watchers.
+  */
+qint64 Watcher::updateFootprint() {
+    WatchStats stats;
+
+    stats.m_numDirectories = m_files.getPaths(true)->count();
+    stats.m_numFiles = m_files.getPaths()->count();
+    stats.m_numCoarseDirectories = m_coarseDirectories.count();
+    stats.m_numCoarseFiles = m_numCoarseFiles;
+    stats.m_footprint = m_files.footprint() + m_newFiles.footprint() + m_removedFiles.footprint() + m_pathArena.footprint() +
+                        m_stateFootprint + m_heatFootprint + m_coarseFootprint +
+                        m_directoryStates.count() * WATCH_DIR_STATE_BYTES;
+
+    QMutexLocker locker(&m_budgetMutex);
+
+    m_totalFootprint += stats.m_footprint - m_stats.m_footprint;
+    m_stats = stats;
+
+    return m_totalFootprint;
+}
+
+/**
+  * Degrades the cold directories if the watchers went over their memory budget. A watcher which
+  * had nothing left to degrade doesn't try again until it grew by WATCH_BUDGET_RETRY_BYTES.
+  */
+void Watcher::checkBudget() {
+    if (updateFootprint() <= getMemoryBudget()) {
+        m_fruitlessFootprint = -1;
+        return;
+    }
+
+    if (m_fruitlessFootprint != -1 && m_stats.m_footprint < m_fruitlessFootprint + WATCH_BUDGET_RETRY_BYTES)
+        return;
+
+    degradeColdDirectories();
+}
+
+/**
+  * Tracks the directories whose files were modified the longest ago at the directory level, until
+  * the watchers are back under WATCH_BUDGET_LOW_WATERMARK of their budget (or this watcher has
+  * nothing left to degrade). The local directories are taken coldest first from their heat, kept
+  * up to date as the file states are recorded and forgotten. The remote files have no state: their
+  * directories are all the coldest, taken in no particular order.
+  */
+void Watcher::degradeColdDirectories() {
+    qint64  target = getMemoryBudget() / 100 * WATCH_BUDGET_LOW_WATERMARK;
+    int     numDegraded = 0;
+    bool    underTarget = false;
+
+    if (m_local) {
+        while (!m_stop && !underTarget && !m_coldDirectories.isEmpty()) {
+            QString directory = m_coldDirectories.constBegin().key().second;
+
+            makeCoarse(directory);
+            ++numDegraded;
+
+            // its files without state (or not watched anymore) don't keep it a candidate
+            forgetDirectoryHeat(directory);
+
+            underTarget = updateFootprint() <= target;
+        }
+    } else {
+        QStringList directories;
+        const QVector<PathSegment *> *directoriesP = m_files.getPaths(true);
+        for (int i = 0; i < directoriesP->count(); i++)
+            if (!m_coarseDirectories.contains(directoriesP->at(i)->getPath()))
+                directories.append(directoriesP->at(i)->getPath());
+
+        for (int i = 0; !m_stop && !underTarget && i < directories.count(); i++) {
+            makeCoarse(directories[i]);
+            ++numDegraded;
+
+            underTarget = updateFootprint() <= target;
+        }
+    }
+
+    // over the target with nothing left, the others watchers may be
+    m_fruitlessFootprint = underTarget || m_stop ? -1 : m_stats.m_footprint;
+
+    displayActivity(tr("Over the watch memory budget, %1 more directories of %2 tracked at the directory level").arg(numDegraded).arg(m_url));
+}
+
+/**
+  * Stops watching the files of a directory one by one, and tracks them at the directory level,
+  * from their states (or from a listing for those without one).
+  */
+void Watcher::makeCoarse(const QString &directory) {
+    QStringList                     subDirectories;
+    QStringList                     files;
+    QHash<QString, QDirExtEntry>    listing;
+    bool                            listed = false;
+    CoarseDirectory                 coarse;
+
+    m_files.getSubPaths(directory, false, &subDirectories, &files);
+    if (files.isEmpty() || m_coarseDirectories.contains(directory))
+        return;
+
+#ifdef _VERBOSE_WATCHER
+    qDebug() << "Tracking directory " << directory << " at the directory level";
+#endif
+
+    for (QStringList::iterator i = files.begin(); i != files.end(); i++) {
+        QString     name = i->mid(i->lastIndexOf(QDir::separator()) + 1);
+        FileState   state = m_fileStates.value(*i);
+
+        if (!state.m_lastModified.isValid()) {
+            if (!listed) {
+                QList<QDirExtEntry> entries;
+                QDirExt::readEntries(directory, &entries, true);
+                IoThrottle::account(0, 1 + entries.count());
+                for (QList<QDirExtEntry>::iterator j = entries.begin(); j != entries.end(); j++)
+                    listing.insert(j->m_name, *j);
+                listed = true;
+            }
+
+            // modified since the last pass, it wasn't signaled yet: leave it unknown so the next
+            // listing does
+            QDirExtEntry entry = listing.value(name);
+            if (entry.m_hasStat && entry.m_lastModified < m_lastPass) {
+                state.m_lastModified = entry.m_lastModified;
+                state.m_size = entry.m_size;
+            }
+        }
+
+        coarse.append(name, state.m_lastModified.isValid() ? state.m_lastModified.toTime_t() : 0, state.m_size);
+
+        m_files.deletePath(*i);
+        forgetFileState(*i);
+    }
+
+    coarse.squeeze();
+    m_coarseFootprint += coarse.footprint();
+    m_numCoarseFiles += coarse.count();
+    m_coarseDirectories.insert(directory, coarse);
+}
+
+/**
+  * Compares a directory tracked at the directory level with its (stat'ed) listing: signals the
+  * files added, modified and deleted since it was last listed. Returns true if any was.
+  */
+bool Watcher::checkCoarseDirectory(const QString &directory, const QList<QDirExtEntry> &entries) {
+    CoarseDirectory     &coarse = m_coarseDirectories[directory];
+    CoarseDirectory     listed;
+    QVector<bool>       found(coarse.count(), false); // the known names found in the listing
+    bool                changed = false;
+
+    for (QList<QDirExtEntry>::const_iterator i = entries.begin(); !m_stop && i != entries.end(); i++) {
+        if (i->m_isHidden || i->m_isDir)
+            continue;
+
+        uint lastModified = i->m_lastModified.toTime_t();
+
+        int j = coarse.indexOf(i->m_name);
+        if (j == -1) {
+#ifdef _VERBOSE_WATCHER
+            qDebug() << "Detected new file " << i->m_name << " in " << directory;
+#endif
+            signalFileAdded(i->m_absoluteFilePath);
+            changed = true;
+        } else {
+            if (coarse.m_lastModified[j] != lastModified || coarse.m_sizes[j] != i->m_size) {
+#ifdef _VERBOSE_WATCHER
+                qDebug() << "Detected modified file " << i->m_name << " in " << directory;
+#endif
+                signalFileModified(i->m_absoluteFilePath);
+                changed = true;
+            }
+
+            found[j] = true;
+        }
+
+        listed.append(i->m_name, lastModified, i->m_size);
+    }
+
+    // the changes signaled so far will be signaled again
+    if (m_stop)
+        return changed;
+
+    QStringList names = coarse.names();
+    for (int i = 0; i < names.count(); i++) {
+        if (found[i])
+            continue;
+
+#ifdef _VERBOSE_WATCHER
+        qDebug() << "Detected deleted file " << names[i] << " in " << directory;
+#endif
+        signalFileDeleted(directory + QDirExt::separator(directory) + names[i]);
+        changed = true;
+    }
+
+    listed.squeeze();
+    m_coarseFootprint += listed.footprint() - coarse.footprint();
+    m_numCoarseFiles += listed.count() - coarse.count();
+    coarse = listed;
+
+    return changed;
+}
+
+/**
+  * Applies a notified change to a file of a directory tracked at the directory level, and signals
+  * it. Returns false if the file's directory isn't tracked at the directory level.
+  */
+bool Watcher::updateCoarseFile(const QString &path, bool deleted) {
+    QString directory = path.left(path.lastIndexOf(QDir::separator()));
+
+    QHash<QString, CoarseDirectory>::iterator coarse = m_coarseDirectories.find(directory);
+    if (coarse == m_coarseDirectories.end())
+        return false;
+
+    QString         name = path.mid(path.lastIndexOf(QDir::separator()) + 1);
+    int             index = coarse->indexOf(name);
+    qint64          footprint = coarse->footprint();
+    int             count = coarse->count();
+    QDirExtEntry    entry;
+
+    if (!deleted)
+        IoThrottle::account(0, 1);
+    if (deleted || !QDirExt::readEntry(path, &entry)) {
+        if (index != -1) {
+            coarse->removeAt(index);
+            signalFileDeleted(path);
+        }
+    } else if (index == -1) {
+        coarse->append(name, entry.m_lastModified.toTime_t(), entry.m_size);
+        signalFileAdded(path);
+    } else {
+        coarse->m_lastModified[index] = entry.m_lastModified.toTime_t();
+        coarse->m_sizes[index] = entry.m_size;
+        signalFileModified(path);
+    }
+
+#ifdef _VERBOSE_WATCHER
+    qDebug() << "Notified change of file " << path << " tracked at the directory level";
+#endif
+
+    m_coarseFootprint += coarse->footprint() - footprint;
+    m_numCoarseFiles += coarse->count() - count;
+
+    return true;
+}
+
+/**
+  * Stops tracking a directory at the directory level, signals the deletion of its files.
+  */
+void Watcher::removeCoarseDirectory(const QString &directory) {
+    QHash<QString, CoarseDirectory>::iterator coarse = m_coarseDirectories.find(directory);
+    if (coarse == m_coarseDirectories.end())
+        return;
+
+    QStringList names = coarse->names();
+    for (QStringList::iterator i = names.begin(); i != names.end(); i++)
+        signalFileDeleted(directory + QDirExt::separator(directory) + *i);
+
+    m_coarseFootprint -= coarse->footprint();
+    m_numCoarseFiles -= coarse->count();
+    m_coarseDirectories.erase(coarse);
+}
+
+/**
+  * Orders the directories to look at in a pass: the hot ones (changed within their last
+  * SCHEDULER_COOLING_PASSES listings, or never listed) first, then the cold ones which are due,
+  * those listed the longest ago first. The cold ones which aren't due are left out. On full checks,
+  * all the directories are, those listed the longest ago first, so a check cut short resumes.
+  */
+QStringList Watcher::scheduleDirectories(const QStringList &directories) {
+    QStringList                 hot;
+    QList<QPair<int, QString> > cold; // by last listed pass
+
+    for (QStringList::const_iterator i = directories.begin(); i != directories.end(); i++) {
+        QHash<QString, DirState>::const_iterator state = m_directoryStates.constFind(*i);
+
+        if (state == m_directoryStates.constEnd()) {
+            if (m_fullCheck)
+                cold.append(QPair<int, QString>(-1, *i));
+            else
+                hot.append(*i);
+        } else if (m_fullCheck || ScanScheduler::isDue(state->m_unchangedPasses, m_numPasses - state->m_lastListedPass)) {
+            if (!m_fullCheck && state->m_unchangedPasses < SCHEDULER_COOLING_PASSES)
+                hot.append(*i);
+            else
+                cold.append(QPair<int, QString>(state->m_lastListedPass, *i));
+        } else
+            ++m_pass.m_numBackedOff;
+    }
+
+    qSort(cold);
+
+    m_pass.m_numHot = hot.count();
+    m_pass.m_numCold = cold.count();
+
+    for (QList<QPair<int, QString> >::iterator i = cold.begin(); i != cold.end(); i++)
+        hot.append(i->second);
+
+    return hot;
+}
+
+/**
+  * Returns true if the pass must stop here, to give the device over to another root.
+  */
+bool Watcher::mustYield() {
+    return m_scheduler.mustYield(this);
+}
+
+/**
+  * Sleeps the given millisecs, or until stopped.
+  */
+void Watcher::pause(int msecs) {
+    QTime start;
+
+    start.start();
+    while (!m_stop && start.elapsed() < msecs)
+        msleep(qMin(WATCH_RETRY_INTERVAL, msecs - start.elapsed()));
+}
+
+/**
+  * Polls the directories the notifier couldn't take, the same way a full pass does.
+  */
+void Watcher::pollDirectories() {
+    QStringList directories = scheduleDirectories(m_polledDirectories.toList());
+
+    for (QStringList::iterator i = directories.begin(); !m_stop && i != directories.end(); i++) {
+        QString directory = *i;
+
+        // the rest stays polled, it'll be first next time
+        if (mustYield()) {
+            m_pass.m_numDeferred += directories.end() - i;
+            break;
+        }
+
+        if (!m_files.findPath(directory)) {
+            m_polledDirectories.remove(directory);
+            continue;
+        }
+
+        if (!QFileInfoExt(directory).exists()) {
+            removeDirectory(directory);
+            continue;
+        }
+
+        // watches may have been released since, try again (we still poll this time to catch up)
+        if (m_notifier.addWatch(directory))
+            m_polledDirectories.remove(directory);
+
+        // the kernel doesn't report the removed entries of polled directories, the listing will tell
+        watchDirectory(directory);
+    }
+
+    exploreNewDirectories();
+    removeDeletedEntries();
+}
+
+/**
+  * Does a full pass: checks every watched directory for new or modified files/directories, then
+  * every watched file for deletion.
+  */
+void Watcher::scanPass() {
+    QStringList directories;
+
+    // the pass will see whatever the kernel reported so far
+    if (m_useNotifier)
+        m_notifier.readEvents();
+
+    m_files.listPaths(&directories, NULL);
+    directories = scheduleDirectories(directories);
+
+    // check for new or modified files/directories
+    int numEntries = directories.count();
+    for (int i = 0; !m_stop && i < numEntries; i++) {
+        // the rest is left to the next pass, where it'll be first
+        if (mustYield()) {
+            m_pass.m_numDeferred += numEntries - i;
+            break;
+        }
+
+        QString filepath = directories[i];
+
+        // show progress
+        displayActivity(tr("Scanning directory %1").arg(filepath));
+        displayProgress(0, numEntries - 1, i);
+
+        watchDirectory(filepath);
+    }
+
+    // as long as new directories show up, their content is yet to be discovered, and a full
+    // check cut short must be completed
+    m_rescanNeeded = !m_newFiles.getPaths(true)->isEmpty() || (m_fullCheck && m_pass.m_numDeferred);
+
+    // add the new files and directories to the watch lists
+#ifdef _VERBOSE_PATH
+    m_files.dump("dumping watched files before merging");
+    m_newFiles.dump("dumping new files before merging");
+#endif
+
+    // list the new directories right away, so the files moved there are found before their old
+    // place is found empty
+    exploreNewDirectories();
+
+#ifdef _VERBOSE_PATH
+    m_files.dump("dumping watched files after merging");
+    m_newFiles.dump("dumping new files after merging");
+#endif
+
+    // the deleted entries were found missing from their directory's listing, but the root has
+    // no watched parent
+    if (!m_stop && m_files.findPath(m_url) && !QFileInfoExt(m_url).exists())
+        m_removedFiles.addPath(m_url, true);
+
+    removeDeletedEntries();
+}
+
+/**
+  * This is the watcher thread main stuff. It iterates on watching its 'known' directories and
+  * notifying the associated filter with the directories/files changes.
+  *
+  * Full passes are done until all the directories have been discovered (or after the kernel lost
+  * events). Then, if the notifier is used, the thread blocks until changes are notified, only
+  * waking up when the scheduler says to poll the directories the notifier couldn't take. Each pass
+  * (or poll) waits for its turn on the device, see ScanScheduler.
+  */
+void Watcher::run() {
+    QTime   passStart;
+    QTime   lastPoll;
+
+    // do nothing if no root url set
+    if (m_url.isEmpty())
+        return;
+
+    m_stop = false;
+    m_numPasses = 0;
+    m_fullCheck = false;
+
+    // the thread's listings and stats, and its walkers', are throttled by the subscriptions' limits
+    IoThrottle::setCurrent(&m_ioThrottle);
+    m_directoryStates.clear();
+    m_interval = SCHEDULER_MIN_INTERVAL;
+
+    // kernel notifications are only available for local directories
+    m_useNotifier = m_notifier.isActive() && m_local;
+
+    // the roots on the same device are discovered one at a time
+    m_scheduler.addRoot(this, m_url);
+    if (!m_scheduler.beginScan(this, &m_stop))
+        return;
+
+    // discover the whole tree at once, the passes will then look for changes
+    passStart.start();
+    m_pass = ScanPass();
+    m_pass.m_changed = true;
+    discover(m_url);
+
+    // what was signaled before a restart and wasn't found again was deleted meanwhile
+    if (!m_stop)
+        removeMissingCheckpointedFiles();
+
+    // the subscriptions which missed what was discovered
+    catchUp();
+
+    m_interval = m_scheduler.endScan(this, &m_pass);
+
+    m_lastPass = QDateTime::currentDateTime().addMSecs(-passStart.elapsed());
+    lastPoll.start();
+
+#ifdef _VERBOSE_WATCHER
+    qDebug() << "(File)Watcher discovered " << m_url << " in " << passStart.elapsed() << " ms";
+#endif
+
+    // the notifier reported what changed during the walk
+    m_rescanNeeded = false;
+
+    do {
+        passStart.restart();
+
+        if (m_useNotifier && !m_rescanNeeded) {
+            // sleep until the kernel tells us something changed, or the unwatched directories must be polled
+            int timeout = m_interval - lastPoll.elapsed();
+            if (timeout > 0 && m_notifier.waitForEvents(timeout) && !m_stop) {
+                passStart.restart();
+
+                processEvents();
+                checkBudget();
+
+#ifdef _VERBOSE_WATCHER
+                qDebug() << "(File)Watcher processed notifications in " << passStart.elapsed() << " ms";
+#endif
+            }
+
+            if (m_stop || lastPoll.elapsed() < m_interval)
+                continue;
+
+            lastPoll.restart();
+
+            if (m_polledDirectories.isEmpty() || !m_scheduler.beginScan(this, &m_stop))
+                continue;
+
+            m_pass = ScanPass();
+            m_fullCheck = ++m_numPasses % WATCH_FULL_CHECK_PASSES == 0;
+            pollDirectories();
+            checkBudget();
+
+            // keep last pass time
+            m_lastPass = QDateTime::currentDateTime();
+            m_interval = m_scheduler.endScan(this, &m_pass);
+            continue;
+        }
+
+#ifdef _VERBOSE_WATCHER
+        qDebug() << "(File)Watcher does a pass at " << passStart;
+#endif
+        // wait for our turn on the device
+        if (!m_scheduler.beginScan(this, &m_stop))
+            continue;
+
+        // after lost events, all the directories must be listed again
+        m_pass = ScanPass();
+        m_fullCheck = m_rescanNeeded || ++m_numPasses % WATCH_FULL_CHECK_PASSES == 0;
+        scanPass();
+        checkBudget();
+
+        // keep last pass time
+        m_lastPass = QDateTime::currentDateTime();
+        lastPoll.restart();
+        m_interval = m_scheduler.endScan(this, &m_pass);
 
-nextPass:
 #ifdef _VERBOSE_WATCHER
         qDebug() << "(File)Watcher ends pass at " << m_lastPass << " (duration: " << passStart.elapsed() << " ms)";
 #endif
@@ -295,9 +2205,9 @@ nextPass:
         displayActivity(tr("Scanning pass completed in (%1) milliseconds. Now sleeping.").arg(duration));
         displayProgress(1, 100, 100);
 
-        // a little break
-        if (!m_stop)
-            msleep(WATCH_PASS_INTERVAL);
+        // a break as long as the scheduler says, unless we can now rely on the notifier
+        if (!m_stop && (!m_useNotifier || m_rescanNeeded))
+            pause(m_rescanNeeded ? SCHEDULER_MIN_INTERVAL : m_interval);
     } while (!m_stop);
 
 #ifdef _VERBOSE_WATCHER
@@ -25,75 +25,339 @@
 
 #include <QObject>
 #include <QString>
+#include <QDir>
 #include <QThread>
 #include <QDateTime>
+#include <QSet>
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QVector>
+#include <QByteArray>
+#include <QDataStream>
+#include <QMutex>
 #include <QDebug>
 
 #include "filter.h"
 #include "pathsegment.h"
+#include "dirnotifier.h"
+#include "scanscheduler.h"
+#include "qdirext.h"
+#include "iothrottle.h"
+#include "watchpredicate.h"
+#include "globset.h"
 
 //#define _VERBOSE_WATCHER 1
 
-#define WATCH_PASS_INTERVAL             5000 // poll the directories every WATCH_INTERVAL millisecs
-#define NEW_DIRS_PER_PASS               2    // don't scan more than this per pass (at the top level, so this is already exponential...)
+#define WATCH_RETRY_INTERVAL            100  // millisecs between the stop checks of a pause
+#define WATCH_STOP_INTERVAL             100  // millisecs, the blocked signals are interrupted every WATCH_STOP_INTERVAL until the thread stops
+#define WATCH_FULL_CHECK_PASSES         12   // list all the directories every WATCH_FULL_CHECK_PASSES passes, changed or not
+#define WATCH_MTIME_GRANULARITY         1    // secs, a directory mtime this close to its listing can hide a change
 
-#define MAX_WATCHED_FILES               5000 // max files watched per watcher
+#define WATCH_MEMORY_BUDGET             (256 * 1024 * 1024) // bytes, shared by all the watchers, see WATCH_BUDGET
+#define WATCH_BUDGET_LOW_WATERMARK      75   // percent of the budget, degrading the cold directories stops below
+#define WATCH_FILE_STATE_OVERHEAD       96   // bytes, a file state and its identity hash nodes, on top of the path
+#define WATCH_DIR_STATE_BYTES           80   // bytes, a directory state and its hash node
+#define WATCH_DIR_HEAT_BYTES            96   // bytes, a directory's heat, its hash and map nodes, on top of the path
+#define WATCH_COARSE_INDEX_BYTES        16   // bytes, the hash node indexing a file name of a directory tracked at the directory level
+#define WATCH_BUDGET_RETRY_BYTES        (1024 * 1024) // bytes a watcher which had nothing left to degrade grows by before it tries again
 
 /**
-  * The watcher embeds a thread to keep track of the associated directory/ies changes.
-  * It signals when a change occured in the watched objects. It can be started/stopped when required.
+  * What a directory looked like when it was last listed.
   */
+class DirState {
+public:
+    DirState() {
+        m_numEntries = 0;
+        m_fingerprint = 0;
+        m_unchangedPasses = 0;
+        m_lastListedPass = 0;
+    }
 
-class Watcher : public QThread {
-    Q_OBJECT
+    QDateTime   m_lastModified; // directory mtime
+    QDateTime   m_listed;       // when it was listed
+    int         m_numEntries;   // number of entries
+    uint        m_fingerprint;  // entry names hashes, xor'ed
+    int         m_unchangedPasses; // listings in a row which found nothing (the directory cools down)
+    int         m_lastListedPass;  // the pass it was last looked at
+};
 
+/**
+  * What a (local) file looked like when its change was last signaled. The watched files states
+  * are checkpointed along with the db, so a restarted watcher only signals the files which changed
+  * while it wasn't running.
+  */
+class FileState {
 public:
-    explicit Watcher(QString url, bool recursive, Filter *filterP);
+    FileState() {
+        m_size = 0;
+        m_device = 0;
+        m_inode = 0;
+    }
+
+    explicit FileState(const QDirExtEntry &entry) {
+        m_lastModified = entry.m_lastModified;
+        m_size = entry.m_size;
+        m_device = entry.m_device;
+        m_inode = entry.m_inode;
+    }
+
+    inline bool operator==(const FileState &state) const {
+        return m_lastModified == state.m_lastModified && m_size == state.m_size && m_device == state.m_device && m_inode == state.m_inode;
+    }
 
-    inline void acquireWatchSemaphore() {
-        m_watchSem.acquire();
+    inline bool operator!=(const FileState &state) const {
+        return !(*this == state);
     }
 
-    inline bool tryAcquireWatchSemaphore() {
-        return m_watchSem.tryAcquire();
+    // the file didn't change, the identity of a file tracked at the directory level isn't known
+    inline bool isUnchanged(const FileState &state) const {
+        return m_lastModified == state.m_lastModified && m_size == state.m_size &&
+               (!m_inode || (m_device == state.m_device && m_inode == state.m_inode));
+    }
+
+    QDateTime   m_lastModified;
+    qint64      m_size;
+    quint64     m_device;
+    quint64     m_inode;
+};
+
+typedef QHash<QString, FileState> FileStates;   // by watched path
+typedef QPair<quint64, quint64> FileId;         // device, inode: a file wherever it's moved to
+
+QDataStream &operator<<(QDataStream &out, const FileState &state);
+QDataStream &operator>>(QDataStream &in, FileState &state);
+
+/**
+  * A directory tracked at the directory level. Once the watchers went over their memory budget,
+  * the files of the coldest directories aren't watched one by one anymore (no path segment, state
+  * or identity each): only their names, mtimes and sizes are kept, packed, so that listing the
+  * directory still tells which of its files were added, deleted or modified.
+  */
+class CoarseDirectory {
+public:
+    CoarseDirectory() {
+        m_garbage = 0;
+    }
+
+    int         indexOf(const QString &name) const;
+    QStringList names() const;
+    void        append(const QString &name, uint lastModified, qint64 size);
+    void        removeAt(int index);
+
+    inline int count() const {
+        return m_sizes.count();
+    }
+
+    inline void squeeze() {
+        m_names.squeeze();
+        m_offsets.squeeze();
+        m_lastModified.squeeze();
+        m_sizes.squeeze();
+    }
+
+    inline qint64 footprint() const {
+        return sizeof(CoarseDirectory) + m_names.capacity() + m_offsets.capacity() * sizeof(int) + m_lastModified.capacity() * sizeof(uint) +
+               m_sizes.capacity() * sizeof(qint64) + m_index.count() * WATCH_COARSE_INDEX_BYTES;
+    }
+
+    QVector<uint>   m_lastModified; // time_t
+    QVector<qint64> m_sizes;
+
+private:
+    QByteArray              m_names;    // the file names, utf8, each one '\0' terminated, and those removed
+    QVector<int>            m_offsets;  // where each name starts in m_names
+    QMultiHash<uint, int>   m_index;    // the indexes by name hash
+    int                     m_garbage;  // bytes of m_names the removed names take
+
+    void compact();
+};
+
+/**
+  * How recently the files of a directory were modified, to degrade the coldest directories first:
+  * the newest mtime of its files recorded so far (a file deleted doesn't make it colder), and how
+  * many of its files have a state.
+  */
+class DirectoryHeat {
+public:
+    DirectoryHeat() {
+        m_newest = 0;
+        m_numFiles = 0;
+    }
+
+    uint    m_newest;   // time_t
+    int     m_numFiles;
+};
+
+/**
+  * What a watcher keeps track of, and the memory it uses for it.
+  */
+class WatchStats {
+public:
+    WatchStats() {
+        m_numDirectories = 0;
+        m_numFiles = 0;
+        m_numCoarseDirectories = 0;
+        m_numCoarseFiles = 0;
+        m_footprint = 0;
     }
 
-    void releaseWatchSemaphore() {
-        while (!m_watchSem.available())
-            m_watchSem.release();
+    int     m_numDirectories;
+    int     m_numFiles;             // watched one by one
+    int     m_numCoarseDirectories; // tracked at the directory level
+    int     m_numCoarseFiles;       // in the directories tracked at the directory level
+    qint64  m_footprint;            // bytes
+};
+
+/**
+  * A root filter watching (part of) a watcher's tree. The watcher signals it the changes under its
+  * directory (only the direct children if not recursive), of the files its predicate accepts
+  * and its globs don't leave out.
+  */
+class WatchSubscription {
+public:
+    WatchSubscription(Filter *filterP = NULL, const QString &url = "", bool recursive = false) {
+        m_filterP = filterP;
+        m_url = url;
+        m_recursive = recursive;
+        m_whole = false;
+        m_active = false;
+        m_live = false;
+        m_checkpointInvalid = false;
     }
 
-    inline void stop() {
-#ifdef _VERBOSE_WATCHER
-        qDebug() << "WATCHER STOP!";
-#endif
+    // the path is under the subscribed directory
+    inline bool covers(const QString &path) const {
+        if (m_whole)
+            return true;
+
+        if (path.length() <= m_url.length() || !path.startsWith(m_url))
+            return false;
+
+        // the entries' names start after the directory's separator
+        int start = m_url.length();
+        if (!m_url.endsWith(QDir::separator())) {
+            if (path[start] != QDir::separator())
+                return false;
+            start++;
+        }
 
-        // disconnect the scan results signals/slots
-        disconnect(m_filterP, SLOT(fileAdded(QString)));
-        disconnect(m_filterP, SLOT(fileDeleted(QString)));
-        disconnect(m_filterP, SLOT(fileModified(QString)));
-        disconnect(m_filterP, SLOT(directoryAdded(QString)));
-        disconnect(m_filterP, SLOT(directoryDeleted(QString)));
-        disconnect(m_filterP, SLOT(directoryModified(QString)));
+        return m_recursive || path.indexOf(QDir::separator(), start) == -1;
+    }
 
-        m_stop = true;
+    // the file may be retained (size -1 if unknown)
+    inline bool retains(const QString &path, qint64 size) const {
+        return m_predicate.acceptsFile(path, size) && !m_globs.excludesPath(m_url, path);
     }
 
-    inline void start() {
-#ifdef _VERBOSE_WATCHER
-        qDebug() << "WATCHER START!";
-#endif
-        m_stop = false;
-        QThread::start(IdlePriority);
+    // the file is under the subscribed directory, and may be retained
+    inline bool accepts(const QString &path, qint64 size) const {
+        return covers(path) && retains(path, size);
     }
 
+    Filter      *m_filterP;
+    QString     m_url;              // as watched (absolute if local)
+    bool        m_recursive;
+    bool        m_whole;            // subscribed to the watcher's whole tree
+    bool        m_active;           // the filter is started
+    bool        m_live;             // was signaled every change so far
+    bool        m_checkpointInvalid; // the signaled files may not be indexed, checkpoint nothing
+    FileStates  m_baseline;         // not live: the files signaled to it, and their state then
+    WatchPredicate m_predicate;     // the files the filter may retain, the others aren't signaled
+    GlobSet     m_globs;            // the names the filter leaves out below its directory, not signaled
+};
+
+/**
+  * The watcher embeds a thread to keep track of the associated directory/ies changes.
+  * It signals when a change occured in the watched objects. It can be started/stopped when required.
+  *
+  * The watchers are shared by the root filters (subscribe/unsubscribe): a root filter whose
+  * directory is within the tree of an existing watcher subscribes to it instead of walking and
+  * watching the same files again, and a new watcher takes over the subscriptions of the watchers
+  * it covers. The changes are signaled to the active subscriptions covering them. A subscription
+  * which missed changes (it joined later, was stopped while the others ran, or was rescanned) is
+  * caught up from what the watcher knows, without listing anything: the files it was signaled
+  * (its checkpoint) are compared with the watched ones once the watcher (re)started. The watcher
+  * thread is stopped while a subscription is started, stopped or removed, and runs while at least
+  * one is active.
+  *
+  * The tree is first discovered in one go by a parallel DirWalker. Local directories are then
+  * watched through kernel notifications (see DirNotifier): the thread sleeps until the kernel reports a
+  * change. The directories which can't be watched (watch limit reached) are polled, and a full pass
+  * is done again if the kernel lost events. Remote urls are always polled.
+  *
+  * The discovery, passes and polls are scheduled with the other watchers' (see ScanScheduler):
+  * they wait for their device, yield it at the end of their slice if another root waits, and
+  * come back sooner or later depending on how much the root changes. Within a pass, the hot
+  * directories (changed lately) are listed first, the cold ones less and less often.
+  *
+  * A pass only lists the local directories modified since they were last listed (see DirState),
+  * except every WATCH_FULL_CHECK_PASSES passes, to catch the files rewritten in place. The deleted
+  * entries are the watched ones missing from their directory's listing.
+  *
+  * A local file showing up with the identity (device, inode) of a watched file which isn't
+  * there anymore was moved: fileMoved is signaled instead of a deletion and an addition, so its
+  * indexed attributes are kept. The first half of a notified rename is held until the events
+  * read with it were processed, so the second half finds the file still watched.
+  *
+  * The states of the signaled local files can be checkpointed (getCheckpoint) while the watcher
+  * is stopped. Given back to a new watcher (setCheckpoint) before it runs, the discovery only
+  * signals the files added or changed since, and the checkpointed files gone missing as deleted.
+  *
+  * Each subscription has the predicate of its filter's rules (see WatchPredicate): the files it
+  * doesn't accept aren't signaled to it. The files and directories none of the subscriptions
+  * accepts aren't watched at all: the walks and listings leave them out and don't go down the
+  * directories. A subscription whose predicate changes (updatePredicate) is caught up, and the
+  * discovery done when the thread restarts finds what the watcher's wider predicate now accepts.
+  * The globs of the subscriptions (see GlobSet) are applied the same way: a subscription isn't
+  * signaled what its globs leave out, and what all of them leave out isn't watched, the excluded
+  * directories aren't even listed (but the subscribed ones and those above them). A subscription
+  * whose filter's rules changed is caught up the same way (recheck), except that the files its
+  * filter rejected are signaled again.
+  *
+  * The watchers share a memory budget (setMemoryBudget). The one which takes them over it degrades
+  * its coldest directories (whose files were modified the longest ago) to directory-level tracking
+  * (see CoarseDirectory) until they're back under WATCH_BUDGET_LOW_WATERMARK. Nothing is dropped:
+  * the files of these directories are still signaled, but their moves are seen as a deletion and an
+  * addition.
+  */
+
+class Watcher : public QThread {
+    Q_OBJECT
+
+public:
+    ~Watcher();
+
+    static Watcher  *subscribe(Filter *filterP, const QString &url, bool recursive);
+    static void     unsubscribe(Filter *filterP);
+
+    inline ScanStats getScanStats() {
+        return m_scheduler.getStats(this);
+    }
+
+    void start(Filter *filterP);
+    void stop(Filter *filterP);
+    void resync(Filter *filterP);
+    bool isActive(Filter *filterP);
+
+    void getCheckpoint(Filter *filterP, QString *urlP, FileStates *statesP);
+    void setCheckpoint(Filter *filterP, const QString &url, const FileStates &states);
+    void invalidateCheckpoint(Filter *filterP);
+
+    WatchStats getStats();
+
+    void updateIoLimits();
+    void updatePredicate(Filter *filterP);
+    void recheck(Filter *filterP);
+
+    static void     setMemoryBudget(qint64 bytes);
+    static qint64   getMemoryBudget();
+    static qint64   getTotalFootprint();
+
 signals:
     void displayActivity(QString);
     void displayProgress(int min, int max, int value);
 
-    void fileAdded(const QString &path);
-    void fileDeleted(const QString &path);
-    void fileModified(const QString &path);
     void directoryAdded(const QString &path);
     void directoryDeleted(const QString &path);
     void directoryModified(const QString &path);
@@ -102,20 +366,110 @@ protected:
     void run();
 
 private:
-    Filter          *m_filterP;
+    QList<WatchSubscription> m_subscriptions; // the root filters signaled, changed from the server thread only
+    QMutex          m_subscriptionsMutex;
     volatile bool   m_stop;         // stop running...
-    QSemaphore      m_watchSem;     // to prevent concurrent access with the filter to resources while scanning
     QString         m_url;          // root url we watch
+    PathArena       m_pathArena;    // the segments and names of the path sets below
     PathSet         m_files;        // the watched files (including directories)
     PathSet         m_newFiles;     // the new watched files (including directories)
-    PathSet         m_removedFiles; // the deleted watched files (including directories)
-    int             m_numWatchedFiles; // number of files watched so far
+    PathSet         m_removedFiles; // the deleted watched files (including directories) found during a pass
     bool            m_recursive;       // recursively go down directories
     QDateTime       m_lastPass;     // last pass time
+    DirNotifier     m_notifier;     // kernel change notifications
+    bool            m_useNotifier;  // the root is local and the notifier is active
+    bool            m_rescanNeeded; // a full pass is required (discovery in progress, events lost)
+    QSet<QString>   m_polledDirectories; // watched directories the notifier couldn't take
+    bool            m_local;        // the root is a local directory
+    QHash<QString, DirState> m_directoryStates; // the local directories as last listed
+    FileStates      m_fileStates;   // the watched local files as last signaled
+    QHash<FileId, QString> m_fileIds; // the watched local files paths by identity
+    FileStates      m_checkpoint;   // the files signaled before a restart, not discovered again yet
+    QHash<FileId, QString> m_checkpointIds; // the checkpoint paths by identity
+    bool            m_fullCheck;    // the current pass lists all the directories
+    int             m_numPasses;
+    QHash<QString, CoarseDirectory> m_coarseDirectories; // the directories tracked at the directory level
+    qint64          m_coarseFootprint; // bytes used by the coarse directories
+    int             m_numCoarseFiles;
+    qint64          m_stateFootprint;  // bytes used by the file states
+    QHash<QString, DirectoryHeat> m_directoryHeat; // the directories of the files with a state
+    QMap<QPair<uint, QString>, bool> m_coldDirectories; // the same, by newest mtime, coldest first
+    qint64          m_heatFootprint;   // bytes used by the directories' heat
+    qint64          m_fruitlessFootprint; // the watcher's footprint when it last had nothing left to degrade, -1 if it had
+    WatchStats      m_stats;        // as of the last footprint update
+
+    IoThrottle      m_ioThrottle;   // the strictest limits of the subscriptions
+    WatchPredicate  m_predicate;    // the subscriptions' predicates united, set while the thread is stopped
+    GlobSet         m_globs;        // what all the subscriptions' globs leave out, set while the thread is stopped
+    int             m_interval;     // millisecs until the next pass (or poll)
+    ScanPass        m_pass;         // what the current pass did
+
+    static QList<Watcher *> m_watchers; // the shared watchers, used from the server thread only
+    static ScanScheduler m_scheduler;
+    static QMutex   m_budgetMutex;  // guards the budget, the total and the watchers' stats
+    static qint64   m_memoryBudget;
+    static qint64   m_totalFootprint; // all the watchers
+
+    explicit Watcher(QString url, bool recursive);
+
+    static QString watchedUrl(const QString &url);
+    bool covers(const QString &url, bool recursive);
+    int  findSubscription(Filter *filterP);
+    void addSubscription(const WatchSubscription &subscription);
+    void startThread();
+    void stopThread();
+    void interruptSignals();
+    void checkpointStates(const WatchSubscription &subscription, FileStates *statesP);
+    void catchUp();
+
+    qint64 knownSize(const QString &path);
+    bool isWanted(const QString &path, const QDirExtEntry &entry);
+    bool isWalked(const QString &directory);
+
+    void signalFileAdded(const QString &path);
+    void signalFileDeleted(const QString &path);
+    void signalFileModified(const QString &path);
+    void signalFileMoved(const QString &oldPath, const QString &path);
 
     void watchDirectory(QString directory);
+    bool isDirectoryUnchanged(const QString &directory, const QDateTime &lastModified);
+    void checkDeletedEntries(const QString &directory, const QStringList &entries);
+    void removeDeletedEntries();
 
     void getNewSubDirectories(QString dir);
+
+    void discover(const QString &root);
+    void removeMissingCheckpointedFiles();
+    void recordFileState(const QString &path, const QDirExtEntry *entryP = NULL);
+    void forgetFileState(const QString &path);
+    void warmDirectory(const QString &path, uint lastModified);
+    void coolDirectory(const QString &path);
+    void forgetDirectoryHeat(const QString &directory);
+    bool checkMovedFile(const QString &path, const QDirExtEntry &entry, PathSet *filesP);
+
+    qint64 updateFootprint();
+    void checkBudget();
+    void degradeColdDirectories();
+    void makeCoarse(const QString &directory);
+    bool checkCoarseDirectory(const QString &directory, const QList<QDirExtEntry> &entries);
+    bool updateCoarseFile(const QString &path, bool deleted);
+    void removeCoarseDirectory(const QString &directory);
+
+    QStringList scheduleDirectories(const QStringList &directories);
+    bool mustYield();
+    void pause(int msecs);
+
+    void scanPass();
+    void pollDirectories();
+    void processEvents();
+
+    void addDirectoryWatch(const QString &directory);
+    void exploreNewDirectories();
+    void addFile(const QString &path);
+    void addDirectory(const QString &path);
+    void removeFile(const QString &path);
+    void removeDirectory(const QString &path);
+    void removeEntry(const QString &path, bool isDir);
 };
 
 #endif // WATCHER_H
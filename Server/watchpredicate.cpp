@@ -0,0 +1,1018 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+
+#include <math.h>
+
+#include "watchpredicate.h"
+
+/**
+  * Constructs a predicate accepting anything.
+  */
+WatchPredicate::WatchPredicate() {
+    m_none = false;
+    m_anySuffix = true;
+    m_anyDirectory = true;
+    m_minSize = -1;
+    m_maxSize = -1;
+}
+
+/**
+  * Returns a predicate accepting nothing.
+  */
+WatchPredicate WatchPredicate::none() {
+    WatchPredicate predicate;
+
+    predicate.m_none = true;
+    predicate.normalize();
+
+    return predicate;
+}
+
+/**
+  * Returns a predicate accepting the files with one of the suffixes (whatever their case).
+  */
+WatchPredicate WatchPredicate::fromSuffixes(const QStringList &suffixes) {
+    WatchPredicate predicate;
+
+    predicate.m_anySuffix = false;
+    for (int i = 0; i < suffixes.count(); i++)
+        predicate.m_suffixes.insert(suffixes[i].toLower());
+    predicate.normalize();
+
+    return predicate;
+}
+
+/**
+  * Returns a predicate accepting the files of a directory, or of the directories starting with
+  * it if prefix is set.
+  */
+WatchPredicate WatchPredicate::fromDirectory(const QString &directory, bool prefix) {
+    WatchPredicate predicate;
+
+    predicate.m_anyDirectory = false;
+    if (prefix)
+        predicate.m_prefixes.insert(directory.toLower());
+    else
+        predicate.m_directories.insert(directory.toLower());
+
+    return predicate;
+}
+
+/**
+  * Returns a predicate accepting the files whose directory doesn't start with the prefix.
+  */
+WatchPredicate WatchPredicate::excludingDirectory(const QString &prefix) {
+    WatchPredicate predicate;
+
+    predicate.m_excludedPrefixes.insert(prefix.toLower());
+    predicate.normalize();
+
+    return predicate;
+}
+
+/**
+  * Returns a predicate accepting the files within the size range (-1 for unbounded).
+  */
+WatchPredicate WatchPredicate::fromSize(qint64 minSize, qint64 maxSize) {
+    WatchPredicate predicate;
+
+    predicate.m_minSize = minSize;
+    predicate.m_maxSize = maxSize;
+    predicate.normalize();
+
+    return predicate;
+}
+
+/**
+  * Returns the predicate of a rule script, anything if it can't be told (see PredicateParser).
+  */
+WatchPredicate WatchPredicate::fromScript(const QString &script) {
+    PredicateParser parser(script);
+    WatchPredicate  predicate;
+
+    if (!parser.parse(&predicate)) {
+#ifdef _VERBOSE_PREDICATE
+        qDebug() << "WatchPredicate can't analyze " << script;
+#endif
+        return WatchPredicate();
+    }
+
+#ifdef _VERBOSE_PREDICATE
+    qDebug() << "WatchPredicate of " << script << " is " << predicate.toString();
+#endif
+
+    return predicate;
+}
+
+/**
+  * Returns a predicate accepting what either predicate accepts (and maybe more).
+  */
+WatchPredicate WatchPredicate::united(const WatchPredicate &predicate) const {
+    WatchPredicate result;
+
+    if (m_none)
+        return predicate;
+
+    if (predicate.m_none)
+        return *this;
+
+    result.m_anySuffix = m_anySuffix || predicate.m_anySuffix;
+    if (!result.m_anySuffix)
+        result.m_suffixes = m_suffixes + predicate.m_suffixes;
+
+    result.m_anyDirectory = m_anyDirectory || predicate.m_anyDirectory;
+    if (!result.m_anyDirectory) {
+        result.m_directories = m_directories + predicate.m_directories;
+        result.m_prefixes = m_prefixes + predicate.m_prefixes;
+    }
+
+    // only what both exclude is excluded
+    for (QSet<QString>::const_iterator i = m_excludedPrefixes.constBegin(); i != m_excludedPrefixes.constEnd(); i++)
+        if (predicate.isExcluded(*i))
+            result.m_excludedPrefixes.insert(*i);
+
+    for (QSet<QString>::const_iterator i = predicate.m_excludedPrefixes.constBegin(); i != predicate.m_excludedPrefixes.constEnd(); i++)
+        if (isExcluded(*i))
+            result.m_excludedPrefixes.insert(*i);
+
+    result.m_minSize = m_minSize == -1 || predicate.m_minSize == -1 ? -1 : qMin(m_minSize, predicate.m_minSize);
+    result.m_maxSize = m_maxSize == -1 || predicate.m_maxSize == -1 ? -1 : qMax(m_maxSize, predicate.m_maxSize);
+
+    result.normalize();
+
+    return result;
+}
+
+/**
+  * Returns a predicate accepting what both predicates accept (and maybe more).
+  */
+WatchPredicate WatchPredicate::intersected(const WatchPredicate &predicate) const {
+    WatchPredicate result;
+
+    if (m_none || predicate.m_none)
+        return none();
+
+    if (m_anySuffix)
+        result.m_suffixes = predicate.m_suffixes;
+    else if (predicate.m_anySuffix)
+        result.m_suffixes = m_suffixes;
+    else
+        result.m_suffixes = QSet<QString>(m_suffixes).intersect(predicate.m_suffixes);
+    result.m_anySuffix = m_anySuffix && predicate.m_anySuffix;
+
+    if (m_anyDirectory) {
+        result.m_directories = predicate.m_directories;
+        result.m_prefixes = predicate.m_prefixes;
+    } else if (predicate.m_anyDirectory) {
+        result.m_directories = m_directories;
+        result.m_prefixes = m_prefixes;
+    } else {
+        // the directories allowed by both, the longest prefix of two nested ones
+        for (QSet<QString>::const_iterator i = m_directories.constBegin(); i != m_directories.constEnd(); i++)
+            if (predicate.isAllowed(*i))
+                result.m_directories.insert(*i);
+
+        for (QSet<QString>::const_iterator i = predicate.m_directories.constBegin(); i != predicate.m_directories.constEnd(); i++)
+            if (isAllowed(*i))
+                result.m_directories.insert(*i);
+
+        for (QSet<QString>::const_iterator i = m_prefixes.constBegin(); i != m_prefixes.constEnd(); i++)
+            if (predicate.isAllowed(*i))
+                result.m_prefixes.insert(*i);
+
+        for (QSet<QString>::const_iterator i = predicate.m_prefixes.constBegin(); i != predicate.m_prefixes.constEnd(); i++)
+            if (isAllowed(*i))
+                result.m_prefixes.insert(*i);
+    }
+    result.m_anyDirectory = m_anyDirectory && predicate.m_anyDirectory;
+
+    result.m_excludedPrefixes = m_excludedPrefixes + predicate.m_excludedPrefixes;
+
+    result.m_minSize = qMax(m_minSize, predicate.m_minSize);
+    if (m_maxSize == -1 || predicate.m_maxSize == -1)
+        result.m_maxSize = qMax(m_maxSize, predicate.m_maxSize);
+    else
+        result.m_maxSize = qMin(m_maxSize, predicate.m_maxSize);
+
+    result.normalize();
+
+    return result;
+}
+
+/**
+  * Returns false if the file (of the given size, -1 if unknown) can't be retained.
+  */
+bool WatchPredicate::acceptsFile(const QString &path, qint64 size) const {
+    if (m_none)
+        return false;
+
+    if (size != -1 && ((m_minSize != -1 && size < m_minSize) || (m_maxSize != -1 && size > m_maxSize)))
+        return false;
+
+    if (!m_anySuffix && !m_suffixes.contains(QFileInfo(path).suffix().toLower()))
+        return false;
+
+    if (m_anyDirectory && m_excludedPrefixes.isEmpty())
+        return true;
+
+    QString directory = parentDirectory(path).toLower();
+
+    return !isExcluded(directory) && isAllowed(directory);
+}
+
+/**
+  * Returns false if no file of the directory, or below it, can be retained: it doesn't need to
+  * be listed.
+  */
+bool WatchPredicate::acceptsDirectory(const QString &directory) const {
+    if (m_none)
+        return false;
+
+    if (m_anyDirectory && m_excludedPrefixes.isEmpty())
+        return true;
+
+    QString lowerDirectory = directory.toLower();
+
+    if (isExcluded(lowerDirectory))
+        return false;
+
+    if (m_anyDirectory || isAllowed(lowerDirectory))
+        return true;
+
+    // an allowed directory is below
+    for (QSet<QString>::const_iterator i = m_directories.constBegin(); i != m_directories.constEnd(); i++)
+        if (i->startsWith(lowerDirectory))
+            return true;
+
+    for (QSet<QString>::const_iterator i = m_prefixes.constBegin(); i != m_prefixes.constEnd(); i++)
+        if (i->startsWith(lowerDirectory))
+            return true;
+
+    return false;
+}
+
+bool WatchPredicate::operator==(const WatchPredicate &predicate) const {
+    return m_none == predicate.m_none &&
+           m_anySuffix == predicate.m_anySuffix && m_suffixes == predicate.m_suffixes &&
+           m_anyDirectory == predicate.m_anyDirectory && m_directories == predicate.m_directories && m_prefixes == predicate.m_prefixes &&
+           m_excludedPrefixes == predicate.m_excludedPrefixes &&
+           m_minSize == predicate.m_minSize && m_maxSize == predicate.m_maxSize;
+}
+
+/**
+  * Returns a readable form of the predicate, for debugging.
+  */
+QString WatchPredicate::toString() const {
+    QStringList bounds;
+
+    if (m_none)
+        return "none";
+
+    if (!m_anySuffix)
+        bounds.append("suffix in (" + QStringList(m_suffixes.toList()).join(", ") + ")");
+
+    if (!m_anyDirectory)
+        bounds.append("directory in (" + QStringList(m_directories.toList()).join(", ") + ") or under (" + QStringList(m_prefixes.toList()).join(", ") + ")");
+
+    if (!m_excludedPrefixes.isEmpty())
+        bounds.append("directory not under (" + QStringList(m_excludedPrefixes.toList()).join(", ") + ")");
+
+    if (m_minSize != -1 || m_maxSize != -1)
+        bounds.append(QString("size in [%1, %2]").arg(m_minSize).arg(m_maxSize));
+
+    return bounds.isEmpty() ? "any" : bounds.join(" and ");
+}
+
+/**
+  * Returns true if the (lower case) directory starts with an excluded prefix.
+  */
+bool WatchPredicate::isExcluded(const QString &directory) const {
+    for (QSet<QString>::const_iterator i = m_excludedPrefixes.constBegin(); i != m_excludedPrefixes.constEnd(); i++)
+        if (directory.startsWith(*i))
+            return true;
+
+    return false;
+}
+
+/**
+  * Returns true if the files of the (lower case) directory are allowed.
+  */
+bool WatchPredicate::isAllowed(const QString &directory) const {
+    if (m_anyDirectory || m_directories.contains(directory))
+        return true;
+
+    for (QSet<QString>::const_iterator i = m_prefixes.constBegin(); i != m_prefixes.constEnd(); i++)
+        if (directory.startsWith(*i))
+            return true;
+
+    return false;
+}
+
+/**
+  * Turns a predicate which can't accept anything into none, so they compare equal.
+  */
+void WatchPredicate::normalize() {
+    if (!m_anySuffix && m_suffixes.isEmpty())
+        m_none = true;
+
+    if (!m_anyDirectory && m_directories.isEmpty() && m_prefixes.isEmpty())
+        m_none = true;
+
+    if (m_excludedPrefixes.contains(""))
+        m_none = true;
+
+    if (m_minSize != -1 && m_maxSize != -1 && m_minSize > m_maxSize)
+        m_none = true;
+
+    if (!m_none)
+        return;
+
+    m_anySuffix = true;
+    m_suffixes.clear();
+    m_anyDirectory = true;
+    m_directories.clear();
+    m_prefixes.clear();
+    m_excludedPrefixes.clear();
+    m_minSize = -1;
+    m_maxSize = -1;
+}
+
+/**
+  * Returns the directory of a file as the Path attribute holds it.
+  */
+QString WatchPredicate::parentDirectory(const QString &path) {
+    int index = path.lastIndexOf(QDir::separator());
+
+    return index > 0 ? path.left(index) : QString(QDir::separator());
+}
+
+PredicateParser::PredicateParser(const QString &script) {
+    m_script = script;
+    m_position = 0;
+    m_resultSet = false;
+    m_called = false;
+}
+
+/**
+  * Analyzes the script. Returns false if it can't be told what the script retains.
+  */
+bool PredicateParser::parse(WatchPredicate *predicateP) {
+    if (!tokenize())
+        return false;
+
+    m_position = 0;
+    m_resultSet = false;
+    m_aliases.clear();
+
+    while (current().m_type != Token::End)
+        if (!statement())
+            return false;
+
+    if (!m_resultSet)
+        return false;
+
+    *predicateP = m_result;
+
+    return true;
+}
+
+/**
+  * Splits the script into tokens, the comments left out. Returns false on what isn't expected
+  * in a rule script (unterminated strings and comments, escapes other than the plain ones).
+  */
+bool PredicateParser::tokenize() {
+    static const char *punctuators[] = {"===", "!==", "==", "!=", "<=", ">=", "&&", "||", "&=", "|=", NULL};
+
+    int length = m_script.length();
+    int i = 0;
+
+    m_tokens.clear();
+
+    while (i < length) {
+        QChar c = m_script[i];
+        QChar next = i + 1 < length ? m_script[i + 1] : QChar();
+
+        if (c.isSpace()) {
+            i++;
+            continue;
+        }
+
+        if (c == '/' && next == '/') {
+            while (i < length && m_script[i] != '\n')
+                i++;
+            continue;
+        }
+
+        if (c == '/' && next == '*') {
+            int end = m_script.indexOf("*/", i + 2);
+            if (end == -1)
+                return false;
+
+            i = end + 2;
+            continue;
+        }
+
+        if (c.isLetter() || c == '_' || c == '$') {
+            int start = i;
+            while (i < length && (m_script[i].isLetterOrNumber() || m_script[i] == '_' || m_script[i] == '$'))
+                i++;
+
+            m_tokens.append(Token(Token::Identifier, m_script.mid(start, i - start)));
+            continue;
+        }
+
+        if (c.isDigit() || (c == '.' && next.isDigit())) {
+            int start = i;
+            while (i < length && (m_script[i].isLetterOrNumber() || m_script[i] == '.'))
+                i++;
+
+            bool    ok;
+            double  number = m_script.mid(start, i - start).toDouble(&ok);
+            if (!ok)
+                return false;
+
+            m_tokens.append(Token(Token::Number, "", number));
+            continue;
+        }
+
+        if (c == '"' || c == '\'') {
+            QString value;
+
+            for (i++; i < length && m_script[i] != c; i++) {
+                if (m_script[i] != '\\') {
+                    value.append(m_script[i]);
+                    continue;
+                }
+
+                if (++i == length)
+                    return false;
+
+                QChar escaped = m_script[i];
+                if (escaped == 'n')
+                    value.append('\n');
+                else if (escaped == 't')
+                    value.append('\t');
+                else if (escaped.isLetterOrNumber())
+                    return false; // unicode, hexadecimal...
+                else
+                    value.append(escaped);
+            }
+
+            if (i == length)
+                return false;
+
+            i++;
+            m_tokens.append(Token(Token::String, value));
+            continue;
+        }
+
+        // the longest punctuator first
+        int j;
+        for (j = 0; punctuators[j]; j++)
+            if (m_script.midRef(i).startsWith(QLatin1String(punctuators[j])))
+                break;
+
+        QString punctuator = punctuators[j] ? QString(punctuators[j]) : QString(c);
+        m_tokens.append(Token(Token::Punctuator, punctuator));
+        i += punctuator.length();
+    }
+
+    m_tokens.append(Token(Token::End));
+
+    return true;
+}
+
+/**
+  * Parses a statement. Once setResult was called, only function declarations may follow.
+  */
+bool PredicateParser::statement() {
+    if (accept(";"))
+        return true;
+
+    if (accept("{")) {
+        while (!accept("}"))
+            if (current().m_type == Token::End || !statement())
+                return false;
+
+        return true;
+    }
+
+    if (isIdentifier("function"))
+        return skipFunction();
+
+    if (m_resultSet)
+        return false;
+
+    m_called = false;
+
+    // plugin.setResult(expression)
+    if (isIdentifier("plugin") && m_position + 2 < m_tokens.count() &&
+        m_tokens[m_position + 1].m_text == "." && m_tokens[m_position + 2].m_text == "setResult") {
+        Value value;
+
+        m_position += 3;
+        if (!accept("(") || !expression(&value) || !accept(")"))
+            return false;
+        accept(";");
+
+        m_result = toPredicate(value);
+        m_resultSet = true;
+
+        return true;
+    }
+
+    // [var] alias = expression, alias &= expression
+    if (isIdentifier("var"))
+        m_position++;
+
+    if (current().m_type != Token::Identifier || isIdentifier("plugin") || isIdentifier("function"))
+        return false;
+
+    QString alias = current().m_text;
+    Value   previous = m_aliases.value(alias);
+    Value   value;
+    bool    narrowing;
+
+    m_position++;
+    if (accept("="))
+        narrowing = false;
+    else if (accept("&="))
+        narrowing = true;
+    else
+        return false;
+
+    if (!expression(&value))
+        return false;
+    accept(";");
+
+    // the called functions may have changed the other aliases
+    if (m_called)
+        m_aliases.clear();
+
+    // both operands of a truthy bitwise and are truthy
+    if (narrowing) {
+        Value narrowed(Value::Predicate);
+        narrowed.m_predicate = toPredicate(previous).intersected(toPredicate(value));
+        value = narrowed;
+    }
+
+    m_aliases.insert(alias, value);
+
+    return true;
+}
+
+/**
+  * Skips a function declaration. Returns false if it calls setResult.
+  */
+bool PredicateParser::skipFunction() {
+    m_position++;
+
+    if (current().m_type != Token::Identifier)
+        return false;
+    m_position++;
+
+    if (!accept("("))
+        return false;
+
+    while (!accept(")")) {
+        if (current().m_type == Token::End)
+            return false;
+        m_position++;
+    }
+
+    if (!accept("{"))
+        return false;
+
+    for (int depth = 1; depth; m_position++) {
+        const Token &token = current();
+
+        if (token.m_type == Token::End || token.m_text.contains("setResult") || token.m_text == "eval")
+            return false;
+
+        if (isPunctuator("{"))
+            depth++;
+        else if (isPunctuator("}"))
+            depth--;
+    }
+
+    return true;
+}
+
+bool PredicateParser::expression(Value *valueP) {
+    return orExpression(valueP);
+}
+
+bool PredicateParser::orExpression(Value *valueP) {
+    if (!andExpression(valueP))
+        return false;
+
+    while (accept("||")) {
+        Value right;
+        Value result(Value::Predicate);
+
+        if (!andExpression(&right))
+            return false;
+
+        result.m_predicate = toPredicate(*valueP).united(toPredicate(right));
+        *valueP = result;
+    }
+
+    return true;
+}
+
+bool PredicateParser::andExpression(Value *valueP) {
+    if (!unaryExpression(valueP))
+        return false;
+
+    while (accept("&&")) {
+        Value right;
+        Value result(Value::Predicate);
+
+        if (!unaryExpression(&right))
+            return false;
+
+        result.m_predicate = toPredicate(*valueP).intersected(toPredicate(right));
+        *valueP = result;
+    }
+
+    return true;
+}
+
+/**
+  * A negated condition can't be bounded (the bounds are approximations), only a literal can.
+  */
+bool PredicateParser::unaryExpression(Value *valueP) {
+    if (!accept("!"))
+        return comparison(valueP);
+
+    Value operand;
+    if (!unaryExpression(&operand))
+        return false;
+
+    *valueP = Value();
+    if (operand.m_kind == Value::BooleanLiteral) {
+        valueP->m_kind = Value::BooleanLiteral;
+        valueP->m_number = operand.m_number ? 0 : 1;
+    }
+
+    return true;
+}
+
+bool PredicateParser::comparison(Value *valueP) {
+    static const char *operators[] = {"==", "===", "!=", "!==", "<", "<=", ">", ">=", NULL};
+
+    if (!primary(valueP))
+        return false;
+
+    for (int i = 0; operators[i]; i++) {
+        if (!isPunctuator(operators[i]))
+            continue;
+
+        QString op = current().m_text;
+        Value   right;
+
+        m_position++;
+        if (!primary(&right))
+            return false;
+
+        *valueP = compare(*valueP, op, right);
+        break;
+    }
+
+    return true;
+}
+
+bool PredicateParser::primary(Value *valueP) {
+    *valueP = Value();
+
+    if (accept("(")) {
+        if (!expression(valueP) || !accept(")"))
+            return false;
+
+        return methods(valueP);
+    }
+
+    // a negative number
+    if (accept("-")) {
+        if (current().m_type != Token::Number)
+            return false;
+
+        valueP->m_kind = Value::NumberLiteral;
+        valueP->m_number = -current().m_number;
+        m_position++;
+        return true;
+    }
+
+    Token token = current();
+
+    switch (token.m_type) {
+        case Token::String:
+            valueP->m_kind = Value::StringLiteral;
+            valueP->m_string = token.m_text;
+            m_position++;
+            return methods(valueP);
+
+        case Token::Number:
+            valueP->m_kind = Value::NumberLiteral;
+            valueP->m_number = token.m_number;
+            m_position++;
+            return true;
+
+        case Token::Identifier:
+            break;
+
+        default:
+            return false;
+    }
+
+    m_position++;
+
+    if (token.m_text == "true" || token.m_text == "false") {
+        valueP->m_kind = Value::BooleanLiteral;
+        valueP->m_number = token.m_text == "true" ? 1 : 0;
+        return true;
+    }
+
+    if (token.m_text == "function" || token.m_text == "eval")
+        return false;
+
+    // plugin.getAttributeValue(name), the other plugin calls can't be told
+    if (token.m_text == "plugin") {
+        if (!accept(".") || current().m_type != Token::Identifier)
+            return false;
+
+        QString method = current().m_text;
+        m_position++;
+
+        if (method == "setResult" || !accept("("))
+            return false;
+
+        if (method == "getAttributeValue" && current().m_type == Token::String) {
+            valueP->m_kind = Value::Attribute;
+            valueP->m_name = current().m_text;
+            m_position++;
+
+            if (!accept(")"))
+                return false;
+
+            return methods(valueP);
+        }
+
+        if (!accept(")")) {
+            do {
+                Value argument;
+                if (!expression(&argument))
+                    return false;
+            } while (accept(","));
+
+            if (!accept(")"))
+                return false;
+        }
+
+        return methods(valueP);
+    }
+
+    // a function call
+    if (accept("(")) {
+        if (!accept(")")) {
+            do {
+                Value argument;
+                if (!expression(&argument))
+                    return false;
+            } while (accept(","));
+
+            if (!accept(")"))
+                return false;
+        }
+
+        m_called = true;
+        return methods(valueP);
+    }
+
+    // an alias, unless a function called meanwhile could have changed it
+    if (!m_called)
+        *valueP = m_aliases.value(token.m_text);
+
+    return methods(valueP);
+}
+
+/**
+  * Applies the method calls following a value. Only the conversions of an attribute to a
+  * (lower case) string and indexOf are told.
+  */
+bool PredicateParser::methods(Value *valueP) {
+    while (accept(".")) {
+        if (current().m_type != Token::Identifier)
+            return false;
+
+        QString method = current().m_text;
+        m_position++;
+
+        if (method == "setResult")
+            return false;
+
+        // a property
+        if (!accept("(")) {
+            *valueP = Value();
+            continue;
+        }
+
+        QList<Value> arguments;
+        if (!accept(")")) {
+            do {
+                Value argument;
+                if (!expression(&argument))
+                    return false;
+                arguments.append(argument);
+            } while (accept(","));
+
+            if (!accept(")"))
+                return false;
+        }
+
+        if (valueP->m_kind != Value::Attribute) {
+            *valueP = Value();
+            continue;
+        }
+
+        if ((method == "toLowerCase" || method == "toLocaleLowerCase") && arguments.isEmpty()) {
+            valueP->m_lowerCase = true;
+            valueP->m_converted = true;
+        } else if (method == "toString" && arguments.isEmpty())
+            valueP->m_converted = true;
+        else if (method == "indexOf" && arguments.count() == 1 && arguments[0].m_kind == Value::StringLiteral) {
+            valueP->m_kind = Value::IndexOf;
+            valueP->m_string = arguments[0].m_string;
+        } else
+            *valueP = Value();
+    }
+
+    return true;
+}
+
+/**
+  * Returns the condition of a comparison, an attribute with a literal either way round.
+  */
+PredicateParser::Value PredicateParser::compare(const Value &left, const QString &op, const Value &right) {
+    if (left.m_kind == Value::Attribute || left.m_kind == Value::IndexOf)
+        return compareAttribute(left, op, right);
+
+    if (right.m_kind == Value::Attribute || right.m_kind == Value::IndexOf)
+        return compareAttribute(right, flipOperator(op), left);
+
+    return Value();
+}
+
+/**
+  * Returns the condition of an attribute compared with a literal:
+  *
+  *     - Type == "x": the suffix is x.
+  *     - Name == "x": the suffix is x's.
+  *     - Path == "x": the directory is x.
+  *     - Path.indexOf("x") == 0: the directory starts with x, or doesn't with != once lower
+  *       cased (the exclusions are matched case insensitively).
+  *     - Size compared with a number: the size range.
+  *
+  * A lower cased attribute never equals a literal with upper case letters.
+  */
+PredicateParser::Value PredicateParser::compareAttribute(const Value &attribute, const QString &op, const Value &literal) {
+    Value   result(Value::Predicate);
+    bool    equal = op == "==" || op == "===";
+    bool    different = op == "!=" || op == "!==";
+
+    if (attribute.m_kind == Value::IndexOf) {
+        if (attribute.m_name != PREDICATE_PATH_ATTR || literal.m_kind != Value::NumberLiteral || literal.m_number != 0)
+            return result;
+
+        QString prefix = attribute.m_string;
+        bool    matchable = !attribute.m_lowerCase || prefix == prefix.toLower();
+
+        if (equal)
+            result.m_predicate = matchable ? WatchPredicate::fromDirectory(prefix, true) : WatchPredicate::none();
+        else if (different && attribute.m_lowerCase && matchable)
+            result.m_predicate = WatchPredicate::excludingDirectory(prefix);
+
+        return result;
+    }
+
+    if (attribute.m_name == PREDICATE_SIZE_ATTR) {
+        if (attribute.m_converted || literal.m_kind != Value::NumberLiteral)
+            return result;
+
+        double  size = literal.m_number;
+        qint64  minSize = -1;
+        qint64  maxSize = -1;
+
+        if (equal) {
+            if (size < 0 || size != floor(size)) {
+                result.m_predicate = WatchPredicate::none();
+                return result;
+            }
+            minSize = maxSize = (qint64)size;
+        } else if (op == "<")
+            maxSize = (qint64)ceil(size) - 1;
+        else if (op == "<=")
+            maxSize = (qint64)floor(size);
+        else if (op == ">")
+            minSize = (qint64)floor(size) + 1;
+        else if (op == ">=")
+            minSize = (qint64)ceil(size);
+        else
+            return result;
+
+        // no file is smaller than nothing
+        if ((op == "<" || op == "<=") && maxSize < 0) {
+            result.m_predicate = WatchPredicate::none();
+            return result;
+        }
+
+        result.m_predicate = WatchPredicate::fromSize(minSize < 0 ? -1 : minSize, maxSize);
+        return result;
+    }
+
+    if (!equal || literal.m_kind != Value::StringLiteral)
+        return result;
+
+    QString value = literal.m_string;
+    if (attribute.m_lowerCase && value != value.toLower()) {
+        result.m_predicate = WatchPredicate::none();
+        return result;
+    }
+
+    if (attribute.m_name == PREDICATE_TYPE_ATTR)
+        result.m_predicate = WatchPredicate::fromSuffixes(QStringList(value));
+    else if (attribute.m_name == PREDICATE_NAME_ATTR)
+        result.m_predicate = WatchPredicate::fromSuffixes(QStringList(QFileInfo(value).suffix()));
+    else if (attribute.m_name == PREDICATE_PATH_ATTR)
+        result.m_predicate = WatchPredicate::fromDirectory(value, false);
+
+    return result;
+}
+
+/**
+  * Returns what the result of an expression bounds: a condition, or its truth.
+  */
+WatchPredicate PredicateParser::toPredicate(const Value &value) {
+    switch (value.m_kind) {
+        case Value::Predicate:
+            return value.m_predicate;
+
+        case Value::BooleanLiteral:
+        case Value::NumberLiteral:
+            return value.m_number ? WatchPredicate() : WatchPredicate::none();
+
+        case Value::StringLiteral:
+            return value.m_string.isEmpty() ? WatchPredicate::none() : WatchPredicate();
+
+        default:
+            return WatchPredicate();
+    }
+}
+
+/**
+  * Returns the operator comparing the operands the other way round.
+  */
+QString PredicateParser::flipOperator(const QString &op) {
+    if (op == "<")
+        return ">";
+    if (op == "<=")
+        return ">=";
+    if (op == ">")
+        return "<";
+    if (op == ">=")
+        return "<=";
+
+    return op;
+}
+
+bool PredicateParser::accept(const QString &punctuator) {
+    if (!isPunctuator(punctuator))
+        return false;
+
+    m_position++;
+
+    return true;
+}
@@ -0,0 +1,224 @@
+/*
+ * SION! Server meta-data / javascript indexing server.
+ *
+ * Copyright (C) Intel Corporation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Gilles Fabre <gilles.fabre@intel.com>
+ */
+
+#ifndef WATCHPREDICATE_H
+#define WATCHPREDICATE_H
+
+#include <QString>
+#include <QStringList>
+#include <QSet>
+#include <QHash>
+#include <QList>
+
+//#define _VERBOSE_PREDICATE 1
+
+#define PREDICATE_TYPE_ATTR     "Type"  // the file suffix
+#define PREDICATE_NAME_ATTR     "Name"  // the file name
+#define PREDICATE_PATH_ATTR     "Path"  // the file's (absolute) parent directory
+#define PREDICATE_SIZE_ATTR     "Size"  // bytes
+
+/**
+  * What a filter's rules may retain, told from a file's path and size alone, so the watcher can
+  * leave out the files and directories that can't be retained without extracting anything. It
+  * is conservative: a file the rules would retain is always accepted, the other ones may be.
+  *
+  * It is made of independent bounds (each one may be unbounded): the allowed suffixes, the
+  * allowed parent directories (exactly, or by prefix), the excluded parent directory prefixes,
+  * and the size range. The path bounds are case insensitive. The predicates of several plugins
+  * are united (any of them retaining the file retains it), the conditions of a script are
+  * intersected (&&) or united (||) bound by bound, widening as needed.
+  *
+  * fromScript tells the predicate of a rule script by static analysis, see PredicateParser. A
+  * script it doesn't understand accepts anything.
+  */
+class WatchPredicate {
+public:
+    WatchPredicate();
+
+    static WatchPredicate none();
+    static WatchPredicate fromSuffixes(const QStringList &suffixes);
+    static WatchPredicate fromDirectory(const QString &directory, bool prefix);
+    static WatchPredicate excludingDirectory(const QString &prefix);
+    static WatchPredicate fromSize(qint64 minSize, qint64 maxSize);
+    static WatchPredicate fromScript(const QString &script);
+
+    WatchPredicate united(const WatchPredicate &predicate) const;
+    WatchPredicate intersected(const WatchPredicate &predicate) const;
+
+    bool acceptsFile(const QString &path, qint64 size = -1) const;
+    bool acceptsDirectory(const QString &directory) const;
+
+    // accepts anything
+    inline bool isAny() const {
+        return !m_none && m_anySuffix && m_anyDirectory && m_excludedPrefixes.isEmpty() && m_minSize == -1 && m_maxSize == -1;
+    }
+
+    inline bool isNone() const {
+        return m_none;
+    }
+
+    bool operator==(const WatchPredicate &predicate) const;
+
+    inline bool operator!=(const WatchPredicate &predicate) const {
+        return !(*this == predicate);
+    }
+
+    QString toString() const;
+
+private:
+    bool            m_none;             // accepts nothing
+    bool            m_anySuffix;
+    QSet<QString>   m_suffixes;         // lower case, without the '.'
+    bool            m_anyDirectory;
+    QSet<QString>   m_directories;      // lower case, the parent directory is one of these
+    QSet<QString>   m_prefixes;         // lower case, or starts with one of these
+    QSet<QString>   m_excludedPrefixes; // lower case, the parent directory doesn't start with any of these
+    qint64          m_minSize;          // bytes, -1 if unbounded
+    qint64          m_maxSize;
+
+    bool isExcluded(const QString &directory) const;
+    bool isAllowed(const QString &directory) const;
+    void normalize();
+
+    static QString parentDirectory(const QString &path);
+};
+
+/**
+  * The static analysis of a rule script (see WatchPredicate::fromScript). The script is a
+  * javascript subset, the one of the default scripts and of the client's assisted scripts:
+  *
+  *     script      :- statement* ,
+  *     statement   :- "{" statement* "}" | "var"? alias ("=" | "&=") expression ";"? |
+  *                    "plugin.setResult(" expression ")" ";"? | function | ";"
+  *     function    :- "function" name "(" ... ")" "{" ... "}"  (doesn't call setResult)
+  *     expression  :- "||", "&&" and "!" of comparisons, aliases and (expressions)
+  *     comparison  :- attribute ("==" | "===" | "!=" | "<" | ...) literal, either way round
+  *     attribute   :- ("plugin.getAttributeValue(" name ")" | alias) ("." method "(" literal? ")")*
+  *
+  * The comparisons of Type, Name, Path and Size with a literal are turned into bounds, the other
+  * comparisons and the calls (a function, plugin.contains) accept anything. setResult must be
+  * called once, by the last statement calling anything. Anything else fails the analysis.
+  */
+class PredicateParser {
+public:
+    explicit PredicateParser(const QString &script);
+
+    bool parse(WatchPredicate *predicateP);
+
+private:
+    /**
+      * A lexical token of the script.
+      */
+    class Token {
+    public:
+        enum Type {
+            End,
+            Identifier,
+            String,
+            Number,
+            Punctuator
+        };
+
+        explicit Token(Type type = End, const QString &text = "", double number = 0) {
+            m_type = type;
+            m_text = text;
+            m_number = number;
+        }
+
+        Type    m_type;
+        QString m_text;     // the identifier, punctuator or string value
+        double  m_number;
+    };
+
+    /**
+      * What an expression stands for: a predicate (a condition), an attribute (and what was
+      * done to it) or a literal. Anything else is Unknown.
+      */
+    class Value {
+    public:
+        enum Kind {
+            Unknown,
+            Predicate,
+            Attribute,
+            IndexOf,        // attribute.indexOf(literal)
+            StringLiteral,
+            NumberLiteral,
+            BooleanLiteral
+        };
+
+        explicit Value(Kind kind = Unknown) {
+            m_kind = kind;
+            m_lowerCase = false;
+            m_converted = false;
+            m_number = 0;
+        }
+
+        Kind            m_kind;
+        WatchPredicate  m_predicate;    // Predicate
+        QString         m_name;         // Attribute, IndexOf: the attribute name
+        bool            m_lowerCase;    // Attribute, IndexOf: toLowerCase() was applied
+        bool            m_converted;    // Attribute, IndexOf: turned into a string (toString, ...)
+        QString         m_string;       // StringLiteral, IndexOf: the value looked for
+        double          m_number;       // NumberLiteral, BooleanLiteral (0 or 1)
+    };
+
+    QString                 m_script;
+    QList<Token>            m_tokens;
+    int                     m_position;
+    QHash<QString, Value>   m_aliases;
+    bool                    m_resultSet;    // setResult was called
+    bool                    m_called;       // a function was called by the current statement
+    WatchPredicate          m_result;
+
+    bool tokenize();
+    bool statement();
+    bool skipFunction();
+    bool expression(Value *valueP);
+    bool orExpression(Value *valueP);
+    bool andExpression(Value *valueP);
+    bool unaryExpression(Value *valueP);
+    bool comparison(Value *valueP);
+    bool primary(Value *valueP);
+    bool methods(Value *valueP);
+
+    Value compare(const Value &left, const QString &op, const Value &right);
+    Value compareAttribute(const Value &attribute, const QString &op, const Value &literal);
+
+    static WatchPredicate toPredicate(const Value &value);
+    static QString flipOperator(const QString &op);
+
+    inline const Token &current() const {
+        return m_tokens[m_position];
+    }
+
+    inline bool isPunctuator(const QString &text) const {
+        return current().m_type == Token::Punctuator && current().m_text == text;
+    }
+
+    inline bool isIdentifier(const QString &text) const {
+        return current().m_type == Token::Identifier && current().m_text == text;
+    }
+
+    bool accept(const QString &punctuator);
+};
+
+#endif // WATCHPREDICATE_H
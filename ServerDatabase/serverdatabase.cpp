@@ -30,11 +30,31 @@
 #include <QPluginLoader>
 #include <QSqlDriverPlugin>
 #include <QSqlDriver>
+#include <QThread>
 
 #include "serverdatabase.h"
 
 int         ServerDatabase::m_dbref = 0;
 QSemaphore  ServerDatabase::m_dbSem(1);
+QThread     *ServerDatabase::m_threadP = NULL;
+QSqlDriverPlugin *ServerDatabase::m_sqlPluginP = NULL;
+QAtomicInt  ServerDatabase::m_numConnections(0);
+QThreadStorage<ThreadConnection *> ServerDatabase::m_connections;
+
+/**
+  * Closes and removes the thread's connection, from the thread exiting.
+  */
+ThreadConnection::~ThreadConnection() {
+    {
+        QSqlDatabase db = QSqlDatabase::database(m_name, false);
+        if (db.isOpen()) {
+            db.commit();
+            db.close();
+        }
+    }
+
+    QSqlDatabase::removeDatabase(m_name);
+}
 
 /**
   * The constructor creates the db and the tables if required. There's a single instance of db for all
@@ -57,6 +77,7 @@ ServerDatabase::ServerDatabase() {
         }
 
         QSqlDriverPlugin *sqlPlugin  = qobject_cast<QSqlDriverPlugin *>(loader.instance());
+        m_sqlPluginP = sqlPlugin;
 #ifdef _VERBOSE_DATABASE
         qDebug() << "Available sql drivers: " << sqlPlugin->keys();
 #endif
@@ -73,6 +94,7 @@ ServerDatabase::ServerDatabase() {
             return;
         }
         m_db = QSqlDatabase::addDatabase(sqlDriver);
+        m_threadP = QThread::currentThread();
 
         // create tables if non existing
         createTables();
@@ -93,6 +115,40 @@ ServerDatabase::~ServerDatabase() {
     }
 }
 
+/**
+  * Returns the calling thread's connection. A connection may only be used from the thread which
+  * created it: the thread which opened the db uses the default connection, the others (the
+  * indexers' persist threads) open their own the first time, removed when they exit.
+  */
+QSqlDatabase ServerDatabase::getDatabase() {
+    if (QThread::currentThread() == m_threadP)
+        return QSqlDatabase::database();
+
+    if (m_connections.hasLocalData())
+        return QSqlDatabase::database(m_connections.localData()->m_name, false);
+
+    QString name = QString(DB_THREAD_CONNECTION).arg(m_numConnections.fetchAndAddOrdered(1));
+    m_connections.setLocalData(new ThreadConnection(name));
+
+    QSqlDriver *sqlDriver = m_sqlPluginP ? m_sqlPluginP->create(DB_TYPE) : NULL;
+    if (!sqlDriver) {
+        qDebug() << QObject::tr("Failed to instantiate mysql driver");
+        return QSqlDatabase();
+    }
+
+    sqlDriver->open(DB_NAME, DB_USR, DB_PWD, DB_HOST);
+    if (sqlDriver->isOpenError()) {
+        qDebug() << QObject::tr("Failed to connect to (") + DB_TYPE + QObject::tr(") DB ") + DB_NAME + QObject::tr(" on host ") + DB_HOST + QObject::tr(" with usr/pwd '") + DB_USR + "/" + DB_PWD + "'";
+        qDebug() << QObject::tr("ERROR: ") + sqlDriver->lastError().text();
+    }
+
+#ifdef _VERBOSE_DATABASE
+    qDebug() << "Opened the thread connection " << name;
+#endif
+
+    return QSqlDatabase::addDatabase(sqlDriver, name);
+}
+
 /**
  * Create the "files" and "attributes" tables if they don't exist yet
  *
@@ -101,7 +157,7 @@ void ServerDatabase::createTables() {
     if (!m_db.tables().isEmpty())
         return;
 
-    QSqlQuery query(m_db);
+    QSqlQuery query(getDatabase());
 
 #ifdef _VERBOSE_DATABASE
     qDebug() << "Creating table filters" << m_dbref;
@@ -173,7 +229,7 @@ void ServerDatabase::createTables() {
 void ServerDatabase::cleanup(bool includingFilters) {
     m_dbSem.acquire();
 
-    QSqlQuery query(m_db);
+    QSqlQuery query(getDatabase());
 
 #ifdef _VERBOSE_DATABASE
     qDebug() << "Cleaning up tables" << m_dbref;
@@ -205,7 +261,7 @@ bool ServerDatabase::hasFile(QString filterId, QString filepath) {
 
     m_dbSem.acquire();
 
-    QSqlQuery query(m_db);
+    QSqlQuery query(getDatabase());
 
     sanitizeString(filepath);
 
@@ -242,7 +298,7 @@ QStringList ServerDatabase::getFileAttributes(QString filterId, QString filepath
 
     QStringList result;
 
-    QSqlQuery query(m_db);
+    QSqlQuery query(getDatabase());
 
     sanitizeString(filepath);
 
@@ -280,7 +336,7 @@ QString ServerDatabase::getFileAttribute(QString filterId, QString filepath, QSt
 
     m_dbSem.acquire();
 
-    QSqlQuery query(m_db);
+    QSqlQuery query(getDatabase());
 
     sanitizeString(filepath);
     sanitizeString(attrName);
@@ -307,6 +363,45 @@ QString ServerDatabase::getFileAttribute(QString filterId, QString filepath, QSt
     return result;
 }
 
+/**
+ * Gets a file's attribute names/values from the db, in a single query.
+ *
+ * @param filterId is the filter id
+ * @param filepath is the full pathname of the file
+ * @return the attribute name/value pairs
+ */
+QList<QPair<QString, QString> > ServerDatabase::getFileAttributeValues(QString filterId, QString filepath) {
+    QList<QPair<QString, QString> > result;
+
+    m_dbSem.acquire();
+
+    QSqlQuery query(getDatabase());
+
+    sanitizeString(filepath);
+
+#ifdef _VERBOSE_DATABASE
+    qDebug() << "retrieving file attribute values for " << filterId << "/" << filepath;
+#endif
+
+    if (!query.exec("SELECT attributes.attribute_name, attributes.attribute_value FROM files, attributes WHERE files.path='" + filepath + "' AND files.filter_id=" + filterId + " AND files.file_id=attributes.file_id")) {
+        qDebug() << QObject::tr("Failed to select from attributes table in DB ") + DB_NAME + QObject::tr(" on host ") + DB_HOST + QObject::tr(" with usr/pwd ") + DB_USR + "/" + DB_PWD;
+        qDebug() << QObject::tr("ERROR: ") + query.lastError().text();
+    } else {
+        while (query.next()) {
+            QString name = query.value(0).toString();
+            QString value = query.value(1).toString();
+            unsanitizeString(name);
+            unsanitizeString(value);
+
+            result.append(qMakePair(name, value));
+        }
+    }
+
+    m_dbSem.release();
+
+    return result;
+}
+
 /**
  * Adds a new (unique) file attribute pair (name/value) to the db
  *
@@ -317,7 +412,7 @@ QString ServerDatabase::getFileAttribute(QString filterId, QString filepath, QSt
 void ServerDatabase::addFileAttribute(QString fileId, QString attrName, QString attrValue) {
     m_dbSem.acquire();
 
-    QSqlQuery query(m_db);
+    QSqlQuery query(getDatabase());
 
     sanitizeString(attrName);
     sanitizeString(attrValue);
@@ -350,7 +445,7 @@ QStringList ServerDatabase::getFiles(QString filterId) {
 
     QStringList result;
 
-    QSqlQuery query(m_db);
+    QSqlQuery query(getDatabase());
 
 #ifdef _VERBOSE_DATABASE
         qDebug() << "retrieving files for " << filterId;
@@ -377,6 +472,52 @@ QStringList ServerDatabase::getFiles(QString filterId) {
     return result;
 }
 
+/**
+ * Gets all file references and their attribute names/values from the db for a given filter,
+ * in a single query.
+ *
+ * @param filterId is the filter id
+ * @return the attribute name/value pairs by file path
+ */
+QHash<QString, QList<QPair<QString, QString> > > ServerDatabase::getFilesAttributes(QString filterId) {
+    m_dbSem.acquire();
+
+    QHash<QString, QList<QPair<QString, QString> > > result;
+
+    QSqlQuery query(getDatabase());
+    query.setForwardOnly(true);
+
+#ifdef _VERBOSE_DATABASE
+        qDebug() << "retrieving files attributes for " << filterId;
+#endif
+
+    // get files and attributes, a file without attributes comes with a NULL name
+    if (!query.exec("SELECT files.path, attributes.attribute_name, attributes.attribute_value FROM files LEFT JOIN attributes ON files.file_id=attributes.file_id WHERE files.filter_id=" + filterId)) {
+        qDebug() << QObject::tr("Failed to query from files table in DB ") + DB_NAME + QObject::tr(" on host ") + DB_HOST + QObject::tr(" with usr/pwd ") + DB_USR + "/" + DB_PWD;
+        qDebug() << QObject::tr("ERROR: ") + query.lastError().text();
+    } else {
+        while (query.next()) {
+            QString filepath = query.value(0).toString();
+            unsanitizeString(filepath);
+
+            QList<QPair<QString, QString> > &attributes = result[filepath];
+            if (query.value(1).isNull())
+                continue;
+
+            QString name = query.value(1).toString();
+            QString value = query.value(2).toString();
+            unsanitizeString(name);
+            unsanitizeString(value);
+
+            attributes.append(qMakePair(name, value));
+        }
+    }
+
+    m_dbSem.release();
+
+    return result;
+}
+
 
 /**
  * Adds a new (unique) file reference to the db
@@ -389,7 +530,7 @@ QString ServerDatabase::addFile(QString filterId, QString filepath) {
     m_dbSem.acquire();
 
     QString fileId;
-    QSqlQuery query(m_db);
+    QSqlQuery query(getDatabase());
 
     sanitizeString(filepath);
 
@@ -426,7 +567,7 @@ QString ServerDatabase::addFile(QString filterId, QString filepath) {
 void ServerDatabase::removeFile(QString filterId, QString filepath) {
     m_dbSem.acquire();
 
-    QSqlQuery query(m_db);
+    QSqlQuery query(getDatabase());
 
     sanitizeString(filepath);
 
@@ -455,6 +596,57 @@ void ServerDatabase::removeFile(QString filterId, QString filepath) {
     m_dbSem.release();
 }
 
+/**
+ * Renames a file reference in the db, its attributes are kept. If the new path is already
+ * referenced (saved meanwhile), the old reference is just removed.
+ *
+ * @param filterId is the filter id
+ * @param oldFilepath is the full pathname the file was saved with
+ * @param newFilepath is the new full pathname of the file
+ * @return the old file reference was found
+ */
+bool ServerDatabase::moveFile(QString filterId, QString oldFilepath, QString newFilepath) {
+    bool result = FALSE;
+
+    m_dbSem.acquire();
+
+    QSqlQuery query(getDatabase());
+
+    sanitizeString(oldFilepath);
+    sanitizeString(newFilepath);
+
+#ifdef _VERBOSE_DATABASE
+    qDebug() << "moving file " << filterId << "/" << oldFilepath << " to " << newFilepath;
+#endif
+
+    // retrieve file_id for the given file, filterId
+    if (!query.exec("SELECT file_id FROM files WHERE path='" + oldFilepath + "' AND filter_id=" + filterId) || !query.next())
+        goto moveFileEnd;
+
+    {
+        QString fileId = query.value(0).toString();
+        result = TRUE;
+
+        // already saved with its new path, the old reference is stale
+        query.exec("SELECT file_id FROM files WHERE path='" + newFilepath + "' AND filter_id=" + filterId);
+        if (query.next()) {
+            query.exec("DELETE FROM files WHERE file_id=" + fileId);
+            query.exec("DELETE FROM attributes WHERE file_id=" + fileId);
+            goto moveFileEnd;
+        }
+
+        if (!query.exec("UPDATE files SET path='" + newFilepath + "' WHERE file_id=" + fileId)) {
+            qDebug() << QObject::tr("Failed to update files table in DB ") + DB_NAME + QObject::tr(" on host ") + DB_HOST + QObject::tr(" with usr/pwd ") + DB_USR + "/" + DB_PWD;
+            qDebug() << QObject::tr("ERROR: ") + query.lastError().text();
+        }
+    }
+
+moveFileEnd:
+    m_dbSem.release();
+
+    return result;
+}
+
 /**
  * Removes all file references from the db
  *
@@ -463,8 +655,8 @@ void ServerDatabase::removeFile(QString filterId, QString filepath) {
 void ServerDatabase::removeFiles(QString filterId) {
     m_dbSem.acquire();
 
-    QSqlQuery query(m_db);
-    QSqlQuery delQuery(m_db);
+    QSqlQuery query(getDatabase());
+    QSqlQuery delQuery(getDatabase());
 
 #ifdef _VERBOSE_DATABASE
     qDebug() << "removing files for " << filterId;
@@ -497,6 +689,35 @@ void ServerDatabase::removeFiles(QString filterId) {
     m_dbSem.release();
 }
 
+/**
+ * Removes the given attributes of all the files of a filter from the db
+ *
+ * @param filterId is the filter id
+ * @param attrNames are the names of the file attributes
+ */
+void ServerDatabase::removeFilesAttributes(QString filterId, QStringList attrNames) {
+    if (attrNames.isEmpty())
+        return;
+
+    m_dbSem.acquire();
+
+    QSqlQuery query(getDatabase());
+
+    for (int i = 0; i < attrNames.count(); i++)
+        sanitizeString(attrNames[i]);
+
+#ifdef _VERBOSE_DATABASE
+    qDebug() << "removing files attributes for " << filterId << ": " << attrNames;
+#endif
+
+    if (!query.exec("DELETE attributes FROM attributes, files WHERE files.filter_id=" + filterId + " AND attributes.file_id=files.file_id AND attributes.attribute_name IN ('" + attrNames.join("', '") + "')")) {
+        qDebug() << QObject::tr("Failed to delete from attributes table in DB ") + DB_NAME + QObject::tr(" on host ") + DB_HOST + QObject::tr(" with usr/pwd ") + DB_USR + "/" + DB_PWD;
+        qDebug() << QObject::tr("ERROR: ") + query.lastError().text();
+    }
+
+    m_dbSem.release();
+}
+
 /**
   * Sanitize: replace "'" substrings in filepaths by "%Q%"
   * Unsanitize: replace "%Q%" substrings in filepaths by "'".
@@ -522,7 +743,7 @@ void ServerDatabase::unsanitizeString(QString &string) {
 void ServerDatabase::addFilter(QString virtualDirectoryPath) {
     m_dbSem.acquire();
 
-    QSqlQuery query(m_db);
+    QSqlQuery query(getDatabase());
 
     sanitizeString(virtualDirectoryPath);
 
@@ -550,7 +771,7 @@ QStringList ServerDatabase::getFilters() {
 
     QStringList result;
 
-    QSqlQuery query(m_db);
+    QSqlQuery query(getDatabase());
 
 #ifdef _VERBOSE_DATABASE
         qDebug() << "retrieving filters";
@@ -585,7 +806,7 @@ QStringList ServerDatabase::getFilters() {
 void ServerDatabase::deleteFilter(QString filterId) {
     m_dbSem.acquire();
 
-    QSqlQuery query(m_db);
+    QSqlQuery query(getDatabase());
 
 #ifdef _VERBOSE_DATABASE
     qDebug() << "removing filter " << filterId;
@@ -610,7 +831,7 @@ QString ServerDatabase::getFilterId(QString virtualDirectoryPath) {
 
     m_dbSem.acquire();
 
-    QSqlQuery query(m_db);
+    QSqlQuery query(getDatabase());
 
     sanitizeString(virtualDirectoryPath);
 
@@ -26,7 +26,11 @@
 #include <QSqlDatabase>
 #include <QVector>
 #include <QStringList>
+#include <QHash>
+#include <QPair>
 #include <QSemaphore>
+#include <QThreadStorage>
+#include <QAtomicInt>
 
 #include "ServerDatabase_global.h"
 
@@ -43,14 +47,33 @@
 #define DB_TYPE "QMYSQL"
 #define DB_USR  "SION"
 #define DB_PWD  "SION"
+#define DB_THREAD_CONNECTION    "SIONThread%1" // the connection names of the threads other than the db opener's
 
 #define MAX_PATH_LEN            QString("512")
 #define MAX_VIRTUAL_PATH_LEN    QString("256")
 #define MAX_ATTR_NAME_LEN       QString("64")
 #define MAX_ATTR_VALUE_LEN      QString("128")
 
+class QThread;
+class QSqlDriverPlugin;
+
 /**
-  * This class serves as an helper to access the MySQL SION! server database.
+  * A thread's own connection to the db, by name, removed when the thread exits.
+  */
+class ThreadConnection {
+public:
+    explicit ThreadConnection(const QString &name) {
+        m_name = name;
+    }
+
+    ~ThreadConnection();
+
+    QString m_name;
+};
+
+/**
+  * This class serves as an helper to access the MySQL SION! server database. The queries go
+  * through the calling thread's connection (see getDatabase).
   */
 class SERVERDATABASESHARED_EXPORT ServerDatabase {
 public:
@@ -66,15 +89,25 @@ public:
     QStringList             getFileAttributes(QString filterId, QString filepath);
     void                    addFileAttribute(QString fileId, QString attrName, QString attrValue);
     QString                 getFileAttribute(QString filterId, QString filepath, QString attrName);
+    QList<QPair<QString, QString> > getFileAttributeValues(QString filterId, QString filepath);
     QString                 addFile(QString filterId, QString filepath);
     QStringList             getFiles(QString filterId);
+    QHash<QString, QList<QPair<QString, QString> > > getFilesAttributes(QString filterId);
     void                    removeFile(QString filterId, QString filepath);
+    bool                    moveFile(QString filterId, QString oldFilepath, QString newFilepath);
     void                    removeFiles(QString filterId);
+    void                    removeFilesAttributes(QString filterId, QStringList attrNames);
 
 private:
     QSqlDatabase        m_db;
     static int          m_dbref;
     static QSemaphore   m_dbSem;
+    static QThread      *m_threadP;         // the thread which opened the db, uses the default connection
+    static QSqlDriverPlugin *m_sqlPluginP;  // creates the other threads' drivers
+    static QAtomicInt   m_numConnections;   // the thread connections opened, to name them
+    static QThreadStorage<ThreadConnection *> m_connections; // the connection of each other thread
+
+    static QSqlDatabase getDatabase();
 
     void sanitizeString(QString &string);
     void unsanitizeString(QString &string);